@@ -0,0 +1,155 @@
+#include <smbus_pec.h>
+#include <hardware/timer.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if PICO_ON_DEVICE
+#include <pico/stdlib.h>
+#define PEC_BENCH_DEFAULT_REPS 20
+#else
+#define PEC_BENCH_DEFAULT_REPS 2000
+#endif
+
+#define PEC_BENCH_MAX_LEN 255
+
+typedef uint8_t (*pec_kernel_t)(uint8_t crc, const uint8_t block[], size_t block_len);
+
+typedef struct pec_bench_kernel_t
+{
+    const char* name;
+    pec_kernel_t kernel;
+}
+pec_bench_kernel_t;
+
+static const pec_bench_kernel_t pec_bench_kernels[] = {
+    { "bytewise",   smbus_pec_block_bytewise },
+    { "slice4",     smbus_pec_block_slice4 },
+    { "nibble",     smbus_pec_block_nibble },
+    { "block",      smbus_pec_block },
+};
+
+static const size_t pec_bench_lengths[] = { 1, 2, 4, 8, 16, 33, 64, 128, 255 };
+
+static uint8_t pec_bench_buffer[PEC_BENCH_MAX_LEN];
+static volatile uint8_t pec_bench_sink;
+
+
+static uint8_t pec_bench_reference(uint8_t crc, const uint8_t block[], size_t block_len)
+{
+    for (size_t i = 0; i < block_len; ++i)
+    {
+        crc ^= block[i];
+
+        for (uint bit = 0; bit < 8; ++bit)
+        {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+
+    return crc;
+}
+
+static bool pec_bench_verify(const pec_bench_kernel_t* kernel)
+{
+    for (size_t len = 0; len <= PEC_BENCH_MAX_LEN; ++len)
+    {
+        for (uint seed = 0; seed < 256; seed += 51)
+        {
+            uint8_t expected = pec_bench_reference((uint8_t)seed, pec_bench_buffer, len);
+            uint8_t actual = kernel->kernel((uint8_t)seed, pec_bench_buffer, len);
+
+            if(actual != expected)
+            {
+                printf("%s: mismatch at len %u seed %u: %02X != %02X\n", 
+                    kernel->name, (uint)len, seed, actual, expected);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static double pec_bench_ns_per_byte(const pec_bench_kernel_t* kernel, size_t first_len, size_t last_len, uint reps)
+{
+    uint64_t bytes = 0;
+    uint8_t crc = 0;
+    uint64_t start_us = time_us_64();
+
+    for (uint rep = 0; rep < reps; ++rep)
+    {
+        for (size_t len = first_len; len <= last_len; ++len)
+        {
+            crc = kernel->kernel(crc, pec_bench_buffer, len);
+            bytes += len;
+        }
+    }
+
+    uint64_t elapsed_us = time_us_64() - start_us;
+    pec_bench_sink = crc;
+
+    return (double)elapsed_us * 1000.0 / (double)bytes;
+}
+
+
+int main(int argc, char* argv[])
+{
+    uint reps = PEC_BENCH_DEFAULT_REPS;
+    size_t kernels_len = sizeof(pec_bench_kernels) / sizeof(pec_bench_kernels[0]);
+    size_t lengths_len = sizeof(pec_bench_lengths) / sizeof(pec_bench_lengths[0]);
+    bool is_verified = true;
+
+#if PICO_ON_DEVICE
+    stdio_init_all();
+#else
+    if(argc > 1)
+    {
+        reps = (uint)strtoul(argv[1], NULL, 0);
+    }
+#endif
+
+    for (size_t i = 0; i < PEC_BENCH_MAX_LEN; ++i)
+    {
+        pec_bench_buffer[i] = (uint8_t)(i * 167 + 13);
+    }
+
+    for (size_t k = 0; k < kernels_len; ++k)
+    {
+        is_verified &= pec_bench_verify(&pec_bench_kernels[k]);
+    }
+
+    if(!is_verified)
+    {
+        return 1;
+    }
+
+    printf("smbus_pec_block kernel %d, output identical to bitwise CRC-8 for 0-%d bytes\n", 
+        SMBUS_PEC_KERNEL, PEC_BENCH_MAX_LEN);
+    printf("ns/byte   %8s", "1-255");
+
+    for (size_t l = 0; l < lengths_len; ++l)
+    {
+        printf(" %7u", (uint)pec_bench_lengths[l]);
+    }
+
+    printf("\n");
+
+    for (size_t k = 0; k < kernels_len; ++k)
+    {
+        const pec_bench_kernel_t* kernel = &pec_bench_kernels[k];
+
+        printf("%-9s %8.2f", kernel->name, pec_bench_ns_per_byte(kernel, 1, PEC_BENCH_MAX_LEN, reps));
+
+        for (size_t l = 0; l < lengths_len; ++l)
+        {
+            size_t len = pec_bench_lengths[l];
+            uint len_reps = reps * (PEC_BENCH_MAX_LEN / len + 1);
+
+            printf(" %7.2f", pec_bench_ns_per_byte(kernel, len, len, len_reps));
+        }
+
+        printf("\n");
+    }
+
+    return 0;
+}
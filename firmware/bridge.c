@@ -0,0 +1,242 @@
+#include "bridge.h"
+#include <assert.h>
+#include <string.h>
+
+
+typedef struct bridge_buffer_t
+{
+    uint8_t* data;
+    size_t len;
+    size_t max;
+}
+bridge_buffer_t;
+
+static uint8_t bridge_stream_response[BRIDGE_FRAME_LEN_SIZE + BRIDGE_MAX_MESSAGE_LEN];
+
+
+static bool bridge_has_room(const bridge_buffer_t* buffer, size_t len)
+{
+    return buffer->max - buffer->len >= len;
+}
+
+static void bridge_put(bridge_buffer_t* buffer, uint8_t value)
+{
+    buffer->data[buffer->len++] = value;
+}
+
+static void bridge_put16(bridge_buffer_t* buffer, uint16_t value)
+{
+    bridge_put(buffer, (uint8_t)(value >> 0));
+    bridge_put(buffer, (uint8_t)(value >> 8));
+}
+
+static void bridge_put32(bridge_buffer_t* buffer, uint32_t value)
+{
+    bridge_put16(buffer, (uint16_t)(value >> 0));
+    bridge_put16(buffer, (uint16_t)(value >> 16));
+}
+
+static uint16_t bridge_get16(const uint8_t* data)
+{
+    return data[0] | (data[1] << 8);
+}
+
+// A result that would not fit gets BRIDGE_NO_ROOM in the room left, or
+// nothing at all when not even that fits
+static void bridge_put_status(bridge_buffer_t* response, uint8_t op, const uint8_t* command, uint8_t status)
+{
+    if(bridge_has_room(response, command ? 3 : 2))
+    {
+        bridge_put(response, op);
+
+        if(command)
+        {
+            bridge_put(response, *command);
+        }
+
+        bridge_put(response, status);
+    }
+}
+
+static void bridge_read(i2c_inst_t* i2c, uint8_t command, bridge_buffer_t* response)
+{
+    uint8_t data[SMBUS_MAX_BUFFER_LEN + 1];
+    size_t data_len = smbus_reg_read(i2c, command, data, sizeof(data));
+
+    if(data_len == 0)
+    {
+        bridge_put_status(response, BRIDGE_OP_READ, &command, BRIDGE_REFUSED);
+    }
+    else
+    if(!bridge_has_room(response, 5 + data_len))
+    {
+        bridge_put_status(response, BRIDGE_OP_READ, &command, BRIDGE_NO_ROOM);
+    }
+    else
+    {
+        bridge_put(response, BRIDGE_OP_READ);
+        bridge_put(response, command);
+        bridge_put(response, BRIDGE_OK);
+        bridge_put16(response, data_len);
+        memcpy(&response->data[response->len], data, data_len);
+        response->len += data_len;
+    }
+}
+
+static void bridge_write(i2c_inst_t* i2c, uint8_t command, const uint8_t* data, size_t data_len, bridge_buffer_t* response)
+{
+    bool is_written = smbus_reg_write(i2c, command, data, data_len);
+
+    bridge_put_status(response, BRIDGE_OP_WRITE, &command, is_written ? BRIDGE_OK : BRIDGE_REFUSED);
+}
+
+static void bridge_stats(i2c_inst_t* i2c, bridge_buffer_t* response)
+{
+    smbus_stats_t stats;
+    const uint32_t* counters = (const uint32_t*)&stats;
+    size_t counter_count = sizeof(stats) / sizeof(uint32_t);
+
+    static_assert(sizeof(smbus_stats_t) % sizeof(uint32_t) == 0, "smbus_stats_t holds uint32_t counters only");
+
+    if(!bridge_has_room(response, 4 + sizeof(stats)))
+    {
+        bridge_put_status(response, BRIDGE_OP_STATS, NULL, BRIDGE_NO_ROOM);
+        return;
+    }
+
+    smbus_get_stats(i2c, &stats);
+
+    bridge_put(response, BRIDGE_OP_STATS);
+    bridge_put(response, BRIDGE_OK);
+    bridge_put16(response, sizeof(stats));
+
+    for (size_t i = 0; i < counter_count; ++i)
+    {
+        bridge_put32(response, counters[i]);
+    }
+}
+
+size_t bridge_process(
+    i2c_inst_t* i2c,
+    const uint8_t* request,
+    size_t request_len,
+    uint8_t* response,
+    size_t response_max
+)
+{
+    bridge_buffer_t buffer = { response, 0, response_max };
+    size_t i = BRIDGE_HEADER_LEN;
+
+    if(request_len < BRIDGE_HEADER_LEN || bridge_get16(request) != BRIDGE_MAGIC || response_max < BRIDGE_HEADER_LEN)
+    {
+        return 0;
+    }
+
+    // Magic and sequence go back as they came
+    memcpy(response, request, BRIDGE_HEADER_LEN);
+    buffer.len = BRIDGE_HEADER_LEN;
+
+    while (i < request_len)
+    {
+        uint8_t op = request[i++];
+        size_t left = request_len - i;
+
+        switch (op)
+        {
+            case BRIDGE_OP_READ:
+            {
+                if(left < 1)
+                {
+                    bridge_put_status(&buffer, op, NULL, BRIDGE_MALFORMED);
+                    return buffer.len;
+                }
+
+                bridge_read(i2c, request[i], &buffer);
+                i += 1;
+            }
+            break;
+
+            case BRIDGE_OP_WRITE:
+            {
+                if(left < 3 || left - 3 < bridge_get16(&request[i + 1]))
+                {
+                    bridge_put_status(&buffer, op, NULL, BRIDGE_MALFORMED);
+                    return buffer.len;
+                }
+
+                size_t data_len = bridge_get16(&request[i + 1]);
+
+                bridge_write(i2c, request[i], &request[i + 3], data_len, &buffer);
+                i += 3 + data_len;
+            }
+            break;
+
+            case BRIDGE_OP_STATS:
+            {
+                bridge_stats(i2c, &buffer);
+            }
+            break;
+
+            default:
+            {
+                bridge_put_status(&buffer, op, NULL, BRIDGE_MALFORMED);
+                return buffer.len;
+            }
+        }
+    }
+
+    return buffer.len;
+}
+
+bool bridge_process_stream(
+    i2c_inst_t* i2c,
+    uint8_t* stream,
+    size_t* stream_len,
+    bridge_send_t send,
+    void* context
+)
+{
+    size_t offset = 0;
+    bool is_served = true;
+
+    while (*stream_len - offset >= BRIDGE_FRAME_LEN_SIZE)
+    {
+        const uint8_t* frame = &stream[offset];
+        size_t request_len = bridge_get16(frame);
+
+        if(request_len > BRIDGE_MAX_MESSAGE_LEN)
+        {
+            is_served = false;
+            break;
+        }
+
+        if(*stream_len - offset < BRIDGE_FRAME_LEN_SIZE + request_len)
+        {
+            break;
+        }
+
+        size_t response_len = bridge_process(
+            i2c,
+            &frame[BRIDGE_FRAME_LEN_SIZE],
+            request_len,
+            &bridge_stream_response[BRIDGE_FRAME_LEN_SIZE],
+            BRIDGE_MAX_MESSAGE_LEN
+        );
+
+        bridge_stream_response[0] = (uint8_t)(response_len >> 0);
+        bridge_stream_response[1] = (uint8_t)(response_len >> 8);
+
+        offset += BRIDGE_FRAME_LEN_SIZE + request_len;
+
+        if(!send(context, bridge_stream_response, BRIDGE_FRAME_LEN_SIZE + response_len))
+        {
+            is_served = false;
+            break;
+        }
+    }
+
+    memmove(stream, &stream[offset], *stream_len - offset);
+    *stream_len -= offset;
+
+    return is_served;
+}
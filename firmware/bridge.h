@@ -0,0 +1,79 @@
+#ifndef BRIDGE_H
+#define BRIDGE_H
+
+#include <smbus/smbus_slave.h>
+
+// Remote access to the register map and stats, independent of transport.
+//
+// A request is BRIDGE_MAGIC, a 16-bit sequence number and any number of
+// operations. The response echoes magic and sequence and has one result
+// per operation, in order. All multi-byte fields are little endian.
+//
+//   request                         result
+//   READ   command                  READ   command status len16 data
+//   WRITE  command len16 data       WRITE  command status
+//   STATS                           STATS  status len16 smbus_stats_t
+//
+// Register data is laid out as on the bus, blocks with their count byte.
+// The result of a malformed operation is just the op and its status.
+// Over UDP a request is one datagram; over TCP requests and responses are
+// each preceded by their length as a 16-bit field.
+
+#define BRIDGE_PORT             4817
+#define BRIDGE_MAGIC            0x4253      // "SB"
+#define BRIDGE_HEADER_LEN       4
+#define BRIDGE_FRAME_LEN_SIZE   2
+
+// Keeps a response in one unfragmented datagram on Ethernet MTUs
+#define BRIDGE_MAX_MESSAGE_LEN  1472
+
+typedef enum bridge_op_t
+{
+    BRIDGE_OP_READ = 1,
+    BRIDGE_OP_WRITE,
+    BRIDGE_OP_STATS,
+}
+bridge_op_t;
+
+typedef enum bridge_status_t
+{
+    BRIDGE_OK,
+    BRIDGE_REFUSED,     // Unmapped, not readable/writable or a wrong length
+    BRIDGE_MALFORMED,   // The request ends early or has an unknown operation
+    BRIDGE_NO_ROOM,     // The result does not fit in the response
+}
+bridge_status_t;
+
+// Runs every operation in request and writes the results to response,
+// returning the response length. Processing stops at a malformed
+// operation, which gets a BRIDGE_MALFORMED result. Returns 0, i.e. no
+// response at all, for requests without a valid header.
+size_t bridge_process(
+    i2c_inst_t* i2c,
+    const uint8_t* request,
+    size_t request_len,
+    uint8_t* response,
+    size_t response_max
+);
+
+// Sends a framed response on a stream transport, false if it cannot
+typedef bool (*bridge_send_t)(void* context, const uint8_t* data, size_t data_len);
+
+// Serves every complete frame at the start of stream, which holds up to
+// BRIDGE_FRAME_LEN_SIZE + BRIDGE_MAX_MESSAGE_LEN bytes, and drops them
+// from it. False when the connection should be dropped: a frame is too
+// long or send failed.
+bool bridge_process_stream(
+    i2c_inst_t* i2c,
+    uint8_t* stream,
+    size_t* stream_len,
+    bridge_send_t send,
+    void* context
+);
+
+// Serves bridge_process() over lwIP on UDP and TCP port. Callbacks run
+// from cyw43_arch_poll(), i.e. in thread context; one TCP client is
+// served at a time.
+bool bridge_lwip_init(i2c_inst_t* i2c, uint16_t port);
+
+#endif // BRIDGE_H
@@ -0,0 +1,182 @@
+#include "bridge.h"
+#include <lwip/pbuf.h>
+#include <lwip/udp.h>
+#include <lwip/tcp.h>
+
+
+typedef struct bridge_tcp_t
+{
+    struct tcp_pcb* pcb;
+    uint8_t request[BRIDGE_FRAME_LEN_SIZE + BRIDGE_MAX_MESSAGE_LEN];
+    size_t request_len;
+}
+bridge_tcp_t;
+
+static i2c_inst_t* bridge_i2c;
+static struct udp_pcb* bridge_udp_pcb;
+static struct tcp_pcb* bridge_listen_pcb;
+static bridge_tcp_t bridge_tcp;
+
+static uint8_t bridge_request[BRIDGE_MAX_MESSAGE_LEN];
+static uint8_t bridge_response[BRIDGE_MAX_MESSAGE_LEN];
+
+
+static void bridge_udp_recv(void* arg, struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* addr, u16_t port)
+{
+    size_t request_len = 0;
+
+    // Anything longer was not sent by a client of this protocol
+    if(p->tot_len <= sizeof(bridge_request))
+    {
+        request_len = pbuf_copy_partial(p, bridge_request, p->tot_len, 0);
+    }
+
+    pbuf_free(p);
+
+    size_t response_len = bridge_process(bridge_i2c, bridge_request, request_len, bridge_response, BRIDGE_MAX_MESSAGE_LEN);
+
+    if(response_len > 0)
+    {
+        struct pbuf* response = pbuf_alloc(PBUF_TRANSPORT, response_len, PBUF_RAM);
+
+        if(response != NULL)
+        {
+            pbuf_take(response, bridge_response, response_len);
+            udp_sendto(pcb, response, addr, port);
+            pbuf_free(response);
+        }
+    }
+}
+
+static void bridge_tcp_close(bridge_tcp_t* tcp)
+{
+    if(tcp->pcb != NULL)
+    {
+        tcp_arg(tcp->pcb, NULL);
+        tcp_recv(tcp->pcb, NULL);
+        tcp_err(tcp->pcb, NULL);
+
+        if(tcp_close(tcp->pcb) != ERR_OK)
+        {
+            tcp_abort(tcp->pcb);
+        }
+
+        tcp->pcb = NULL;
+    }
+}
+
+static void bridge_tcp_err(void* arg, err_t err)
+{
+    bridge_tcp_t* tcp = arg;
+
+    // lwIP has freed the pcb already
+    tcp->pcb = NULL;
+}
+
+static bool bridge_tcp_send(void* context, const uint8_t* data, size_t data_len)
+{
+    bridge_tcp_t* tcp = context;
+
+    // TCP_SND_BUF holds several responses; a client that does not read
+    // them is dropped rather than buffered for
+    return tcp_write(tcp->pcb, data, data_len, TCP_WRITE_FLAG_COPY) == ERR_OK;
+}
+
+static err_t bridge_tcp_recv(void* arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err)
+{
+    bridge_tcp_t* tcp = arg;
+
+    if(p == NULL)
+    {
+        bridge_tcp_close(tcp);
+        return ERR_OK;
+    }
+
+    u16_t data_len = p->tot_len;
+    size_t offset = 0;
+    bool is_served = true;
+
+    // A frame always fits the request buffer, so serving empties it far
+    // enough for the next chunk
+    while (is_served && offset < data_len)
+    {
+        size_t copy_len = MIN(data_len - offset, sizeof(tcp->request) - tcp->request_len);
+
+        pbuf_copy_partial(p, &tcp->request[tcp->request_len], copy_len, offset);
+        tcp->request_len += copy_len;
+        offset += copy_len;
+
+        is_served = bridge_process_stream(bridge_i2c, tcp->request, &tcp->request_len, bridge_tcp_send, tcp);
+    }
+
+    tcp_output(pcb);
+
+    tcp_recved(pcb, data_len);
+    pbuf_free(p);
+
+    if(!is_served)
+    {
+        tcp_abort(pcb);
+        tcp->pcb = NULL;
+        return ERR_ABRT;
+    }
+
+    return ERR_OK;
+}
+
+static err_t bridge_tcp_accept(void* arg, struct tcp_pcb* pcb, err_t err)
+{
+    if(err != ERR_OK || pcb == NULL)
+    {
+        return ERR_VAL;
+    }
+
+    if(bridge_tcp.pcb != NULL)
+    {
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+
+    bridge_tcp.pcb = pcb;
+    bridge_tcp.request_len = 0;
+
+    tcp_arg(pcb, &bridge_tcp);
+    tcp_recv(pcb, bridge_tcp_recv);
+    tcp_err(pcb, bridge_tcp_err);
+    tcp_nagle_disable(pcb);
+
+    return ERR_OK;
+}
+
+bool bridge_lwip_init(i2c_inst_t* i2c, uint16_t port)
+{
+    bridge_i2c = i2c;
+
+    bridge_udp_pcb = udp_new_ip_type(IPADDR_TYPE_ANY);
+
+    if(bridge_udp_pcb == NULL || udp_bind(bridge_udp_pcb, IP_ANY_TYPE, port) != ERR_OK)
+    {
+        return false;
+    }
+
+    udp_recv(bridge_udp_pcb, bridge_udp_recv, NULL);
+
+    struct tcp_pcb* pcb = tcp_new_ip_type(IPADDR_TYPE_ANY);
+
+    if(pcb == NULL || tcp_bind(pcb, IP_ANY_TYPE, port) != ERR_OK)
+    {
+        return false;
+    }
+
+    bridge_listen_pcb = tcp_listen_with_backlog(pcb, 1);
+
+    if(bridge_listen_pcb == NULL)
+    {
+        tcp_close(pcb);
+        return false;
+    }
+
+    tcp_accept(bridge_listen_pcb, bridge_tcp_accept);
+
+    return true;
+}
@@ -0,0 +1,112 @@
+#include "event_log.h"
+#include <hardware/sync.h>
+
+
+static struct
+{
+    uint8_t buffer[EVENT_LOG_LEN];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    uint16_t lost;
+    spin_lock_t* lock;
+}
+event_log;
+
+
+void event_log_init()
+{
+    event_log.lock = spin_lock_instance(spin_lock_claim_unused(true));
+}
+
+
+static uint32_t __not_in_flash_func(event_log_put)(uint32_t head, const uint8_t* data, size_t data_len)
+{
+    for (size_t i = 0; i < data_len; ++i)
+    {
+        event_log.buffer[(head + i) & (EVENT_LOG_LEN - 1)] = data[i];
+    }
+
+    return head + data_len;
+}
+
+static uint32_t __not_in_flash_func(event_log_put_record)(uint32_t head, event_log_type_t type, const uint8_t* payload, size_t payload_len)
+{
+    uint8_t header[EVENT_LOG_HEADER_LEN] = { EVENT_LOG_SYNC, type, payload_len };
+
+    head = event_log_put(head, header, sizeof(header));
+    return event_log_put(head, payload, payload_len);
+}
+
+void __not_in_flash_func(event_log_append)(event_log_type_t type, const uint8_t* payload, size_t payload_len)
+{
+    uint8_t lost[sizeof(event_log.lost)];
+    size_t lost_len = 0;
+
+    if(payload_len > EVENT_LOG_MAX_PAYLOAD)
+    {
+        payload_len = EVENT_LOG_MAX_PAYLOAD;
+    }
+
+    // Handlers run in the ISR and in smbus_dispatch() on the SMBus core,
+    // and from smbus_reg_write() for the bridge on the other one. The lock
+    // keeps the other core out, masking interrupts the ISR on this one.
+    uint32_t interrupts = spin_lock_blocking(event_log.lock);
+
+    uint32_t free_len = EVENT_LOG_LEN - (event_log.head - event_log.tail);
+
+    if(event_log.lost)
+    {
+        lost_len = EVENT_LOG_HEADER_LEN + sizeof(lost);
+    }
+
+    if(free_len < lost_len + EVENT_LOG_HEADER_LEN + payload_len)
+    {
+        if(event_log.lost < UINT16_MAX)
+        {
+            ++event_log.lost;
+        }
+    }
+    else
+    {
+        uint32_t head = event_log.head;
+
+        if(lost_len)
+        {
+            lost[0] = (uint8_t)(event_log.lost >> 0);
+            lost[1] = (uint8_t)(event_log.lost >> 8);
+            head = event_log_put_record(head, EVENT_LOG_LOST, lost, sizeof(lost));
+            event_log.lost = 0;
+        }
+
+        head = event_log_put_record(head, type, payload, payload_len);
+
+        // The reader only ever sees whole records
+        __mem_fence_release();
+        event_log.head = head;
+    }
+
+    spin_unlock(event_log.lock, interrupts);
+}
+
+size_t event_log_read(uint8_t* buffer, size_t buffer_len)
+{
+    uint32_t tail = event_log.tail;
+    size_t data_len = event_log.head - tail;
+
+    __mem_fence_acquire();
+
+    if(data_len > buffer_len)
+    {
+        data_len = buffer_len;
+    }
+
+    for (size_t i = 0; i < data_len; ++i)
+    {
+        buffer[i] = event_log.buffer[(tail + i) & (EVENT_LOG_LEN - 1)];
+    }
+
+    __mem_fence_release();
+    event_log.tail = tail + data_len;
+
+    return data_len;
+}
@@ -0,0 +1,43 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+
+// Handlers append compact binary records which the main loop drains to
+// stdio. host/tools decodes them back into the "W-C1 01" text lines.
+//
+// A record is EVENT_LOG_SYNC, its type, the payload length and the
+// payload. stdio text stays 7-bit so the sync byte cannot appear in it.
+
+#ifndef EVENT_LOG_LEN
+#define EVENT_LOG_LEN 1024
+#endif
+
+static_assert((EVENT_LOG_LEN & (EVENT_LOG_LEN - 1)) == 0, "EVENT_LOG_LEN must be a power of two");
+
+#define EVENT_LOG_SYNC          0xA5
+#define EVENT_LOG_HEADER_LEN    3
+#define EVENT_LOG_MAX_PAYLOAD   255
+
+typedef enum event_log_type_t
+{
+    EVENT_LOG_QUICK = 1,        // is_on
+    EVENT_LOG_WRITE_REG,        // reg
+    EVENT_LOG_WRITE_DATA,       // command, value bytes MSB first
+    EVENT_LOG_WRITE_BLOCK,      // command, byte count, block bytes
+    EVENT_LOG_READ_REG,         // reg
+    EVENT_LOG_READ_UNKNOWN,     // command
+    EVENT_LOG_PROC_CALL,        // command, request MSB first, response MSB first
+    EVENT_LOG_LOST,             // number of records dropped, LSB first
+}
+event_log_type_t;
+
+// Claims the spin lock appends take, call before any handler can run
+void event_log_init();
+
+void event_log_append(event_log_type_t type, const uint8_t* payload, size_t payload_len);
+size_t event_log_read(uint8_t* buffer, size_t buffer_len);
+
+#endif // EVENT_LOG_H
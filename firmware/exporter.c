@@ -0,0 +1,134 @@
+#include "exporter.h"
+
+#define EXPORTER_READ_BATCH 16
+
+
+static void exporter_put16(uint8_t* data, uint16_t value)
+{
+    data[0] = (uint8_t)(value >> 0);
+    data[1] = (uint8_t)(value >> 8);
+}
+
+static void exporter_put32(uint8_t* data, uint32_t value)
+{
+    exporter_put16(&data[0], (uint16_t)(value >> 0));
+    exporter_put16(&data[2], (uint16_t)(value >> 16));
+}
+
+static uint16_t exporter_get16(const uint8_t* data)
+{
+    return data[0] | (data[1] << 8);
+}
+
+static uint32_t exporter_get32(const uint8_t* data)
+{
+    return exporter_get16(&data[0]) | ((uint32_t)exporter_get16(&data[2]) << 16);
+}
+
+void exporter_put_header(uint8_t* data, const exporter_header_t* header)
+{
+    exporter_put16(&data[0], header->magic);
+    data[2] = header->version;
+    data[3] = header->record_count;
+    exporter_put32(&data[4], header->sequence);
+    exporter_put32(&data[8], header->lost);
+}
+
+void exporter_get_header(const uint8_t* data, exporter_header_t* header)
+{
+    header->magic = exporter_get16(&data[0]);
+    header->version = data[2];
+    header->record_count = data[3];
+    header->sequence = exporter_get32(&data[4]);
+    header->lost = exporter_get32(&data[8]);
+}
+
+void exporter_put_record(uint8_t* data, const smbus_trace_record_t* record)
+{
+    exporter_put32(&data[0], record->timestamp_us);
+    exporter_put16(&data[4], record->data_len);
+    exporter_put16(&data[6], record->handler_us);
+    data[8] = record->bus_index;
+    data[9] = record->address;
+    data[10] = record->command;
+    data[11] = record->flags;
+}
+
+void exporter_get_record(const uint8_t* data, smbus_trace_record_t* record)
+{
+    record->timestamp_us = exporter_get32(&data[0]);
+    record->data_len = exporter_get16(&data[4]);
+    record->handler_us = exporter_get16(&data[6]);
+    record->bus_index = data[8];
+    record->address = data[9];
+    record->command = data[10];
+    record->flags = data[11];
+}
+
+static size_t exporter_capacity(size_t datagram_max)
+{
+    return MIN((datagram_max - EXPORTER_HEADER_LEN) / EXPORTER_RECORD_LEN, EXPORTER_MAX_RECORDS);
+}
+
+bool exporter_is_full(const exporter_t* exporter, size_t datagram_max)
+{
+    return exporter->record_count >= exporter_capacity(datagram_max);
+}
+
+size_t exporter_pack(exporter_t* exporter, uint8_t* datagram, size_t datagram_max)
+{
+    smbus_trace_record_t records[EXPORTER_READ_BATCH];
+    size_t capacity = exporter_capacity(datagram_max);
+    size_t packed = 0;
+
+    while (exporter->record_count < capacity)
+    {
+        size_t count = smbus_trace_read(&exporter->cursor, records, MIN(capacity - exporter->record_count, EXPORTER_READ_BATCH));
+
+        if(count == 0)
+        {
+            break;
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint8_t* data = &datagram[EXPORTER_HEADER_LEN + exporter->record_count * EXPORTER_RECORD_LEN];
+
+            exporter_put_record(data, &records[i]);
+            exporter->record_count += 1;
+        }
+
+        packed += count;
+    }
+
+    return packed;
+}
+
+size_t exporter_seal(exporter_t* exporter, uint8_t* datagram)
+{
+    exporter_header_t header = {
+        .magic = EXPORTER_MAGIC,
+        .version = EXPORTER_VERSION,
+        .record_count = exporter->record_count,
+        .sequence = exporter->sequence,
+        .lost = exporter_get_lost(exporter),
+    };
+    size_t datagram_len = EXPORTER_HEADER_LEN + exporter->record_count * EXPORTER_RECORD_LEN;
+
+    exporter_put_header(datagram, &header);
+
+    exporter->sequence += 1;
+    exporter->record_count = 0;
+
+    return datagram_len;
+}
+
+void exporter_drop(exporter_t* exporter, uint8_t record_count)
+{
+    exporter->dropped += record_count;
+}
+
+uint32_t exporter_get_lost(const exporter_t* exporter)
+{
+    return exporter->cursor.lost + exporter->dropped;
+}
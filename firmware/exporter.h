@@ -0,0 +1,87 @@
+#ifndef EXPORTER_H
+#define EXPORTER_H
+
+#include <smbus/smbus_slave.h>
+
+// Mirrors the transaction trace to a collector in batches. The ISR
+// records transactions in the trace ring; the exporter packs them into
+// datagrams from the main loop.
+//
+// A datagram is a header followed by record_count records, little endian:
+//
+//   magic16 version8 record_count8 sequence32 lost32
+//   timestamp_us32 data_len16 handler_us16 bus8 address8 command8 flags8
+//
+// sequence counts datagrams and lost counts records overwritten in the
+// ring or packed into datagrams that could not be sent, so the collector
+// can tell loss on the network from loss on the Pico.
+
+#define EXPORTER_PORT               4818
+#define EXPORTER_MAGIC              0x5453      // "ST"
+#define EXPORTER_VERSION            1
+#define EXPORTER_HEADER_LEN         12
+#define EXPORTER_RECORD_LEN         12
+
+// One unfragmented datagram on Ethernet MTUs
+#define EXPORTER_MAX_DATAGRAM_LEN   1472
+#define EXPORTER_MAX_RECORDS        ((EXPORTER_MAX_DATAGRAM_LEN - EXPORTER_HEADER_LEN) / EXPORTER_RECORD_LEN)
+
+// A part-filled datagram goes out once its first record is this old
+#ifndef EXPORTER_FLUSH_US
+#define EXPORTER_FLUSH_US           100000
+#endif
+
+typedef struct exporter_header_t
+{
+    uint16_t magic;
+    uint8_t version;
+    uint8_t record_count;
+    uint32_t sequence;
+    uint32_t lost;
+}
+exporter_header_t;
+
+typedef struct exporter_t
+{
+    smbus_trace_cursor_t cursor;
+    uint32_t sequence;
+    uint32_t dropped;           // Records in datagrams that were not sent
+    uint8_t record_count;       // In the datagram being packed
+}
+exporter_t;
+
+typedef struct exporter_stats_t
+{
+    uint32_t datagrams;
+    uint32_t records;
+    uint32_t lost;              // As in the header
+    uint32_t alloc_failures;    // No pbuf, records waited in the ring
+    uint32_t send_failures;     // Datagrams dropped by udp_sendto()
+}
+exporter_stats_t;
+
+// Packs new trace records into datagram, which holds the records packed
+// by earlier calls, until it is full. Returns how many were added.
+size_t exporter_pack(exporter_t* exporter, uint8_t* datagram, size_t datagram_max);
+bool exporter_is_full(const exporter_t* exporter, size_t datagram_max);
+
+// Writes the header, returns the datagram length and starts the next one
+size_t exporter_seal(exporter_t* exporter, uint8_t* datagram);
+
+// The sealed datagram holding record_count records could not be sent
+void exporter_drop(exporter_t* exporter, uint8_t record_count);
+uint32_t exporter_get_lost(const exporter_t* exporter);
+
+// Serialized as in a datagram, for receivers
+void exporter_put_header(uint8_t* data, const exporter_header_t* header);
+void exporter_get_header(const uint8_t* data, exporter_header_t* header);
+void exporter_put_record(uint8_t* data, const smbus_trace_record_t* record);
+void exporter_get_record(const uint8_t* data, smbus_trace_record_t* record);
+
+// Sends to collector from exporter_lwip_poll(), which the main loop calls
+// after cyw43_arch_poll()
+bool exporter_lwip_init(const char* collector, uint16_t port);
+void exporter_lwip_poll();
+void exporter_lwip_get_stats(exporter_stats_t* stats);
+
+#endif // EXPORTER_H
@@ -0,0 +1,105 @@
+#include "exporter.h"
+#include <pico/time.h>
+#include <lwip/pbuf.h>
+#include <lwip/udp.h>
+#include <lwip/ip_addr.h>
+
+#if !LWIP_NETIF_TX_SINGLE_PBUF
+#warning "Exporter datagrams are built in one pbuf, without LWIP_NETIF_TX_SINGLE_PBUF the driver copies them again"
+#endif
+
+
+static exporter_t exporter;
+static exporter_stats_t exporter_stats;
+
+static struct udp_pcb* exporter_pcb;
+static ip_addr_t exporter_collector;
+static uint16_t exporter_port;
+
+// The datagram being packed, straight into the pbuf that is sent
+static struct pbuf* exporter_pbuf;
+static uint32_t exporter_first_us;
+
+
+static void exporter_lwip_send()
+{
+    size_t datagram_len = exporter_seal(&exporter, exporter_pbuf->payload);
+    uint8_t record_count = (datagram_len - EXPORTER_HEADER_LEN) / EXPORTER_RECORD_LEN;
+
+    pbuf_realloc(exporter_pbuf, datagram_len);
+
+    // UDP/IP headers go in front of the payload, in the same pbuf
+    if(udp_sendto(exporter_pcb, exporter_pbuf, &exporter_collector, exporter_port) == ERR_OK)
+    {
+        exporter_stats.datagrams += 1;
+        exporter_stats.records += record_count;
+    }
+    else
+    {
+        // lwIP may have prepended its headers already, so no retry
+        exporter_drop(&exporter, record_count);
+        exporter_stats.send_failures += 1;
+    }
+
+    pbuf_free(exporter_pbuf);
+    exporter_pbuf = NULL;
+}
+
+bool exporter_lwip_init(const char* collector, uint16_t port)
+{
+    if(!ipaddr_aton(collector, &exporter_collector))
+    {
+        return false;
+    }
+
+    exporter_pcb = udp_new_ip_type(IP_GET_TYPE(&exporter_collector));
+
+    if(exporter_pcb == NULL)
+    {
+        return false;
+    }
+
+    exporter_port = port;
+
+    return true;
+}
+
+void exporter_lwip_poll()
+{
+    if(exporter_pcb == NULL)
+    {
+        return;
+    }
+
+    if(exporter_pbuf == NULL)
+    {
+        // Out of memory the records wait in the trace ring, which counts
+        // what it has to overwrite meanwhile
+        exporter_pbuf = pbuf_alloc(PBUF_TRANSPORT, EXPORTER_MAX_DATAGRAM_LEN, PBUF_RAM);
+
+        if(exporter_pbuf == NULL)
+        {
+            exporter_stats.alloc_failures += 1;
+            return;
+        }
+    }
+
+    bool is_empty = exporter.record_count == 0;
+
+    if(exporter_pack(&exporter, exporter_pbuf->payload, EXPORTER_MAX_DATAGRAM_LEN) > 0 && is_empty)
+    {
+        exporter_first_us = time_us_32();
+    }
+
+    if(exporter_is_full(&exporter, EXPORTER_MAX_DATAGRAM_LEN) ||
+        (exporter.record_count > 0 && time_us_32() - exporter_first_us >= EXPORTER_FLUSH_US))
+    {
+        exporter_lwip_send();
+    }
+}
+
+void exporter_lwip_get_stats(exporter_stats_t* stats)
+{
+    *stats = exporter_stats;
+    stats->lost = exporter_get_lost(&exporter);
+}
@@ -1,248 +1,157 @@
 #include "handlers.h"
 #include "commands.h"
-#include <pico/stdio.h>
+#include "event_log.h"
+#include <string.h>
 
 
 #ifdef PICO_SMBUS_DEBUG
 
-    static const char hex_alpla[] = { 
-        '0', '1', '2', '3', 
-        '4', '5', '6', '7', 
-        '8', '9', 'A', 'B', 
-        'C', 'D', 'E', 'F' 
-    };
-
-    #define PICO_PUTCHAR(x) \
-        putchar_raw(x)
-
-    #define PICO_PUTBYTE(x)                                     \
+    // Handlers only queue binary records, the main loop prints them
+    #define PICO_LOG(type, ...)                                 \
         do                                                      \
         {                                                       \
-            uint8_t half_byte;                                  \
-                                                                \
-            half_byte = ((x >> 4) & 0xF);                       \
-            PICO_PUTCHAR(hex_alpla[half_byte]);                 \
-                                                                \
-            half_byte = ((x >> 0) & 0xF);                       \
-            PICO_PUTCHAR(hex_alpla[half_byte]);                 \
+            const uint8_t payload[] = { __VA_ARGS__ };          \
+            event_log_append(type, payload, sizeof(payload));   \
         }                                                       \
         while (0)
 
+    #define PICO_LOG_DATA(type, data, data_len) \
+        event_log_append(type, data, data_len)
+
 #else
 
-    #define PICO_PUTCHAR(x)
-    #define PICO_PUTBYTE(x)
+    #define PICO_LOG(type, ...)
+    #define PICO_LOG_DATA(type, data, data_len)
 
 #endif // PICO_SMBUS_DEBUG
 
 
 
-void quick_handler(bool is_on)
-{
-    PICO_PUTCHAR('Q');
-    PICO_PUTCHAR('-');
+static uint8_t byte_data = 0x01;
+static uint16_t word_data = 0x0123;
+static uint32_t dword_data = 0x01234567;
+static uint64_t qword_data = 0x0123456789ABCDEF;
+static uint8_t block_data[SMBUS_MAX_BLOCK_LEN + 1] = { 
+    SMBUS_MAX_BLOCK_LEN,
+    0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7,
+    0xA8, 0xA9, 0xAA, 0xAB, 0xAC, 0xAD, 0xAE, 0xAF,
+    0xB0, 0xB1, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7,
+    0xB8, 0xB9, 0xBA, 0xBB, 0xBC, 0xBD, 0xBE, 0xBF,
+};
 
-    if(is_on)
-    {
-        PICO_PUTCHAR('O');
-        PICO_PUTCHAR('N');
-    }
-    else
-    {
-        PICO_PUTCHAR('O');
-        PICO_PUTCHAR('F');
-        PICO_PUTCHAR('F');
-    }
+// Walked by the ISR on every mapped command, so it is kept in SRAM
+const smbus_reg_t __not_in_flash("smbus") register_map[256] = {
+    [SMBUS_CMD_BYTE_DATA]   = SMBUS_REG_FIXED_ENTRY(byte_data, SMBUS_REG_RW, write_data_handler),
+    [SMBUS_CMD_WORD_DATA]   = SMBUS_REG_FIXED_ENTRY(word_data, SMBUS_REG_RW, write_data_handler),
+    [SMBUS_CMD_DWORD_DATA]  = SMBUS_REG_FIXED_ENTRY(dword_data, SMBUS_REG_RW, write_data_handler),
+    [SMBUS_CMD_QWORD_DATA]  = SMBUS_REG_FIXED_ENTRY(qword_data, SMBUS_REG_RW, write_data_handler),
+    [SMBUS_CMD_BLOCK_DATA]  = SMBUS_REG_BLOCK_ENTRY(block_data, SMBUS_REG_RW, write_data_handler),
+};
 
-    PICO_PUTCHAR('\n');
-}
 
-void write_reg_handler(uint8_t reg)
+void __not_in_flash_func(quick_handler)(bool is_on)
 {
-    PICO_PUTCHAR('W');
-    PICO_PUTCHAR('-');
-    PICO_PUTBYTE(reg);
-
-    PICO_PUTCHAR('\n');
+    PICO_LOG(EVENT_LOG_QUICK, is_on);
 }
 
-void write_data_handler(uint8_t command, const smbus_data_t* smbus_data)
+void __not_in_flash_func(write_reg_handler)(uint8_t reg)
 {
-    PICO_PUTCHAR('W');
-    PICO_PUTCHAR('-');
-    PICO_PUTBYTE(command);
-
-    PICO_PUTCHAR(' ');
+    PICO_LOG(EVENT_LOG_WRITE_REG, reg);
+}
 
+void __not_in_flash_func(write_data_handler)(uint8_t command, const smbus_data_t* smbus_data)
+{
     switch (command)
     {
         case SMBUS_CMD_BYTE_DATA:
         {
-            PICO_PUTBYTE(smbus_data->byte);
+            PICO_LOG(EVENT_LOG_WRITE_DATA, command, smbus_data->byte);
         }
         break;
 
         case SMBUS_CMD_WORD_DATA:
         {
-            PICO_PUTBYTE((uint8_t)(smbus_data->word >> 8));
-            PICO_PUTBYTE((uint8_t)(smbus_data->word >> 0));
+            PICO_LOG(EVENT_LOG_WRITE_DATA, command,
+                (uint8_t)(smbus_data->word >> 8),
+                (uint8_t)(smbus_data->word >> 0)
+            );
         }
         break;
 
         case SMBUS_CMD_DWORD_DATA:
         {
-            PICO_PUTBYTE((uint8_t)(smbus_data->dword >> 24));
-            PICO_PUTBYTE((uint8_t)(smbus_data->dword >> 16));
-            PICO_PUTBYTE((uint8_t)(smbus_data->dword >> 8));
-            PICO_PUTBYTE((uint8_t)(smbus_data->dword >> 0));
+            PICO_LOG(EVENT_LOG_WRITE_DATA, command,
+                (uint8_t)(smbus_data->dword >> 24),
+                (uint8_t)(smbus_data->dword >> 16),
+                (uint8_t)(smbus_data->dword >> 8),
+                (uint8_t)(smbus_data->dword >> 0)
+            );
         }
         break;
 
         case SMBUS_CMD_QWORD_DATA:
         {
-            PICO_PUTBYTE((uint8_t)(smbus_data->qword >> 56));
-            PICO_PUTBYTE((uint8_t)(smbus_data->qword >> 48));
-            PICO_PUTBYTE((uint8_t)(smbus_data->qword >> 40));
-            PICO_PUTBYTE((uint8_t)(smbus_data->qword >> 32));
-            PICO_PUTBYTE((uint8_t)(smbus_data->qword >> 24));
-            PICO_PUTBYTE((uint8_t)(smbus_data->qword >> 16));
-            PICO_PUTBYTE((uint8_t)(smbus_data->qword >> 8));
-            PICO_PUTBYTE((uint8_t)(smbus_data->qword >> 0));
+            PICO_LOG(EVENT_LOG_WRITE_DATA, command,
+                (uint8_t)(smbus_data->qword >> 56),
+                (uint8_t)(smbus_data->qword >> 48),
+                (uint8_t)(smbus_data->qword >> 40),
+                (uint8_t)(smbus_data->qword >> 32),
+                (uint8_t)(smbus_data->qword >> 24),
+                (uint8_t)(smbus_data->qword >> 16),
+                (uint8_t)(smbus_data->qword >> 8),
+                (uint8_t)(smbus_data->qword >> 0)
+            );
         }
         break;
 
         case SMBUS_CMD_BLOCK_DATA:
         {
-            PICO_PUTBYTE(smbus_data->block[0]);
+            uint8_t record[SMBUS_MAX_BLOCK_LEN + 2];
+            size_t block_len = MIN(smbus_data->block[0], SMBUS_MAX_BLOCK_LEN);
+
+            // The count goes out as received, only the bytes logged are capped
+            record[0] = command;
+            memcpy(&record[1], smbus_data->block, block_len + 1);
 
-            for (uint8_t i = 0; i < smbus_data->block[0]; ++i)
-            {
-                PICO_PUTCHAR(' ');
-                PICO_PUTBYTE(smbus_data->block[i + 1]);
-            }
+            PICO_LOG_DATA(EVENT_LOG_WRITE_BLOCK, record, block_len + 2);
         }
         break;
-    }
 
-    PICO_PUTCHAR('\n');
+        default:
+        {
+            PICO_LOG(EVENT_LOG_WRITE_DATA, command);
+        }
+        break;
+    }
 }
 
-uint8_t read_reg_handler()
+uint8_t __not_in_flash_func(read_reg_handler)()
 {
     uint8_t reg = SMBUS_CMD_REG;
 
-    PICO_PUTCHAR('R');
-    PICO_PUTCHAR('-');
-    PICO_PUTBYTE(reg);
-
-    PICO_PUTCHAR('\n');
+    PICO_LOG(EVENT_LOG_READ_REG, reg);
 
     return reg;
 }
 
-size_t read_data_handler(uint8_t command, smbus_data_t* smbus_data)
+size_t __not_in_flash_func(read_data_handler)(uint8_t command, smbus_data_t* smbus_data)
 {
-    size_t size = 0;
-
-    PICO_PUTCHAR('R');
-    PICO_PUTCHAR('-');
-    PICO_PUTBYTE(command);
-
-    PICO_PUTCHAR(' ');
-
-    switch (command)
-    {
-        case SMBUS_CMD_BYTE_DATA:
-        {
-            smbus_data->byte = 0x01;
-            size = sizeof(uint8_t);
-
-            PICO_PUTBYTE(smbus_data->byte);
-        }
-        break;
+    // Data commands are answered from register_map, only unknown ones end up here
+    PICO_LOG(EVENT_LOG_READ_UNKNOWN, command);
 
-        case SMBUS_CMD_WORD_DATA:
-        {
-            smbus_data->word = 0x0123;
-            size = sizeof(uint16_t);
-
-            PICO_PUTBYTE((uint8_t)(smbus_data->word >> 8));
-            PICO_PUTBYTE((uint8_t)(smbus_data->word >> 0));
-        }
-        break;
-
-        case SMBUS_CMD_DWORD_DATA:
-        {
-            smbus_data->dword = 0x01234567;
-            size = sizeof(uint32_t);
-
-            PICO_PUTBYTE((uint8_t)(smbus_data->dword >> 24));
-            PICO_PUTBYTE((uint8_t)(smbus_data->dword >> 16));
-            PICO_PUTBYTE((uint8_t)(smbus_data->dword >> 8));
-            PICO_PUTBYTE((uint8_t)(smbus_data->dword >> 0));
-        }
-        break;
-
-        case SMBUS_CMD_QWORD_DATA:
-        {
-            smbus_data->qword = 0x0123456789ABCDEF;
-            size = sizeof(uint64_t);
-
-            PICO_PUTBYTE((uint8_t)(smbus_data->qword >> 56));
-            PICO_PUTBYTE((uint8_t)(smbus_data->qword >> 48));
-            PICO_PUTBYTE((uint8_t)(smbus_data->qword >> 40));
-            PICO_PUTBYTE((uint8_t)(smbus_data->qword >> 32));
-            PICO_PUTBYTE((uint8_t)(smbus_data->qword >> 24));
-            PICO_PUTBYTE((uint8_t)(smbus_data->qword >> 16));
-            PICO_PUTBYTE((uint8_t)(smbus_data->qword >> 8));
-            PICO_PUTBYTE((uint8_t)(smbus_data->qword >> 0));
-        }
-        break;
-
-        case SMBUS_CMD_BLOCK_DATA:
-        {
-            smbus_data->block[0] = SMBUS_MAX_BLOCK_LEN;
-            PICO_PUTBYTE(smbus_data->block[0]);
-
-            for (uint8_t i = 0; i < smbus_data->block[0]; ++i)
-            {
-                smbus_data->block[i + 1] = 0xA0 | i;
-
-                PICO_PUTCHAR(' ');
-                PICO_PUTBYTE(smbus_data->block[i + 1]);
-            }
-
-            size = smbus_data->block[0] + 1;
-        }
-        break;
-    }
-
-    PICO_PUTCHAR('\n');
-
-    return size;
+    return 0;
 }
 
-uint16_t proc_call_handler(uint8_t command, uint16_t request)
+uint16_t __not_in_flash_func(proc_call_handler)(uint8_t command, uint16_t request)
 {
     uint16_t response = 0x8246;
 
-    PICO_PUTCHAR('C');
-    PICO_PUTCHAR('-');
-    PICO_PUTBYTE(command);
-
-    PICO_PUTCHAR(' ');
-    PICO_PUTCHAR('W');
-    PICO_PUTCHAR(' ');
-    PICO_PUTBYTE((uint8_t)(request >> 8));
-    PICO_PUTBYTE((uint8_t)(request >> 0));
-    
-    PICO_PUTCHAR(' ');
-    PICO_PUTCHAR('R');
-    PICO_PUTCHAR(' ');
-    PICO_PUTBYTE((uint8_t)(response >> 8));
-    PICO_PUTBYTE((uint8_t)(response >> 0));
-
-    PICO_PUTCHAR('\n');
+    PICO_LOG(EVENT_LOG_PROC_CALL, command,
+        (uint8_t)(request >> 8),
+        (uint8_t)(request >> 0),
+        (uint8_t)(response >> 8),
+        (uint8_t)(response >> 0)
+    );
 
     return response;
-}
\ No newline at end of file
+}
@@ -3,8 +3,6 @@
 
 #include <smbus/smbus_slave.h>
 
-#define PICO_SMBUS_DEBUG
-
 void quick_handler(bool is_on);
 void write_reg_handler(uint8_t reg);
 void write_data_handler(uint8_t command, const smbus_data_t* smbus_data);
@@ -12,4 +10,6 @@ uint8_t read_reg_handler();
 size_t read_data_handler(uint8_t command, smbus_data_t* smbus_data);
 uint16_t proc_call_handler(uint8_t command, uint16_t request);
 
+extern const smbus_reg_t register_map[256];
+
 #endif // HANDLERS_H
\ No newline at end of file
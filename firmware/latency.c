@@ -0,0 +1,54 @@
+#include "latency.h"
+#include <string.h>
+#include <hardware/irq.h>
+#include <hardware/timer.h>
+
+
+static uint latency_alarm;
+static uint64_t latency_target_us;
+static volatile latency_stats_t latency_stats;
+
+
+static void __not_in_flash_func(latency_alarm_handler)(uint alarm_num)
+{
+    uint32_t late_us = (uint32_t)(time_us_64() - latency_target_us);
+    uint bucket = late_us ? 32 - __builtin_clz(late_us) : 0;
+
+    latency_stats.samples += 1;
+    latency_stats.buckets[MIN(bucket, LATENCY_BUCKETS - 1)] += 1;
+
+    if(late_us > latency_stats.max_us)
+    {
+        latency_stats.max_us = late_us;
+    }
+
+    // Re-armed from the target, not from now, so lateness does not add up.
+    // Targets already missed are skipped, the alarm would not fire for them.
+    do
+    {
+        latency_target_us += LATENCY_PERIOD_US;
+    }
+    while (hardware_alarm_set_target(alarm_num, from_us_since_boot(latency_target_us)));
+}
+
+void latency_probe_init()
+{
+    latency_alarm = hardware_alarm_claim_unused(true);
+
+    // The alarm IRQ is registered on the calling core, like the I2C one
+    hardware_alarm_set_callback(latency_alarm, latency_alarm_handler);
+    irq_set_priority(TIMER_IRQ_0 + latency_alarm, PICO_DEFAULT_IRQ_PRIORITY);
+
+    latency_target_us = time_us_64() + LATENCY_PERIOD_US;
+    hardware_alarm_set_target(latency_alarm, from_us_since_boot(latency_target_us));
+}
+
+void latency_probe_get(latency_stats_t* stats)
+{
+    memcpy(stats, (const void*)&latency_stats, sizeof(latency_stats_t));
+}
+
+void latency_probe_reset()
+{
+    memset((void*)&latency_stats, 0, sizeof(latency_stats_t));
+}
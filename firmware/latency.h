@@ -0,0 +1,33 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+
+// Measures how late interrupts are served on the calling core: a
+// hardware alarm at the I2C IRQ's priority fires every
+// LATENCY_PERIOD_US and records how long after its target its ISR ran.
+// Whatever delays it, from CYW43 and lwIP work to critical sections,
+// delays smbus_slave_irq_handler the same way.
+
+#ifndef LATENCY_PERIOD_US
+#define LATENCY_PERIOD_US 1000
+#endif
+
+// Bucket n > 0 counts latencies of 2^(n-1) up to 2^n - 1 us
+#define LATENCY_BUCKETS 16
+
+typedef struct latency_stats_t
+{
+    uint32_t samples;
+    uint32_t max_us;
+    uint32_t buckets[LATENCY_BUCKETS];
+}
+latency_stats_t;
+
+void latency_probe_init();
+
+// Safe from either core, each field is consistent on its own
+void latency_probe_get(latency_stats_t* stats);
+void latency_probe_reset();
+
+#endif // LATENCY_H
@@ -3,18 +3,45 @@
 #include <ctype.h>
 #include <pico/stdlib.h>
 #include <pico/cyw43_arch.h>
+#include <pico/multicore.h>
+#include <lwip/netif.h>
 #include <hardware/i2c.h>
+#include <hardware/structs/xip_ctrl.h>
 #include <smbus/smbus_slave.h>
 #include "handlers.h"
+#include "event_log.h"
+#include "bridge.h"
+#include "exporter.h"
+#include "latency.h"
 
 #define PICO_SMBUS_SLAVE_I2C_INSTANCE    i2c0
 #define PICO_SMBUS_SLAVE_I2C_ADDRESS     0x17
 #define PICO_SMBUS_SLAVE_BAUDRATE        100000
 #define PICO_SMBUS_SLAVE_SMDAT_PIN       12
 #define PICO_SMBUS_SLAVE_SMCLK_PIN       13
+#define PICO_SMBUS_SLAVE_RX_THRESHOLD    8
+#define PICO_SMBUS_SLAVE_TX_THRESHOLD    4
+#define PICO_SMBUS_LOG_BATCH_LEN         64
+#define PICO_SMBUS_LATENCY_REPORT_US     5000000
+#define PICO_SMBUS_CORE1_READY           0x5342
+
+// SMBus IRQs and handlers on core1, Wi-Fi, lwIP and printing on core0
+#ifndef PICO_SMBUS_CORE1
+#define PICO_SMBUS_CORE1 1
+#endif
 
 static void pico_smbus_slave_init();
 static bool init_all();
+static void flush_log();
+static void poll_network();
+static void report_latency();
+static void core1_main();
+
+static bool is_network_started;
+static uint32_t latency_report_us;
+static uint32_t isr_cycles_reported[SMBUS_STATS_BUCKETS];
+static uint32_t xip_hits_reported;
+static uint32_t xip_accesses_reported;
 
 void pico_smbus_slave_init()
 {
@@ -32,8 +59,15 @@ void pico_smbus_slave_init()
     smbus_set_read_reg_handler(PICO_SMBUS_SLAVE_I2C_INSTANCE, read_reg_handler);
     smbus_set_read_data_handler(PICO_SMBUS_SLAVE_I2C_INSTANCE, read_data_handler);
     smbus_set_proc_call_handler(PICO_SMBUS_SLAVE_I2C_INSTANCE, proc_call_handler);
+    smbus_set_regmap(PICO_SMBUS_SLAVE_I2C_INSTANCE, register_map);
 
     smbus_set_pec(PICO_SMBUS_SLAVE_I2C_INSTANCE, true);
+    smbus_set_deferred(PICO_SMBUS_SLAVE_I2C_INSTANCE, true);
+    smbus_set_fifo_thresholds(
+        PICO_SMBUS_SLAVE_I2C_INSTANCE, 
+        PICO_SMBUS_SLAVE_RX_THRESHOLD, 
+        PICO_SMBUS_SLAVE_TX_THRESHOLD
+    );
 }
 
 
@@ -44,6 +78,8 @@ bool init_all()
         printf("stdio init failed\n");
         return false;
     }
+
+    event_log_init();
     
     if (cyw43_arch_init() != PICO_OK) 
     {
@@ -51,12 +87,152 @@ bool init_all()
         return false;
     }
 
+#if PICO_SMBUS_CORE1
+    // The IRQs are taken by the core that calls smbus_slave_init()
+    multicore_launch_core1(core1_main);
+
+    if(multicore_fifo_pop_blocking() != PICO_SMBUS_CORE1_READY)
+    {
+        printf("core1 start failed\n");
+        return false;
+    }
+#else
     pico_smbus_slave_init();
+    latency_probe_init();
+#endif
+
+    // The bridge comes up once joined, SMBus does not wait for the network
+    if(WIFI_SSID[0] != '\0')
+    {
+        cyw43_arch_enable_sta_mode();
+
+        if(cyw43_arch_wifi_connect_async(WIFI_SSID, WIFI_PASSWORD, CYW43_AUTH_WPA2_AES_PSK) != PICO_OK)
+        {
+            printf("Wi-Fi connect failed\n");
+        }
+    }
 
     return true;
 }
 
 
+void flush_log()
+{
+    uint8_t batch[PICO_SMBUS_LOG_BATCH_LEN];
+    size_t batch_len = event_log_read(batch, sizeof(batch));
+
+    // Raw, CR/LF translation would corrupt the binary records
+    for (size_t i = 0; i < batch_len; ++i)
+    {
+        putchar_raw(batch[i]);
+    }
+}
+
+void poll_network()
+{
+    // lwIP runs its callbacks, the bridge's included, from here
+    cyw43_arch_poll();
+
+    if(!is_network_started && cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA) == CYW43_LINK_UP)
+    {
+        is_network_started = true;
+
+        if(bridge_lwip_init(PICO_SMBUS_SLAVE_I2C_INSTANCE, BRIDGE_PORT))
+        {
+            printf("Bridge at %s:%u\n", ip4addr_ntoa(netif_ip4_addr(&cyw43_state.netif[CYW43_ITF_STA])), BRIDGE_PORT);
+        }
+        else
+        {
+            printf("Bridge init failed\n");
+        }
+
+        if(EXPORTER_COLLECTOR[0] != '\0' && !exporter_lwip_init(EXPORTER_COLLECTOR, EXPORTER_PORT))
+        {
+            printf("Exporter init failed\n");
+        }
+    }
+
+    exporter_lwip_poll();
+}
+
+void report_latency()
+{
+    latency_stats_t stats;
+    smbus_stats_t smbus_stats;
+    uint isr_bucket = 0;
+
+    if(time_us_32() - latency_report_us < PICO_SMBUS_LATENCY_REPORT_US)
+    {
+        return;
+    }
+
+    latency_report_us = time_us_32();
+    latency_probe_get(&stats);
+    latency_probe_reset();
+
+    // Longest SMBus ISR entry since the last report, as the upper bound of
+    // its histogram bucket. The counters are left alone for the bridge.
+    smbus_get_stats(PICO_SMBUS_SLAVE_I2C_INSTANCE, &smbus_stats);
+
+    for (uint i = 0; i < SMBUS_STATS_BUCKETS; ++i)
+    {
+        if(smbus_stats.isr_cycles[i] != isr_cycles_reported[i])
+        {
+            isr_bucket = i;
+        }
+
+        isr_cycles_reported[i] = smbus_stats.isr_cycles[i];
+    }
+
+    // XIP cache counters cover both cores, every miss is a flash read over
+    // QSPI. A copy_to_ram build should show none.
+    uint32_t xip_hits = xip_ctrl_hw->ctr_hit;
+    uint32_t xip_accesses = xip_ctrl_hw->ctr_acc;
+    uint32_t xip_misses = (xip_accesses - xip_accesses_reported) - (xip_hits - xip_hits_reported);
+
+    xip_hits_reported = xip_hits;
+    xip_accesses_reported = xip_accesses;
+
+    printf("IRQ latency on core%u: max %lu us over %lu samples, ISR max < %lu cycles, XIP misses %lu, Wi-Fi %s\n",
+        PICO_SMBUS_CORE1,
+        (unsigned long)stats.max_us,
+        (unsigned long)stats.samples,
+        1ul << isr_bucket,
+        (unsigned long)xip_misses,
+        is_network_started ? "up" : "down"
+    );
+
+    if(EXPORTER_COLLECTOR[0] != '\0')
+    {
+        exporter_stats_t exporter_stats;
+
+        exporter_lwip_get_stats(&exporter_stats);
+
+        printf("Exporter: %lu datagrams, %lu records, %lu lost, %lu alloc failures, %lu send failures\n",
+            (unsigned long)exporter_stats.datagrams,
+            (unsigned long)exporter_stats.records,
+            (unsigned long)exporter_stats.lost,
+            (unsigned long)exporter_stats.alloc_failures,
+            (unsigned long)exporter_stats.send_failures
+        );
+    }
+}
+
+void core1_main()
+{
+    pico_smbus_slave_init();
+    latency_probe_init();
+
+    multicore_fifo_push_blocking(PICO_SMBUS_CORE1_READY);
+
+    // Deferred handlers run on this core as well, they only queue log records
+    while (true)
+    {
+        smbus_dispatch(PICO_SMBUS_SLAVE_I2C_INSTANCE);
+    }
+}
+
+
 int main() 
 {   
     if(!init_all())
@@ -66,7 +242,16 @@ int main()
 
     printf("Pico SMBUS slave started at 0x%02X\n", PICO_SMBUS_SLAVE_I2C_ADDRESS);
 
-    while (true);
+    // Handlers only queue log records, printing them is left to this loop
+    while (true)
+    {
+#if !PICO_SMBUS_CORE1
+        smbus_dispatch(PICO_SMBUS_SLAVE_I2C_INSTANCE);
+#endif
+        flush_log();
+        poll_network();
+        report_latency();
+    }
     
     return 0;
 }
\ No newline at end of file
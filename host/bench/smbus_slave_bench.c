@@ -0,0 +1,302 @@
+#include <smbus/smbus_slave.h>
+#include <smbus_sim.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_BUS           0
+#define BENCH_I2C           i2c0
+#define BENCH_ADDRESS       0x17
+#define BENCH_BAUDRATE      100000
+#define BENCH_SDA_PIN       12
+#define BENCH_SCL_PIN       13
+#define BENCH_ITERATIONS    20000
+
+#define BENCH_CMD_BYTE      0xC1
+#define BENCH_CMD_WORD      0xC2
+#define BENCH_CMD_BLOCK     0xCB
+#define BENCH_CMD_PROC_CALL 0xCC
+
+typedef int (*bench_transaction_t)(bool pec);
+
+typedef struct bench_case_t
+{
+    const char* name;
+    bench_transaction_t transaction;
+    bool has_pec;
+    uint rx_threshold;
+    uint tx_threshold;
+    bool is_dma_enabled;
+    bool is_irq_late;       // Causes pile up until SCL is held or the STOP
+}
+bench_case_t;
+
+static uint8_t bench_block[SMBUS_MAX_BLOCK_LEN + 1];
+static double bench_worst_ns_per_isr;
+
+static const uint bench_baudrates[] = {
+    SMBUS_BAUDRATE_STANDARD,
+    SMBUS_BAUDRATE_FAST,
+    SMBUS_BAUDRATE_FAST_PLUS,
+};
+
+
+static void bench_quick_handler(bool is_on)
+{}
+
+static void bench_write_reg_handler(uint8_t reg)
+{}
+
+static void bench_write_data_handler(uint8_t command, const smbus_data_t* smbus_data)
+{}
+
+static uint8_t bench_read_reg_handler()
+{
+    return 0xC0;
+}
+
+static size_t bench_read_data_handler(uint8_t command, smbus_data_t* smbus_data)
+{
+    switch (command)
+    {
+        case BENCH_CMD_BYTE:
+            smbus_data->byte = 0x01;
+            return sizeof(uint8_t);
+
+        case BENCH_CMD_WORD:
+            smbus_data->word = 0x0123;
+            return sizeof(uint16_t);
+
+        case BENCH_CMD_BLOCK:
+            memcpy(smbus_data->block, bench_block, sizeof(bench_block));
+            return sizeof(bench_block);
+    }
+
+    return 0;
+}
+
+static uint16_t bench_proc_call_handler(uint8_t command, uint16_t request)
+{
+    return request ^ 0xFFFF;
+}
+
+
+static int bench_quick_write(bool pec)
+{
+    return smbus_sim_quick(BENCH_BUS, BENCH_ADDRESS, false);
+}
+
+static int bench_quick_read(bool pec)
+{
+    return smbus_sim_quick(BENCH_BUS, BENCH_ADDRESS, true);
+}
+
+static int bench_send_byte(bool pec)
+{
+    return smbus_sim_send_byte(BENCH_BUS, BENCH_ADDRESS, 0x42, pec);
+}
+
+static int bench_receive_byte(bool pec)
+{
+    uint8_t value;
+    return smbus_sim_receive_byte(BENCH_BUS, BENCH_ADDRESS, &value, pec);
+}
+
+static int bench_write_byte(bool pec)
+{
+    uint8_t data[] = { 0x99 };
+    return smbus_sim_write(BENCH_BUS, BENCH_ADDRESS, BENCH_CMD_BYTE, data, sizeof(data), pec);
+}
+
+static int bench_read_byte(bool pec)
+{
+    uint8_t data[1];
+    return smbus_sim_read(BENCH_BUS, BENCH_ADDRESS, BENCH_CMD_BYTE, data, sizeof(data), pec);
+}
+
+static int bench_write_word(bool pec)
+{
+    uint8_t data[] = { 0x34, 0x12 };
+    return smbus_sim_write(BENCH_BUS, BENCH_ADDRESS, BENCH_CMD_WORD, data, sizeof(data), pec);
+}
+
+static int bench_read_word(bool pec)
+{
+    uint8_t data[2];
+    return smbus_sim_read(BENCH_BUS, BENCH_ADDRESS, BENCH_CMD_WORD, data, sizeof(data), pec);
+}
+
+static int bench_block_write(bool pec)
+{
+    return smbus_sim_write(BENCH_BUS, BENCH_ADDRESS, BENCH_CMD_BLOCK, bench_block, sizeof(bench_block), pec);
+}
+
+static int bench_block_read(bool pec)
+{
+    uint8_t data[SMBUS_MAX_BLOCK_LEN + 1];
+    size_t data_len;
+    return smbus_sim_block_read(BENCH_BUS, BENCH_ADDRESS, BENCH_CMD_BLOCK, data, &data_len, pec);
+}
+
+static int bench_proc_call(bool pec)
+{
+    uint16_t response;
+    return smbus_sim_proc_call(BENCH_BUS, BENCH_ADDRESS, BENCH_CMD_PROC_CALL, 0x1234, &response, pec);
+}
+
+
+static const bench_case_t bench_cases[] = {
+    { "quick write",        bench_quick_write,  false,  1,  0,  false, false },
+    { "quick read",         bench_quick_read,   false,  1,  0,  false, false },
+    { "send byte",          bench_send_byte,    true,   1,  0,  false, false },
+    { "receive byte",       bench_receive_byte, true,   1,  0,  false, false },
+    { "write byte",         bench_write_byte,   true,   1,  0,  false, false },
+    { "read byte",          bench_read_byte,    true,   1,  0,  false, false },
+    { "write word",         bench_write_word,   true,   1,  0,  false, false },
+    { "read word",          bench_read_word,    true,   1,  0,  false, false },
+    { "block write 32",     bench_block_write,  true,   1,  0,  false, false },
+    { "block write 32 rx8", bench_block_write,  true,   8,  0,  false, false },
+    { "block read 32",      bench_block_read,   true,   1,  0,  false, false },
+    { "block read 32 tx4",  bench_block_read,   true,   1,  4,  false, false },
+    { "proc call",          bench_proc_call,    true,   1,  0,  false, false },
+    { "proc call rx8",      bench_proc_call,    true,   8,  0,  false, false },
+    { "block write 32 dma", bench_block_write,  true,   8,  0,  true,  false },
+    { "block read 32 dma",  bench_block_read,   true,   1,  0,  true,  false },
+    { "write word late",    bench_write_word,   true,   1,  0,  false, true },
+    { "read word late",     bench_read_word,    true,   1,  0,  false, true },
+    { "block write late",   bench_block_write,  true,   8,  0,  false, true },
+    { "proc call late",     bench_proc_call,    true,   1,  0,  false, true },
+};
+
+
+static void bench_setup(bool pec, const bench_case_t* bench_case)
+{
+    smbus_sim_reset();
+
+    smbus_slave_init(BENCH_I2C, BENCH_ADDRESS, BENCH_BAUDRATE, BENCH_SDA_PIN, BENCH_SCL_PIN);
+
+    smbus_set_quick_handler(BENCH_I2C, bench_quick_handler);
+    smbus_set_write_reg_handler(BENCH_I2C, bench_write_reg_handler);
+    smbus_set_write_data_handler(BENCH_I2C, bench_write_data_handler);
+    smbus_set_read_reg_handler(BENCH_I2C, bench_read_reg_handler);
+    smbus_set_read_data_handler(BENCH_I2C, bench_read_data_handler);
+    smbus_set_proc_call_handler(BENCH_I2C, bench_proc_call_handler);
+
+    smbus_set_pec(BENCH_I2C, pec);
+    smbus_set_fifo_thresholds(BENCH_I2C, bench_case->rx_threshold, bench_case->tx_threshold);
+    smbus_set_dma(BENCH_I2C, bench_case->is_dma_enabled);
+}
+
+static int bench_transaction(const bench_case_t* bench_case, bool pec)
+{
+    int status;
+
+    // Late: the ISR only runs where the master is stretched for it and
+    // once the transaction is over
+    smbus_sim_set_irq_delay(BENCH_BUS, bench_case->is_irq_late);
+    status = bench_case->transaction(pec);
+    smbus_sim_set_irq_delay(BENCH_BUS, false);
+
+    return status;
+}
+
+static void bench_run(const bench_case_t* bench_case, bool pec)
+{
+    smbus_sim_stats_t stats;
+    char name[40];
+
+    bench_setup(pec, bench_case);
+
+    // Warm up caches and branch predictors before measuring
+    for (uint i = 0; i < BENCH_ITERATIONS / 10; ++i)
+    {
+        bench_transaction(bench_case, pec);
+    }
+
+    smbus_sim_reset_stats(BENCH_BUS);
+
+    for (uint i = 0; i < BENCH_ITERATIONS; ++i)
+    {
+        if(bench_transaction(bench_case, pec) != SMBUS_SIM_OK)
+        {
+            printf("%s: transaction failed\n", bench_case->name);
+            exit(1);
+        }
+    }
+
+    smbus_sim_get_stats(BENCH_BUS, &stats);
+    smbus_slave_deinit(BENCH_I2C);
+
+    if((double)stats.isr_ns / stats.isr_entries > bench_worst_ns_per_isr)
+    {
+        bench_worst_ns_per_isr = (double)stats.isr_ns / stats.isr_entries;
+    }
+
+    snprintf(name, sizeof(name), "%s%s", bench_case->name, pec ? " +pec" : "");
+
+    printf("%-26s %8.2f %10.1f %10.1f %10llu",
+        name,
+        (double)stats.isr_entries / BENCH_ITERATIONS,
+        (double)stats.isr_ns / BENCH_ITERATIONS,
+        (double)stats.isr_ns / stats.isr_entries,
+        (unsigned long long)stats.isr_ns_max
+    );
+
+    if(smbus_sim_has_instruction_counter())
+    {
+        printf(" %10.1f\n", (double)stats.isr_instructions / BENCH_ITERATIONS);
+    }
+    else
+    {
+        printf(" %10s\n", "n/a");
+    }
+}
+
+static void bench_budget(uint rx_threshold, uint tx_threshold)
+{
+    printf("\nlatency budget, rx threshold %u, tx threshold %u\n", rx_threshold, tx_threshold);
+    printf("%-10s %10s %12s %12s %14s\n", "baudrate", "byte us", "rx_full us", "tx_empty us", "worst isr us");
+
+    for (size_t i = 0; i < sizeof(bench_baudrates) / sizeof(bench_baudrates[0]); ++i)
+    {
+        // 8 data bits and the ACK
+        double byte_us = 9e6 / bench_baudrates[i];
+
+        // RX_FULL must be served before the FIFO fills up and SCL is held,
+        // TX_EMPTY before the bytes still queued have been clocked out
+        printf("%-10u %10.1f %12.1f %12.1f %14.2f\n",
+            bench_baudrates[i],
+            byte_us,
+            byte_us * (SMBUS_SIM_FIFO_DEPTH - rx_threshold + 1),
+            byte_us * tx_threshold,
+            bench_worst_ns_per_isr / 1000.0
+        );
+    }
+}
+
+
+int main()
+{
+    bench_block[0] = SMBUS_MAX_BLOCK_LEN;
+
+    for (uint8_t i = 0; i < SMBUS_MAX_BLOCK_LEN; ++i)
+    {
+        bench_block[i + 1] = 0xA0 | i;
+    }
+
+    printf("%-26s %8s %10s %10s %10s %10s\n", "transaction", "isr/txn", "ns/txn", "ns/isr", "max ns", "instr/txn");
+
+    for (size_t i = 0; i < sizeof(bench_cases) / sizeof(bench_cases[0]); ++i)
+    {
+        bench_run(&bench_cases[i], false);
+
+        if(bench_cases[i].has_pec)
+        {
+            bench_run(&bench_cases[i], true);
+        }
+    }
+
+    bench_budget(8, 4);
+
+    return 0;
+}
@@ -0,0 +1,40 @@
+#ifndef _HARDWARE_ADDRESS_MAPPED_H
+#define _HARDWARE_ADDRESS_MAPPED_H
+
+#include <pico.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef volatile uint32_t io_rw_32;
+typedef const volatile uint32_t io_ro_32;
+typedef volatile uint32_t io_wo_32;
+
+// The RP2040 atomic SET/CLR/XOR aliases reduce to plain read-modify-write
+// on the host; the simulator never runs concurrently with the ISR.
+static inline void hw_set_bits(io_rw_32* addr, uint32_t mask)
+{
+    *addr |= mask;
+}
+
+static inline void hw_clear_bits(io_rw_32* addr, uint32_t mask)
+{
+    *addr &= ~mask;
+}
+
+static inline void hw_xor_bits(io_rw_32* addr, uint32_t mask)
+{
+    *addr ^= mask;
+}
+
+static inline void hw_write_masked(io_rw_32* addr, uint32_t values, uint32_t write_mask)
+{
+    *addr = (*addr & ~write_mask) | (values & write_mask);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _HARDWARE_ADDRESS_MAPPED_H
@@ -0,0 +1,26 @@
+#ifndef _HARDWARE_CLAIM_H
+#define _HARDWARE_CLAIM_H
+
+#include <hardware/sync.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// One thread runs everything on the host, masking is all the lock needs
+
+static inline uint32_t hw_claim_lock(void)
+{
+    return save_and_disable_interrupts();
+}
+
+static inline void hw_claim_unlock(uint32_t token)
+{
+    restore_interrupts(token);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _HARDWARE_CLAIM_H
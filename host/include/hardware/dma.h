@@ -0,0 +1,81 @@
+#ifndef _HARDWARE_DMA_H
+#define _HARDWARE_DMA_H
+
+#include <pico.h>
+#include <hardware/address_mapped.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Simulated DMA engine: only transfers paced by the I2C DREQs are moved,
+// and they are moved as soon as the simulated FIFOs allow it.
+
+#define NUM_DMA_CHANNELS 12
+
+enum dma_channel_transfer_size
+{
+    DMA_SIZE_8 = 0,
+    DMA_SIZE_16 = 1,
+    DMA_SIZE_32 = 2,
+};
+
+typedef struct
+{
+    enum dma_channel_transfer_size data_size;
+    bool read_increment;
+    bool write_increment;
+    uint dreq;
+}
+dma_channel_config;
+
+typedef struct
+{
+    io_rw_32 transfer_count;
+}
+dma_channel_hw_t;
+
+int dma_claim_unused_channel(bool required);
+void dma_channel_claim(uint channel);
+void dma_channel_unclaim(uint channel);
+bool dma_channel_is_claimed(uint channel);
+
+dma_channel_config dma_channel_get_default_config(uint channel);
+dma_channel_hw_t* dma_channel_hw_addr(uint channel);
+
+void dma_channel_configure(
+    uint channel,
+    const dma_channel_config* config,
+    volatile void* write_addr,
+    const volatile void* read_addr,
+    uint transfer_count,
+    bool trigger
+);
+void dma_channel_abort(uint channel);
+bool dma_channel_is_busy(uint channel);
+
+static inline void channel_config_set_transfer_data_size(dma_channel_config* c, enum dma_channel_transfer_size size)
+{
+    c->data_size = size;
+}
+
+static inline void channel_config_set_read_increment(dma_channel_config* c, bool incr)
+{
+    c->read_increment = incr;
+}
+
+static inline void channel_config_set_write_increment(dma_channel_config* c, bool incr)
+{
+    c->write_increment = incr;
+}
+
+static inline void channel_config_set_dreq(dma_channel_config* c, uint dreq)
+{
+    c->dreq = dreq;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _HARDWARE_DMA_H
@@ -0,0 +1,80 @@
+#ifndef _HARDWARE_I2C_H
+#define _HARDWARE_I2C_H
+
+#include <pico.h>
+#include <hardware/structs/i2c.h>
+#include <hardware/timer.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct i2c_inst
+{
+    i2c_hw_t* hw;
+    bool restart_on_next;
+}
+i2c_inst_t;
+
+extern i2c_inst_t i2c0_inst;
+extern i2c_inst_t i2c1_inst;
+
+#define i2c0 (&i2c0_inst)
+#define i2c1 (&i2c1_inst)
+
+#define NUM_I2CS 2
+
+uint i2c_init(i2c_inst_t* i2c, uint baudrate);
+void i2c_deinit(i2c_inst_t* i2c);
+void i2c_set_slave_mode(i2c_inst_t* i2c, bool slave, uint8_t addr);
+
+// Accessors for IC_DATA_CMD: these pop the simulated RX FIFO and push the
+// simulated TX FIFO respectively.
+uint8_t i2c_read_byte_raw(i2c_inst_t* i2c);
+void i2c_write_byte_raw(i2c_inst_t* i2c, uint8_t value);
+
+// A read of the whole IC_DATA_CMD, FIRST_DATA_BYTE included, which lib/
+// reaches through smbus_i2c_read_data_cmd() since a plain read of
+// hw->data_cmd cannot pop the simulated RX FIFO
+uint32_t i2c_sim_read_data_cmd(i2c_inst_t* i2c);
+
+#define smbus_i2c_read_data_cmd(i2c) i2c_sim_read_data_cmd(i2c)
+
+static inline uint i2c_hw_index(i2c_inst_t* i2c)
+{
+    assert(i2c == i2c0 || i2c == i2c1);
+    return i2c == i2c1 ? 1 : 0;
+}
+
+static inline i2c_hw_t* i2c_get_hw(i2c_inst_t* i2c)
+{
+    return i2c->hw;
+}
+
+static inline i2c_inst_t* i2c_get_instance(uint num)
+{
+    assert(num < NUM_I2CS);
+    return num ? i2c1 : i2c0;
+}
+
+static inline uint i2c_get_dreq(i2c_inst_t* i2c, bool is_tx)
+{
+    return DREQ_I2C0_TX + 2 * i2c_hw_index(i2c) + (is_tx ? 0 : 1);
+}
+
+static inline size_t i2c_get_write_available(i2c_inst_t* i2c)
+{
+    const size_t IC_TX_BUFFER_DEPTH = 16;
+    return IC_TX_BUFFER_DEPTH - i2c_get_hw(i2c)->txflr;
+}
+
+static inline size_t i2c_get_read_available(i2c_inst_t* i2c)
+{
+    return i2c_get_hw(i2c)->rxflr;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _HARDWARE_I2C_H
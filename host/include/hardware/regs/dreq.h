@@ -0,0 +1,10 @@
+#ifndef _HARDWARE_REGS_DREQ_H
+#define _HARDWARE_REGS_DREQ_H
+
+#define DREQ_I2C0_TX 32
+#define DREQ_I2C0_RX 33
+#define DREQ_I2C1_TX 34
+#define DREQ_I2C1_RX 35
+#define DREQ_FORCE   63
+
+#endif // _HARDWARE_REGS_DREQ_H
@@ -0,0 +1,73 @@
+#ifndef _HARDWARE_REGS_I2C_H
+#define _HARDWARE_REGS_I2C_H
+
+// Register bit definitions copied from the RP2040 datasheet, limited to
+// the fields touched by lib/ and the host simulator.
+
+#define I2C_IC_CON_MASTER_MODE_BITS             _u(0x00000001)
+#define I2C_IC_CON_SPEED_BITS                   _u(0x00000006)
+#define I2C_IC_CON_IC_RESTART_EN_BITS           _u(0x00000020)
+#define I2C_IC_CON_IC_SLAVE_DISABLE_BITS        _u(0x00000040)
+#define I2C_IC_CON_STOP_DET_IFADDRESSED_BITS    _u(0x00000080)
+#define I2C_IC_CON_TX_EMPTY_CTRL_BITS           _u(0x00000100)
+#define I2C_IC_CON_RX_FIFO_FULL_HLD_CTRL_BITS   _u(0x00000200)
+
+#define I2C_IC_INTR_STAT_R_RX_UNDER_BITS        _u(0x00000001)
+#define I2C_IC_INTR_STAT_R_RX_OVER_BITS         _u(0x00000002)
+#define I2C_IC_INTR_STAT_R_RX_FULL_BITS         _u(0x00000004)
+#define I2C_IC_INTR_STAT_R_TX_OVER_BITS         _u(0x00000008)
+#define I2C_IC_INTR_STAT_R_TX_EMPTY_BITS        _u(0x00000010)
+#define I2C_IC_INTR_STAT_R_RD_REQ_BITS          _u(0x00000020)
+#define I2C_IC_INTR_STAT_R_TX_ABRT_BITS         _u(0x00000040)
+#define I2C_IC_INTR_STAT_R_RX_DONE_BITS         _u(0x00000080)
+#define I2C_IC_INTR_STAT_R_ACTIVITY_BITS        _u(0x00000100)
+#define I2C_IC_INTR_STAT_R_STOP_DET_BITS        _u(0x00000200)
+#define I2C_IC_INTR_STAT_R_START_DET_BITS       _u(0x00000400)
+#define I2C_IC_INTR_STAT_R_GEN_CALL_BITS        _u(0x00000800)
+#define I2C_IC_INTR_STAT_R_RESTART_DET_BITS     _u(0x00001000)
+
+#define I2C_IC_INTR_MASK_RESET                  _u(0x000008ff)
+#define I2C_IC_INTR_MASK_M_RX_UNDER_BITS        _u(0x00000001)
+#define I2C_IC_INTR_MASK_M_RX_OVER_BITS         _u(0x00000002)
+#define I2C_IC_INTR_MASK_M_RX_FULL_BITS         _u(0x00000004)
+#define I2C_IC_INTR_MASK_M_TX_OVER_BITS         _u(0x00000008)
+#define I2C_IC_INTR_MASK_M_TX_EMPTY_BITS        _u(0x00000010)
+#define I2C_IC_INTR_MASK_M_RD_REQ_BITS          _u(0x00000020)
+#define I2C_IC_INTR_MASK_M_TX_ABRT_BITS         _u(0x00000040)
+#define I2C_IC_INTR_MASK_M_RX_DONE_BITS         _u(0x00000080)
+#define I2C_IC_INTR_MASK_M_ACTIVITY_BITS        _u(0x00000100)
+#define I2C_IC_INTR_MASK_M_STOP_DET_BITS        _u(0x00000200)
+#define I2C_IC_INTR_MASK_M_START_DET_BITS       _u(0x00000400)
+#define I2C_IC_INTR_MASK_M_GEN_CALL_BITS        _u(0x00000800)
+#define I2C_IC_INTR_MASK_M_RESTART_DET_BITS     _u(0x00001000)
+
+#define I2C_IC_RAW_INTR_STAT_RX_FULL_BITS       _u(0x00000004)
+#define I2C_IC_RAW_INTR_STAT_TX_EMPTY_BITS      _u(0x00000010)
+#define I2C_IC_RAW_INTR_STAT_RD_REQ_BITS        _u(0x00000020)
+#define I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS       _u(0x00000040)
+#define I2C_IC_RAW_INTR_STAT_RX_DONE_BITS       _u(0x00000080)
+#define I2C_IC_RAW_INTR_STAT_STOP_DET_BITS      _u(0x00000200)
+#define I2C_IC_RAW_INTR_STAT_START_DET_BITS     _u(0x00000400)
+#define I2C_IC_RAW_INTR_STAT_RESTART_DET_BITS   _u(0x00001000)
+
+#define I2C_IC_STATUS_ACTIVITY_BITS             _u(0x00000001)
+#define I2C_IC_STATUS_TFNF_BITS                 _u(0x00000002)
+#define I2C_IC_STATUS_TFE_BITS                  _u(0x00000004)
+#define I2C_IC_STATUS_RFNE_BITS                 _u(0x00000008)
+#define I2C_IC_STATUS_SLV_ACTIVITY_BITS         _u(0x00000040)
+
+#define I2C_IC_TX_ABRT_SOURCE_ABRT_7B_ADDR_NOACK_BITS   _u(0x00000001)
+#define I2C_IC_TX_ABRT_SOURCE_ABRT_TXDATA_NOACK_BITS    _u(0x00000008)
+#define I2C_IC_TX_ABRT_SOURCE_ARB_LOST_BITS             _u(0x00001000)
+#define I2C_IC_TX_ABRT_SOURCE_ABRT_SLVFLUSH_TXFIFO_BITS _u(0x00002000)
+#define I2C_IC_TX_ABRT_SOURCE_ABRT_SLV_ARBLOST_BITS     _u(0x00004000)
+
+#define I2C_IC_DATA_CMD_DAT_BITS                _u(0x000000ff)
+#define I2C_IC_DATA_CMD_CMD_BITS                _u(0x00000100)
+#define I2C_IC_DATA_CMD_STOP_BITS               _u(0x00000200)
+#define I2C_IC_DATA_CMD_FIRST_DATA_BYTE_BITS    _u(0x00000800)
+
+#define I2C_IC_DMA_CR_RDMAE_BITS                _u(0x00000001)
+#define I2C_IC_DMA_CR_TDMAE_BITS                _u(0x00000002)
+
+#endif // _HARDWARE_REGS_I2C_H
@@ -0,0 +1,9 @@
+#ifndef _HARDWARE_REGS_INTCTRL_H
+#define _HARDWARE_REGS_INTCTRL_H
+
+#define I2C0_IRQ 23
+#define I2C1_IRQ 24
+
+#define NUM_IRQS 32
+
+#endif // _HARDWARE_REGS_INTCTRL_H
@@ -0,0 +1,14 @@
+#ifndef _HARDWARE_REGS_M0PLUS_H
+#define _HARDWARE_REGS_M0PLUS_H
+
+// Subset of the RP2040 Cortex-M0+ private peripheral registers used by lib/
+
+#define M0PLUS_SYST_CSR_ENABLE_BITS             _u(0x00000001)
+#define M0PLUS_SYST_CSR_TICKINT_BITS            _u(0x00000002)
+#define M0PLUS_SYST_CSR_CLKSOURCE_BITS          _u(0x00000004)
+#define M0PLUS_SYST_CSR_COUNTFLAG_BITS          _u(0x00010000)
+
+#define M0PLUS_SYST_RVR_BITS                    _u(0x00ffffff)
+#define M0PLUS_SYST_CVR_BITS                    _u(0x00ffffff)
+
+#endif // _HARDWARE_REGS_M0PLUS_H
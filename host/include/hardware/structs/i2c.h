@@ -0,0 +1,88 @@
+#ifndef _HARDWARE_STRUCTS_I2C_H
+#define _HARDWARE_STRUCTS_I2C_H
+
+#include <pico.h>
+#include <hardware/address_mapped.h>
+#include <hardware/regs/i2c.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The IC_CLR_* registers clear their interrupt as a side effect of being
+// read. A plain C read cannot be intercepted on the host, so each of them
+// is backed by a per-instance read callback owned by the simulator and the
+// register names below expand into calls to it. `hw->clr_stop_det;` in lib/
+// therefore compiles unchanged and clears STOP_DET exactly like the silicon.
+// IC_INTR_STAT is read the same way, so it reflects IC_INTR_MASK writes and
+// FIFO levels as they happen.
+typedef uint32_t (*i2c_hw_clr_read_t)(void);
+
+typedef struct
+{
+    io_rw_32 con;
+    io_rw_32 tar;
+    io_rw_32 sar;
+    io_rw_32 data_cmd;
+    io_rw_32 ss_scl_hcnt;
+    io_rw_32 ss_scl_lcnt;
+    io_rw_32 fs_scl_hcnt;
+    io_rw_32 fs_scl_lcnt;
+    i2c_hw_clr_read_t intr_stat_read;
+    io_rw_32 intr_mask;
+    io_ro_32 raw_intr_stat;
+    io_rw_32 rx_tl;
+    io_rw_32 tx_tl;
+    i2c_hw_clr_read_t clr_intr_read;
+    i2c_hw_clr_read_t clr_rx_under_read;
+    i2c_hw_clr_read_t clr_rx_over_read;
+    i2c_hw_clr_read_t clr_tx_over_read;
+    i2c_hw_clr_read_t clr_rd_req_read;
+    i2c_hw_clr_read_t clr_tx_abrt_read;
+    i2c_hw_clr_read_t clr_rx_done_read;
+    i2c_hw_clr_read_t clr_activity_read;
+    i2c_hw_clr_read_t clr_stop_det_read;
+    i2c_hw_clr_read_t clr_start_det_read;
+    i2c_hw_clr_read_t clr_gen_call_read;
+    i2c_hw_clr_read_t clr_restart_det_read;
+    io_rw_32 enable;
+    io_ro_32 status;
+    io_ro_32 txflr;
+    io_ro_32 rxflr;
+    io_rw_32 sda_hold;
+    io_ro_32 tx_abrt_source;
+    io_rw_32 slv_data_nack_only;
+    io_rw_32 dma_cr;
+    io_rw_32 dma_tdlr;
+    io_rw_32 dma_rdlr;
+    io_rw_32 sda_setup;
+    io_rw_32 ack_general_call;
+    io_ro_32 enable_status;
+    io_rw_32 fs_spklen;
+}
+i2c_hw_t;
+
+#define intr_stat       intr_stat_read()
+#define clr_intr        clr_intr_read()
+#define clr_rx_under    clr_rx_under_read()
+#define clr_rx_over     clr_rx_over_read()
+#define clr_tx_over     clr_tx_over_read()
+#define clr_rd_req      clr_rd_req_read()
+#define clr_tx_abrt     clr_tx_abrt_read()
+#define clr_rx_done     clr_rx_done_read()
+#define clr_activity    clr_activity_read()
+#define clr_stop_det    clr_stop_det_read()
+#define clr_start_det   clr_start_det_read()
+#define clr_gen_call    clr_gen_call_read()
+#define clr_restart_det clr_restart_det_read()
+
+extern i2c_hw_t i2c_sim_hw[2];
+
+#define i2c0_hw (&i2c_sim_hw[0])
+#define i2c1_hw (&i2c_sim_hw[1])
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _HARDWARE_STRUCTS_I2C_H
@@ -0,0 +1,36 @@
+#ifndef _HARDWARE_STRUCTS_SYSTICK_H
+#define _HARDWARE_STRUCTS_SYSTICK_H
+
+#include <pico.h>
+#include <hardware/address_mapped.h>
+#include <hardware/regs/m0plus.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// SYST_CVR counts down on its own. As with IC_CLR_* in structs/i2c.h, reads
+// of it expand into a simulator callback, which derives the count from
+// CLOCK_MONOTONIC at the clk_sys rate.
+typedef uint32_t (*systick_hw_cvr_read_t)(void);
+
+typedef struct
+{
+    io_rw_32 csr;
+    io_rw_32 rvr;
+    systick_hw_cvr_read_t cvr_read;
+    io_ro_32 calib;
+}
+systick_hw_t;
+
+#define cvr cvr_read()
+
+extern systick_hw_t systick_sim_hw;
+
+#define systick_hw (&systick_sim_hw)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _HARDWARE_STRUCTS_SYSTICK_H
@@ -0,0 +1,93 @@
+#ifndef _HARDWARE_SYNC_H
+#define _HARDWARE_SYNC_H
+
+#include <pico.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The simulated ISR runs on the caller's thread, compiler fences are
+// enough to keep the same ordering the DMB-based SDK versions give
+
+static inline void __mem_fence_acquire(void)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+}
+
+static inline void __mem_fence_release(void)
+{
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void __dmb(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+// Nothing can preempt the simulated ISR's caller, so there is nothing
+// to mask
+
+static inline uint32_t save_and_disable_interrupts(void)
+{
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    return 0;
+}
+
+static inline void restore_interrupts(uint32_t status)
+{
+    (void)status;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+#define NUM_SPIN_LOCKS 32
+
+typedef volatile uint32_t spin_lock_t;
+
+extern spin_lock_t smbus_sim_spin_locks[NUM_SPIN_LOCKS];
+
+int spin_lock_claim_unused(bool required);
+void spin_lock_unclaim(uint lock_num);
+
+static inline spin_lock_t* spin_lock_instance(uint lock_num)
+{
+    return &smbus_sim_spin_locks[lock_num];
+}
+
+static inline uint spin_lock_get_num(spin_lock_t* lock)
+{
+    return (uint)(lock - smbus_sim_spin_locks);
+}
+
+// There is only one core, so a lock found taken would never be released
+static inline void spin_lock_unsafe_blocking(spin_lock_t* lock)
+{
+    assert(*lock == 0);
+    *lock = 1;
+    __mem_fence_acquire();
+}
+
+static inline void spin_unlock_unsafe(spin_lock_t* lock)
+{
+    __mem_fence_release();
+    *lock = 0;
+}
+
+static inline uint32_t spin_lock_blocking(spin_lock_t* lock)
+{
+    uint32_t status = save_and_disable_interrupts();
+    spin_lock_unsafe_blocking(lock);
+    return status;
+}
+
+static inline void spin_unlock(spin_lock_t* lock, uint32_t status)
+{
+    spin_unlock_unsafe(lock);
+    restore_interrupts(status);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _HARDWARE_SYNC_H
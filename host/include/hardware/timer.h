@@ -0,0 +1,21 @@
+#ifndef _HARDWARE_TIMER_H
+#define _HARDWARE_TIMER_H
+
+#include <pico.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Backed by CLOCK_MONOTONIC. busy_wait_us really spins so that any delay
+// left in an ISR shows up in the simulator's timing figures.
+uint32_t time_us_32(void);
+uint64_t time_us_64(void);
+void busy_wait_us_32(uint32_t delay_us);
+void busy_wait_us(uint64_t delay_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _HARDWARE_TIMER_H
@@ -0,0 +1,59 @@
+#ifndef _PICO_H
+#define _PICO_H
+
+// Host stand-in for the Pico SDK base header. Only the subset used by
+// lib/ is provided; everything behaves as on the RP2040 except that
+// memory placement attributes are no-ops.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <assert.h>
+
+#include <hardware/regs/intctrl.h>
+#include <hardware/regs/dreq.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef unsigned int uint;
+
+#define _u(x) x ## u
+
+#define __isr
+#define __not_in_flash(group)
+#define __not_in_flash_func(func_name) func_name
+#define __time_critical_func(func_name) func_name
+#define __force_inline inline __attribute__((always_inline))
+
+#define VTABLE_FIRST_IRQ 16
+
+#define PICO_OK 0
+
+#define count_of(a) (sizeof(a) / sizeof((a)[0]))
+
+#ifndef MIN
+#define MIN(a, b) ((b) > (a) ? (a) : (b))
+#endif
+
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+uint __get_current_exception(void);
+
+static inline void tight_loop_contents(void)
+{}
+
+// The simulation runs everything on "core 0"
+static inline uint get_core_num(void)
+{
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _PICO_H
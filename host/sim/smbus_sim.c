@@ -0,0 +1,1407 @@
+#define _GNU_SOURCE
+
+#include "smbus_sim.h"
+#include <hardware/irq.h>
+#include <hardware/gpio.h>
+#include <hardware/timer.h>
+#include <hardware/dma.h>
+#include <hardware/sync.h>
+#include <hardware/clocks.h>
+#include <hardware/structs/systick.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define SMBUS_SIM_MAX_ISR_PASSES 64
+#define SMBUS_SIM_CALIBRATION_RUNS 4096
+
+#define SMBUS_SIM_REG(reg) (*(volatile uint32_t*)&(reg))
+
+// IC_DATA_CMD after the simulated master has taken the last write from it
+#define SMBUS_SIM_DATA_CMD_EMPTY UINT32_MAX
+
+#define SMBUS_SIM_CLR_READ_BITS ( \
+    I2C_IC_INTR_STAT_R_RX_UNDER_BITS    | \
+    I2C_IC_INTR_STAT_R_RX_OVER_BITS     | \
+    I2C_IC_INTR_STAT_R_TX_OVER_BITS     | \
+    I2C_IC_INTR_STAT_R_RD_REQ_BITS      | \
+    I2C_IC_INTR_STAT_R_TX_ABRT_BITS     | \
+    I2C_IC_INTR_STAT_R_RX_DONE_BITS     | \
+    I2C_IC_INTR_STAT_R_ACTIVITY_BITS    | \
+    I2C_IC_INTR_STAT_R_STOP_DET_BITS    | \
+    I2C_IC_INTR_STAT_R_START_DET_BITS   | \
+    I2C_IC_INTR_STAT_R_GEN_CALL_BITS    | \
+    I2C_IC_INTR_STAT_R_RESTART_DET_BITS   \
+)
+
+typedef struct smbus_sim_bus_t
+{
+    uint16_t rx_fifo[SMBUS_SIM_FIFO_DEPTH];     // IC_DATA_CMD as read
+    uint rx_head;
+    uint rx_count;
+
+    uint8_t tx_fifo[SMBUS_SIM_FIFO_DEPTH];
+    uint tx_head;
+    uint tx_count;
+
+    uint32_t raw_intr;
+    uint baudrate;
+
+    bool is_active;
+    bool is_read;
+    bool is_addressed;
+    bool was_addressed;
+    bool is_first_data;
+    uint read_bytes;
+    bool is_stalled;
+    bool is_irq_delayed;
+    uint arbitration_losses;
+
+    // Transfer of the controller in master mode, as seen by the host
+    bool is_master_active;
+    uint8_t master_address;
+    uint8_t master_bytes[SMBUS_SIM_FIFO_DEPTH];
+    uint master_len;
+    bool is_notify_received;
+
+    smbus_sim_stats_t stats;
+}
+smbus_sim_bus_t;
+
+typedef struct smbus_sim_dma_channel_t
+{
+    bool is_claimed;
+    bool is_busy;
+    dma_channel_config config;
+    volatile uint8_t* write_addr;
+    const volatile uint8_t* read_addr;
+}
+smbus_sim_dma_channel_t;
+
+i2c_hw_t i2c_sim_hw[2];
+i2c_inst_t i2c0_inst = { &i2c_sim_hw[0], false };
+i2c_inst_t i2c1_inst = { &i2c_sim_hw[1], false };
+
+static smbus_sim_bus_t smbus_sim_buses[2];
+
+static uint32_t smbus_sim_systick_cvr(void);
+systick_hw_t systick_sim_hw = { 0, 0, smbus_sim_systick_cvr, 0 };
+
+static smbus_sim_dma_channel_t smbus_sim_dma_channels[NUM_DMA_CHANNELS];
+static dma_channel_hw_t smbus_sim_dma_hw[NUM_DMA_CHANNELS];
+
+spin_lock_t smbus_sim_spin_locks[NUM_SPIN_LOCKS];
+static bool smbus_sim_spin_lock_claimed[NUM_SPIN_LOCKS];
+
+static irq_handler_t smbus_sim_irq_handlers[NUM_IRQS];
+static bool smbus_sim_irq_enabled[NUM_IRQS];
+static uint smbus_sim_current_exception;
+
+static enum gpio_function smbus_sim_gpio_function[NUM_BANK0_GPIOS];
+static bool smbus_sim_gpio_level[NUM_BANK0_GPIOS];
+static bool smbus_sim_gpio_out[NUM_BANK0_GPIOS];
+static bool smbus_sim_gpio_is_output[NUM_BANK0_GPIOS];
+
+static bool smbus_sim_is_calibrated;
+static int smbus_sim_perf_fd = -1;
+static uint64_t smbus_sim_ns_overhead;
+static uint64_t smbus_sim_instructions_overhead;
+
+static void smbus_sim_update(uint bus_index);
+static void smbus_sim_dma_service(uint bus_index);
+static void smbus_sim_master_service(uint bus_index);
+static void smbus_sim_dma_service(uint bus_index)
+{
+    smbus_sim_bus_t* bus = &smbus_sim_buses[bus_index];
+    i2c_hw_t* hw = &i2c_sim_hw[bus_index];
+
+    for (uint channel = 0; channel < NUM_DMA_CHANNELS; ++channel)
+    {
+        smbus_sim_dma_channel_t* dma = &smbus_sim_dma_channels[channel];
+        dma_channel_hw_t* dma_hw = &smbus_sim_dma_hw[channel];
+        uint size = 1u << dma->config.data_size;
+        bool is_tx = dma->config.dreq == i2c_get_dreq(i2c_get_instance(bus_index), true);
+        bool is_rx = dma->config.dreq == i2c_get_dreq(i2c_get_instance(bus_index), false);
+
+        if(!dma->is_busy || !(is_tx || is_rx))
+        {
+            continue;
+        }
+
+        while (dma_hw->transfer_count > 0)
+        {
+            if(is_rx)
+            {
+                // DREQ is asserted while RXFLR > DMARDL
+                if(!(hw->dma_cr & I2C_IC_DMA_CR_RDMAE_BITS) || bus->rx_count <= hw->dma_rdlr)
+                {
+                    break;
+                }
+
+                assert(dma->read_addr == (const volatile uint8_t*)&hw->data_cmd);
+
+                uint32_t value = bus->rx_fifo[bus->rx_head];
+                bus->rx_head = (bus->rx_head + 1) % SMBUS_SIM_FIFO_DEPTH;
+                bus->rx_count -= 1;
+
+                memcpy((void*)dma->write_addr, &value, size);
+            }
+            else
+            {
+                // DREQ is asserted while TXFLR <= DMATDL
+                if(!(hw->dma_cr & I2C_IC_DMA_CR_TDMAE_BITS) ||
+                   bus->tx_count > hw->dma_tdlr ||
+                   bus->tx_count == SMBUS_SIM_FIFO_DEPTH)
+                {
+                    break;
+                }
+
+                assert(dma->write_addr == (volatile uint8_t*)&hw->data_cmd);
+
+                uint32_t value = 0;
+                memcpy(&value, (const void*)dma->read_addr, size);
+
+                // Byte transfers are replicated across the bus and set CMD
+                if(size == 1)
+                {
+                    value *= 0x01010101u;
+                }
+
+                assert(!(value & I2C_IC_DATA_CMD_CMD_BITS));
+
+                bus->tx_fifo[(bus->tx_head + bus->tx_count) % SMBUS_SIM_FIFO_DEPTH] = (uint8_t)value;
+                bus->tx_count += 1;
+            }
+
+            if(dma->config.read_increment)
+            {
+                dma->read_addr += size;
+            }
+
+            if(dma->config.write_increment)
+            {
+                dma->write_addr += size;
+            }
+
+            dma_hw->transfer_count -= 1;
+        }
+
+        dma->is_busy = dma_hw->transfer_count > 0;
+    }
+}
+
+void smbus_sim_master_service(uint bus_index)
+{
+    smbus_sim_bus_t* bus = &smbus_sim_buses[bus_index];
+    i2c_hw_t* hw = &i2c_sim_hw[bus_index];
+    uint32_t data_cmd = hw->data_cmd;
+
+    if(!hw->enable || !(hw->con & I2C_IC_CON_MASTER_MODE_BITS) || data_cmd == SMBUS_SIM_DATA_CMD_EMPTY)
+    {
+        return;
+    }
+
+    hw->data_cmd = SMBUS_SIM_DATA_CMD_EMPTY;
+
+    if(!bus->is_master_active)
+    {
+        uint32_t abort_source = 0;
+
+        // START and address, acknowledged only by the SMBus host
+        if(bus->arbitration_losses > 0)
+        {
+            bus->arbitration_losses -= 1;
+            abort_source = I2C_IC_TX_ABRT_SOURCE_ARB_LOST_BITS;
+        }
+        else
+        if((hw->tar & 0x7F) != SMBUS_SIM_HOST_ADDRESS)
+        {
+            abort_source = I2C_IC_TX_ABRT_SOURCE_ABRT_7B_ADDR_NOACK_BITS;
+        }
+
+        if(abort_source != 0)
+        {
+            // The winner or our own abort ends the transfer with a STOP
+            SMBUS_SIM_REG(hw->tx_abrt_source) = abort_source;
+            bus->raw_intr |= I2C_IC_INTR_STAT_R_TX_ABRT_BITS | I2C_IC_INTR_STAT_R_STOP_DET_BITS;
+            return;
+        }
+
+        bus->is_master_active = true;
+        bus->master_address = hw->tar & 0x7F;
+        bus->master_len = 0;
+    }
+
+    if(bus->master_len < SMBUS_SIM_FIFO_DEPTH)
+    {
+        bus->master_bytes[bus->master_len] = (uint8_t)(data_cmd & I2C_IC_DATA_CMD_DAT_BITS);
+        bus->master_len += 1;
+    }
+
+    if(data_cmd & I2C_IC_DATA_CMD_STOP_BITS)
+    {
+        bus->is_master_active = false;
+        bus->is_notify_received = (bus->master_len == 3);
+        bus->raw_intr |= I2C_IC_INTR_STAT_R_STOP_DET_BITS;
+    }
+}
+
+uint32_t smbus_sim_clr(uint bus_index, uint32_t bits);
+static void smbus_sim_raise(uint bus_index, uint32_t bits);
+static void smbus_sim_set_sda(uint bus_index, bool level);
+static void smbus_sim_call_isr(uint bus_index);
+static void smbus_sim_run_isr(uint bus_index, bool is_stretched);
+static uint32_t smbus_sim_intr_stat(uint bus_index);
+static void smbus_sim_calibrate(void);
+static uint64_t smbus_sim_now_ns(void);
+static uint64_t smbus_sim_instructions(void);
+static uint8_t smbus_sim_pec_single(uint8_t crc, uint8_t data);
+
+
+#define SMBUS_SIM_CLR_READ(name, bits)                                          \
+    static uint32_t smbus_sim_clr_##name##_0(void) { return smbus_sim_clr(0, bits); } \
+    static uint32_t smbus_sim_clr_##name##_1(void) { return smbus_sim_clr(1, bits); }
+
+SMBUS_SIM_CLR_READ(all, SMBUS_SIM_CLR_READ_BITS)
+SMBUS_SIM_CLR_READ(rx_under, I2C_IC_INTR_STAT_R_RX_UNDER_BITS)
+SMBUS_SIM_CLR_READ(rx_over, I2C_IC_INTR_STAT_R_RX_OVER_BITS)
+SMBUS_SIM_CLR_READ(tx_over, I2C_IC_INTR_STAT_R_TX_OVER_BITS)
+SMBUS_SIM_CLR_READ(rd_req, I2C_IC_INTR_STAT_R_RD_REQ_BITS)
+SMBUS_SIM_CLR_READ(tx_abrt, I2C_IC_INTR_STAT_R_TX_ABRT_BITS)
+SMBUS_SIM_CLR_READ(rx_done, I2C_IC_INTR_STAT_R_RX_DONE_BITS)
+SMBUS_SIM_CLR_READ(activity, I2C_IC_INTR_STAT_R_ACTIVITY_BITS)
+SMBUS_SIM_CLR_READ(stop_det, I2C_IC_INTR_STAT_R_STOP_DET_BITS)
+SMBUS_SIM_CLR_READ(start_det, I2C_IC_INTR_STAT_R_START_DET_BITS)
+SMBUS_SIM_CLR_READ(gen_call, I2C_IC_INTR_STAT_R_GEN_CALL_BITS)
+SMBUS_SIM_CLR_READ(restart_det, I2C_IC_INTR_STAT_R_RESTART_DET_BITS)
+
+#define SMBUS_SIM_BIND_CLR_READ(hw, index, name) \
+    (hw)->clr_##name##_read = smbus_sim_clr_##name##_##index
+
+static uint32_t smbus_sim_intr_stat_0(void) { return smbus_sim_intr_stat(0); }
+static uint32_t smbus_sim_intr_stat_1(void) { return smbus_sim_intr_stat(1); }
+
+
+// Simulated controller
+
+void smbus_sim_update(uint bus_index)
+{
+    smbus_sim_bus_t* bus = &smbus_sim_buses[bus_index];
+    i2c_hw_t* hw = &i2c_sim_hw[bus_index];
+    uint32_t raw;
+    uint32_t status = 0;
+
+    // DMA requests and master writes are served before the interrupt levels
+    // are sampled
+    smbus_sim_dma_service(bus_index);
+    smbus_sim_master_service(bus_index);
+
+    raw = bus->raw_intr & ~(I2C_IC_INTR_STAT_R_RX_FULL_BITS | I2C_IC_INTR_STAT_R_TX_EMPTY_BITS);
+
+    if(bus->rx_count > hw->rx_tl)
+    {
+        raw |= I2C_IC_INTR_STAT_R_RX_FULL_BITS;
+    }
+
+    // A master write still waiting in IC_DATA_CMD has not left the FIFO
+    if(bus->tx_count <= hw->tx_tl && hw->data_cmd == SMBUS_SIM_DATA_CMD_EMPTY)
+    {
+        raw |= I2C_IC_INTR_STAT_R_TX_EMPTY_BITS;
+    }
+
+    if(bus->tx_count < SMBUS_SIM_FIFO_DEPTH)
+    {
+        status |= I2C_IC_STATUS_TFNF_BITS;
+    }
+
+    if(bus->tx_count == 0)
+    {
+        status |= I2C_IC_STATUS_TFE_BITS;
+    }
+
+    if(bus->rx_count > 0)
+    {
+        status |= I2C_IC_STATUS_RFNE_BITS;
+    }
+
+    if(bus->is_active && bus->was_addressed)
+    {
+        status |= I2C_IC_STATUS_ACTIVITY_BITS | I2C_IC_STATUS_SLV_ACTIVITY_BITS;
+    }
+
+    bus->raw_intr = raw;
+
+    SMBUS_SIM_REG(hw->raw_intr_stat) = raw;
+    SMBUS_SIM_REG(hw->status) = status;
+    SMBUS_SIM_REG(hw->rxflr) = bus->rx_count;
+    SMBUS_SIM_REG(hw->txflr) = bus->tx_count;
+}
+
+uint32_t smbus_sim_clr(uint bus_index, uint32_t bits)
+{
+    smbus_sim_bus_t* bus = &smbus_sim_buses[bus_index];
+    uint32_t was_set = bus->raw_intr & bits;
+
+    bus->raw_intr &= ~bits;
+
+    if(bits & I2C_IC_INTR_STAT_R_TX_ABRT_BITS)
+    {
+        SMBUS_SIM_REG(i2c_sim_hw[bus_index].tx_abrt_source) = 0;
+    }
+
+    smbus_sim_update(bus_index);
+
+    return was_set ? 1 : 0;
+}
+
+uint32_t smbus_sim_intr_stat(uint bus_index)
+{
+    smbus_sim_update(bus_index);
+
+    return smbus_sim_buses[bus_index].raw_intr & i2c_sim_hw[bus_index].intr_mask;
+}
+
+void smbus_sim_raise(uint bus_index, uint32_t bits)
+{
+    smbus_sim_buses[bus_index].raw_intr |= bits;
+    smbus_sim_update(bus_index);
+}
+
+void smbus_sim_set_sda(uint bus_index, bool level)
+{
+    for (uint gpio = 0; gpio < NUM_BANK0_GPIOS; ++gpio)
+    {
+        // RP2040 pinout: GPIO 4n is I2C0 SDA and GPIO 4n + 2 is I2C1 SDA
+        if(smbus_sim_gpio_function[gpio] == GPIO_FUNC_I2C && (gpio & 0x3) == (bus_index << 1))
+        {
+            smbus_sim_gpio_level[gpio] = level;
+        }
+    }
+}
+
+void smbus_sim_call_isr(uint bus_index)
+{
+    smbus_sim_bus_t* bus = &smbus_sim_buses[bus_index];
+    uint irq = I2C0_IRQ + bus_index;
+    uint64_t instructions = smbus_sim_instructions();
+    uint64_t start_ns = smbus_sim_now_ns();
+
+    smbus_sim_current_exception = VTABLE_FIRST_IRQ + irq;
+    smbus_sim_irq_handlers[irq]();
+    smbus_sim_current_exception = 0;
+
+    uint64_t isr_ns = smbus_sim_now_ns() - start_ns;
+    instructions = smbus_sim_instructions() - instructions;
+
+    isr_ns = (isr_ns > smbus_sim_ns_overhead) ? (isr_ns - smbus_sim_ns_overhead) : 0;
+    instructions = (instructions > smbus_sim_instructions_overhead) ? (instructions - smbus_sim_instructions_overhead) : 0;
+
+    bus->stats.isr_entries += 1;
+    bus->stats.isr_ns += isr_ns;
+    bus->stats.isr_instructions += instructions;
+
+    if(isr_ns > bus->stats.isr_ns_max)
+    {
+        bus->stats.isr_ns_max = isr_ns;
+    }
+}
+
+void smbus_sim_service(uint bus_index)
+{
+    smbus_sim_run_isr(bus_index, false);
+}
+
+void smbus_sim_run_isr(uint bus_index, bool is_stretched)
+{
+    smbus_sim_bus_t* bus = &smbus_sim_buses[bus_index];
+    i2c_hw_t* hw = &i2c_sim_hw[bus_index];
+    uint irq = I2C0_IRQ + bus_index;
+
+    // A late ISR is only entered once SCL is held for it
+    if(bus->is_irq_delayed && !is_stretched)
+    {
+        smbus_sim_update(bus_index);
+        return;
+    }
+
+    for (uint pass = 0; ; ++pass)
+    {
+        if(hw->intr_stat == 0 || !smbus_sim_irq_enabled[irq] || smbus_sim_irq_handlers[irq] == NULL)
+        {
+            break;
+        }
+
+        if(pass == SMBUS_SIM_MAX_ISR_PASSES)
+        {
+            bus->stats.stuck += 1;
+            break;
+        }
+
+        smbus_sim_call_isr(bus_index);
+    }
+}
+
+void smbus_sim_set_irq_delay(uint bus_index, bool is_delayed)
+{
+    smbus_sim_buses[bus_index].is_irq_delayed = is_delayed;
+
+    if(!is_delayed)
+    {
+        smbus_sim_service(bus_index);
+    }
+}
+
+
+// Measurement
+
+uint64_t smbus_sim_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t smbus_sim_instructions(void)
+{
+    uint64_t count = 0;
+
+    if(smbus_sim_perf_fd >= 0)
+    {
+        if(read(smbus_sim_perf_fd, &count, sizeof(count)) != sizeof(count))
+        {
+            count = 0;
+        }
+    }
+
+    return count;
+}
+
+void smbus_sim_calibrate(void)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    smbus_sim_perf_fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+
+    // Use the cheapest empty measurement as the fixed probe cost
+    smbus_sim_ns_overhead = UINT64_MAX;
+    smbus_sim_instructions_overhead = UINT64_MAX;
+
+    for (uint i = 0; i < SMBUS_SIM_CALIBRATION_RUNS; ++i)
+    {
+        uint64_t instructions = smbus_sim_instructions();
+        uint64_t start_ns = smbus_sim_now_ns();
+        uint64_t isr_ns = smbus_sim_now_ns() - start_ns;
+        instructions = smbus_sim_instructions() - instructions;
+
+        if(isr_ns < smbus_sim_ns_overhead)
+        {
+            smbus_sim_ns_overhead = isr_ns;
+        }
+
+        if(instructions < smbus_sim_instructions_overhead)
+        {
+            smbus_sim_instructions_overhead = instructions;
+        }
+    }
+
+    smbus_sim_is_calibrated = true;
+}
+
+uint32_t smbus_sim_systick_cvr(void)
+{
+    uint64_t cycles = smbus_sim_now_ns() * (clock_get_hz(clk_sys) / 1000000u) / 1000u;
+    uint32_t reload = systick_sim_hw.rvr & M0PLUS_SYST_RVR_BITS;
+
+    if(!(systick_sim_hw.csr & M0PLUS_SYST_CSR_ENABLE_BITS))
+    {
+        return 0;
+    }
+
+    // Counts down from RVR to 0, then reloads
+    return reload - (uint32_t)(cycles % ((uint64_t)reload + 1));
+}
+
+void smbus_sim_set_arbitration_loss(uint bus_index, uint count)
+{
+    smbus_sim_buses[bus_index].arbitration_losses = count;
+}
+
+bool smbus_sim_get_host_notify(uint bus_index, uint8_t* address, uint16_t* status)
+{
+    smbus_sim_bus_t* bus = &smbus_sim_buses[bus_index];
+
+    if(!bus->is_notify_received || bus->master_address != SMBUS_SIM_HOST_ADDRESS)
+    {
+        return false;
+    }
+
+    *address = bus->master_bytes[0] >> 1;
+    *status = (uint16_t)(bus->master_bytes[1] | (bus->master_bytes[2] << 8));
+    bus->is_notify_received = false;
+
+    return true;
+}
+
+bool smbus_sim_has_instruction_counter(void)
+{
+    return smbus_sim_perf_fd >= 0;
+}
+
+void smbus_sim_get_stats(uint bus_index, smbus_sim_stats_t* stats)
+{
+    *stats = smbus_sim_buses[bus_index].stats;
+}
+
+void smbus_sim_reset_stats(uint bus_index)
+{
+    memset(&smbus_sim_buses[bus_index].stats, 0, sizeof(smbus_sim_stats_t));
+}
+
+void smbus_sim_reset(void)
+{
+    if(!smbus_sim_is_calibrated)
+    {
+        smbus_sim_calibrate();
+    }
+
+    memset(smbus_sim_buses, 0, sizeof(smbus_sim_buses));
+    memset(i2c_sim_hw, 0, sizeof(i2c_sim_hw));
+    memset(smbus_sim_irq_handlers, 0, sizeof(smbus_sim_irq_handlers));
+    memset(smbus_sim_irq_enabled, 0, sizeof(smbus_sim_irq_enabled));
+    memset(smbus_sim_dma_channels, 0, sizeof(smbus_sim_dma_channels));
+    memset(smbus_sim_dma_hw, 0, sizeof(smbus_sim_dma_hw));
+    memset((void*)smbus_sim_spin_locks, 0, sizeof(smbus_sim_spin_locks));
+    memset(smbus_sim_spin_lock_claimed, 0, sizeof(smbus_sim_spin_lock_claimed));
+
+    for (uint gpio = 0; gpio < NUM_BANK0_GPIOS; ++gpio)
+    {
+        smbus_sim_gpio_function[gpio] = GPIO_FUNC_NULL;
+        smbus_sim_gpio_level[gpio] = true;
+        smbus_sim_gpio_out[gpio] = false;
+        smbus_sim_gpio_is_output[gpio] = false;
+    }
+
+    i2c_sim_hw[0].data_cmd = SMBUS_SIM_DATA_CMD_EMPTY;
+    i2c_sim_hw[1].data_cmd = SMBUS_SIM_DATA_CMD_EMPTY;
+
+    SMBUS_SIM_BIND_CLR_READ(&i2c_sim_hw[0], 0, rx_under);
+    SMBUS_SIM_BIND_CLR_READ(&i2c_sim_hw[0], 0, rx_over);
+    SMBUS_SIM_BIND_CLR_READ(&i2c_sim_hw[0], 0, tx_over);
+    SMBUS_SIM_BIND_CLR_READ(&i2c_sim_hw[0], 0, rd_req);
+    SMBUS_SIM_BIND_CLR_READ(&i2c_sim_hw[0], 0, tx_abrt);
+    SMBUS_SIM_BIND_CLR_READ(&i2c_sim_hw[0], 0, rx_done);
+    SMBUS_SIM_BIND_CLR_READ(&i2c_sim_hw[0], 0, activity);
+    SMBUS_SIM_BIND_CLR_READ(&i2c_sim_hw[0], 0, stop_det);
+    SMBUS_SIM_BIND_CLR_READ(&i2c_sim_hw[0], 0, start_det);
+    SMBUS_SIM_BIND_CLR_READ(&i2c_sim_hw[0], 0, gen_call);
+    SMBUS_SIM_BIND_CLR_READ(&i2c_sim_hw[0], 0, restart_det);
+    i2c_sim_hw[0].clr_intr_read = smbus_sim_clr_all_0;
+    i2c_sim_hw[0].intr_stat_read = smbus_sim_intr_stat_0;
+
+    SMBUS_SIM_BIND_CLR_READ(&i2c_sim_hw[1], 1, rx_under);
+    SMBUS_SIM_BIND_CLR_READ(&i2c_sim_hw[1], 1, rx_over);
+    SMBUS_SIM_BIND_CLR_READ(&i2c_sim_hw[1], 1, tx_over);
+    SMBUS_SIM_BIND_CLR_READ(&i2c_sim_hw[1], 1, rd_req);
+    SMBUS_SIM_BIND_CLR_READ(&i2c_sim_hw[1], 1, tx_abrt);
+    SMBUS_SIM_BIND_CLR_READ(&i2c_sim_hw[1], 1, rx_done);
+    SMBUS_SIM_BIND_CLR_READ(&i2c_sim_hw[1], 1, activity);
+    SMBUS_SIM_BIND_CLR_READ(&i2c_sim_hw[1], 1, stop_det);
+    SMBUS_SIM_BIND_CLR_READ(&i2c_sim_hw[1], 1, start_det);
+    SMBUS_SIM_BIND_CLR_READ(&i2c_sim_hw[1], 1, gen_call);
+    SMBUS_SIM_BIND_CLR_READ(&i2c_sim_hw[1], 1, restart_det);
+    i2c_sim_hw[1].clr_intr_read = smbus_sim_clr_all_1;
+    i2c_sim_hw[1].intr_stat_read = smbus_sim_intr_stat_1;
+
+    i2c_sim_hw[0].intr_mask = I2C_IC_INTR_MASK_RESET;
+    i2c_sim_hw[1].intr_mask = I2C_IC_INTR_MASK_RESET;
+
+    smbus_sim_update(0);
+    smbus_sim_update(1);
+}
+
+
+// Bus primitives
+
+bool smbus_sim_start(uint bus_index, uint8_t address, bool read)
+{
+    smbus_sim_bus_t* bus = &smbus_sim_buses[bus_index];
+    i2c_hw_t* hw = &i2c_sim_hw[bus_index];
+    bool is_slave = hw->enable && !(hw->con & I2C_IC_CON_IC_SLAVE_DISABLE_BITS);
+
+    if(bus->is_active)
+    {
+        if(bus->is_addressed)
+        {
+            smbus_sim_raise(bus_index, I2C_IC_INTR_STAT_R_RESTART_DET_BITS);
+        }
+    }
+    else
+    {
+        if(hw->enable)
+        {
+            smbus_sim_raise(bus_index, I2C_IC_INTR_STAT_R_START_DET_BITS);
+        }
+
+        bus->was_addressed = false;
+    }
+
+    smbus_sim_service(bus_index);
+
+    bus->is_active = true;
+    bus->is_read = read;
+    bus->is_addressed = is_slave && (address == (hw->sar & 0x7F));
+    bus->was_addressed |= bus->is_addressed;
+    bus->is_first_data = true;
+    bus->read_bytes = 0;
+
+    // Stale TX FIFO contents are flushed through TX_ABRT on the next read
+    if(bus->is_addressed && read && bus->tx_count > 0)
+    {
+        bus->tx_count = 0;
+        bus->tx_head = 0;
+        SMBUS_SIM_REG(hw->tx_abrt_source) = I2C_IC_TX_ABRT_SOURCE_ABRT_SLVFLUSH_TXFIFO_BITS;
+        smbus_sim_raise(bus_index, I2C_IC_INTR_STAT_R_TX_ABRT_BITS);
+        smbus_sim_service(bus_index);
+    }
+
+    return bus->is_addressed;
+}
+
+bool smbus_sim_write_byte(uint bus_index, uint8_t value)
+{
+    smbus_sim_bus_t* bus = &smbus_sim_buses[bus_index];
+
+    assert(bus->is_active && !bus->is_read);
+
+    if(!bus->is_addressed)
+    {
+        return false;
+    }
+
+    if(bus->rx_count == SMBUS_SIM_FIFO_DEPTH)
+    {
+        // RX_FIFO_FULL_HLD_CTRL: SCL is held until the ISR makes room
+        smbus_sim_run_isr(bus_index, true);
+
+        if(bus->rx_count == SMBUS_SIM_FIFO_DEPTH)
+        {
+            bus->stats.stalls += 1;
+            bus->is_stalled = true;
+            return false;
+        }
+    }
+
+    bus->rx_fifo[(bus->rx_head + bus->rx_count) % SMBUS_SIM_FIFO_DEPTH] =
+        value | (bus->is_first_data ? I2C_IC_DATA_CMD_FIRST_DATA_BYTE_BITS : 0);
+    bus->rx_count += 1;
+    bus->is_first_data = false;
+
+    smbus_sim_service(bus_index);
+
+    return true;
+}
+
+uint8_t smbus_sim_read_byte(uint bus_index, bool ack)
+{
+    smbus_sim_bus_t* bus = &smbus_sim_buses[bus_index];
+    uint8_t value = 0xFF;
+
+    assert(bus->is_active && bus->is_read);
+
+    if(!bus->is_addressed)
+    {
+        return value;
+    }
+
+    // The master releases SDA while it waits for the slave to drive data
+    smbus_sim_set_sda(bus_index, true);
+
+    if(bus->tx_count == 0)
+    {
+        // SCL is held until the ISR has answered RD_REQ
+        smbus_sim_raise(bus_index, I2C_IC_INTR_STAT_R_RD_REQ_BITS);
+        smbus_sim_run_isr(bus_index, true);
+    }
+
+    if(bus->tx_count == 0)
+    {
+        bus->stats.stalls += 1;
+        bus->is_stalled = true;
+        return value;
+    }
+
+    if(bus->arbitration_losses > 0)
+    {
+        // Another slave drives a 0 where this one sends a 1 (the device
+        // with the lower address wins an ARA read), the rest is flushed
+        bus->arbitration_losses -= 1;
+        value = 0x00;
+        bus->tx_count = 0;
+        bus->tx_head = 0;
+        bus->read_bytes += 1;
+        SMBUS_SIM_REG(i2c_sim_hw[bus_index].tx_abrt_source) = I2C_IC_TX_ABRT_SOURCE_ABRT_SLV_ARBLOST_BITS;
+        smbus_sim_raise(bus_index, I2C_IC_INTR_STAT_R_TX_ABRT_BITS);
+        smbus_sim_service(bus_index);
+
+        return value;
+    }
+
+    value = bus->tx_fifo[bus->tx_head];
+    bus->tx_head = (bus->tx_head + 1) % SMBUS_SIM_FIFO_DEPTH;
+    bus->tx_count -= 1;
+    bus->read_bytes += 1;
+
+    if(!ack)
+    {
+        smbus_sim_raise(bus_index, I2C_IC_INTR_STAT_R_RX_DONE_BITS);
+    }
+
+    smbus_sim_service(bus_index);
+
+    return value;
+}
+
+void smbus_sim_stop(uint bus_index)
+{
+    smbus_sim_bus_t* bus = &smbus_sim_buses[bus_index];
+    i2c_hw_t* hw = &i2c_sim_hw[bus_index];
+
+    if(bus->is_active && bus->is_read && bus->is_addressed && bus->read_bytes == 0)
+    {
+        // Quick read: the slave still raises RD_REQ after the address ACK,
+        // but the master holds SDA low to set up the STOP condition
+        smbus_sim_set_sda(bus_index, false);
+
+        if(bus->tx_count == 0)
+        {
+            smbus_sim_raise(bus_index, I2C_IC_INTR_STAT_R_RD_REQ_BITS);
+            smbus_sim_run_isr(bus_index, true);
+        }
+
+        // Released by SCL, the slave drives the first bit of its answer and
+        // a 0 there keeps SDA from rising for the STOP
+        if(bus->tx_count > 0 && !(bus->tx_fifo[bus->tx_head] & 0x80))
+        {
+            bus->stats.stalls += 1;
+            bus->is_stalled = true;
+        }
+    }
+
+    if(hw->enable && (bus->was_addressed || !(hw->con & I2C_IC_CON_STOP_DET_IFADDRESSED_BITS)))
+    {
+        smbus_sim_raise(bus_index, I2C_IC_INTR_STAT_R_STOP_DET_BITS);
+    }
+
+    bus->is_active = false;
+    bus->is_read = false;
+    bus->is_addressed = false;
+    bus->was_addressed = false;
+
+    smbus_sim_service(bus_index);
+    smbus_sim_set_sda(bus_index, true);
+}
+
+
+// SMBus protocol transactions
+
+uint8_t smbus_sim_pec_single(uint8_t crc, uint8_t data)
+{
+    // Bitwise CRC-8 (x^8 + x^2 + x + 1), independent of lib/smbus_pec.c
+    crc ^= data;
+
+    for (uint bit = 0; bit < 8; ++bit)
+    {
+        crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+
+    return crc;
+}
+
+static int smbus_sim_finish(uint bus_index, int status)
+{
+    smbus_sim_bus_t* bus = &smbus_sim_buses[bus_index];
+
+    smbus_sim_stop(bus_index);
+
+    if(bus->is_stalled)
+    {
+        bus->is_stalled = false;
+        status = SMBUS_SIM_STALL;
+    }
+
+    return status;
+}
+
+int smbus_sim_quick(uint bus_index, uint8_t address, bool read)
+{
+    int status = smbus_sim_start(bus_index, address, read) ? SMBUS_SIM_OK : SMBUS_SIM_NACK;
+
+    return smbus_sim_finish(bus_index, status);
+}
+
+int smbus_sim_send_byte(uint bus_index, uint8_t address, uint8_t value, bool pec)
+{
+    uint8_t crc = 0;
+
+    crc = smbus_sim_pec_single(crc, address << 1);
+    crc = smbus_sim_pec_single(crc, value);
+
+    if(!smbus_sim_start(bus_index, address, false) ||
+       !smbus_sim_write_byte(bus_index, value) ||
+       (pec && !smbus_sim_write_byte(bus_index, crc)))
+    {
+        return smbus_sim_finish(bus_index, SMBUS_SIM_NACK);
+    }
+
+    return smbus_sim_finish(bus_index, SMBUS_SIM_OK);
+}
+
+int smbus_sim_receive_byte(uint bus_index, uint8_t address, uint8_t* value, bool pec)
+{
+    uint8_t crc = 0;
+    int status = SMBUS_SIM_OK;
+
+    if(!smbus_sim_start(bus_index, address, true))
+    {
+        return smbus_sim_finish(bus_index, SMBUS_SIM_NACK);
+    }
+
+    *value = smbus_sim_read_byte(bus_index, pec);
+
+    if(pec)
+    {
+        crc = smbus_sim_pec_single(crc, (address << 1) | 0x1);
+        crc = smbus_sim_pec_single(crc, *value);
+
+        if(smbus_sim_read_byte(bus_index, false) != crc)
+        {
+            status = SMBUS_SIM_PEC_ERROR;
+        }
+    }
+
+    return smbus_sim_finish(bus_index, status);
+}
+
+int smbus_sim_write(uint bus_index, uint8_t address, uint8_t command, const uint8_t data[], size_t data_len, bool pec)
+{
+    uint8_t crc = 0;
+
+    crc = smbus_sim_pec_single(crc, address << 1);
+    crc = smbus_sim_pec_single(crc, command);
+
+    if(!smbus_sim_start(bus_index, address, false) || !smbus_sim_write_byte(bus_index, command))
+    {
+        return smbus_sim_finish(bus_index, SMBUS_SIM_NACK);
+    }
+
+    for (size_t i = 0; i < data_len; ++i)
+    {
+        crc = smbus_sim_pec_single(crc, data[i]);
+
+        if(!smbus_sim_write_byte(bus_index, data[i]))
+        {
+            return smbus_sim_finish(bus_index, SMBUS_SIM_NACK);
+        }
+    }
+
+    if(pec && !smbus_sim_write_byte(bus_index, crc))
+    {
+        return smbus_sim_finish(bus_index, SMBUS_SIM_NACK);
+    }
+
+    return smbus_sim_finish(bus_index, SMBUS_SIM_OK);
+}
+
+int smbus_sim_read(uint bus_index, uint8_t address, uint8_t command, uint8_t data[], size_t data_len, bool pec)
+{
+    uint8_t crc = 0;
+    int status = SMBUS_SIM_OK;
+
+    crc = smbus_sim_pec_single(crc, address << 1);
+    crc = smbus_sim_pec_single(crc, command);
+    crc = smbus_sim_pec_single(crc, (address << 1) | 0x1);
+
+    if(!smbus_sim_start(bus_index, address, false) ||
+       !smbus_sim_write_byte(bus_index, command) ||
+       !smbus_sim_start(bus_index, address, true))
+    {
+        return smbus_sim_finish(bus_index, SMBUS_SIM_NACK);
+    }
+
+    for (size_t i = 0; i < data_len; ++i)
+    {
+        data[i] = smbus_sim_read_byte(bus_index, pec || (i + 1 < data_len));
+        crc = smbus_sim_pec_single(crc, data[i]);
+    }
+
+    if(pec && smbus_sim_read_byte(bus_index, false) != crc)
+    {
+        status = SMBUS_SIM_PEC_ERROR;
+    }
+
+    return smbus_sim_finish(bus_index, status);
+}
+
+int smbus_sim_block_read(uint bus_index, uint8_t address, uint8_t command, uint8_t data[], size_t* data_len, bool pec)
+{
+    uint8_t crc = 0;
+    int status = SMBUS_SIM_OK;
+
+    crc = smbus_sim_pec_single(crc, address << 1);
+    crc = smbus_sim_pec_single(crc, command);
+    crc = smbus_sim_pec_single(crc, (address << 1) | 0x1);
+
+    if(!smbus_sim_start(bus_index, address, false) ||
+       !smbus_sim_write_byte(bus_index, command) ||
+       !smbus_sim_start(bus_index, address, true))
+    {
+        return smbus_sim_finish(bus_index, SMBUS_SIM_NACK);
+    }
+
+    data[0] = smbus_sim_read_byte(bus_index, true);
+    crc = smbus_sim_pec_single(crc, data[0]);
+
+    for (size_t i = 1; i <= data[0]; ++i)
+    {
+        data[i] = smbus_sim_read_byte(bus_index, pec || (i < data[0]));
+        crc = smbus_sim_pec_single(crc, data[i]);
+    }
+
+    *data_len = (size_t)data[0] + 1;
+
+    if(pec && smbus_sim_read_byte(bus_index, false) != crc)
+    {
+        status = SMBUS_SIM_PEC_ERROR;
+    }
+
+    return smbus_sim_finish(bus_index, status);
+}
+
+int smbus_sim_proc_call(uint bus_index, uint8_t address, uint8_t command, uint16_t request, uint16_t* response, bool pec)
+{
+    uint8_t crc = 0;
+    uint8_t low;
+    uint8_t high;
+    int status = SMBUS_SIM_OK;
+
+    crc = smbus_sim_pec_single(crc, address << 1);
+    crc = smbus_sim_pec_single(crc, command);
+    crc = smbus_sim_pec_single(crc, (uint8_t)(request >> 0));
+    crc = smbus_sim_pec_single(crc, (uint8_t)(request >> 8));
+    crc = smbus_sim_pec_single(crc, (address << 1) | 0x1);
+
+    if(!smbus_sim_start(bus_index, address, false) ||
+       !smbus_sim_write_byte(bus_index, command) ||
+       !smbus_sim_write_byte(bus_index, (uint8_t)(request >> 0)) ||
+       !smbus_sim_write_byte(bus_index, (uint8_t)(request >> 8)) ||
+       !smbus_sim_start(bus_index, address, true))
+    {
+        return smbus_sim_finish(bus_index, SMBUS_SIM_NACK);
+    }
+
+    low = smbus_sim_read_byte(bus_index, true);
+    high = smbus_sim_read_byte(bus_index, pec);
+
+    crc = smbus_sim_pec_single(crc, low);
+    crc = smbus_sim_pec_single(crc, high);
+
+    *response = (uint16_t)(low | (high << 8));
+
+    if(pec && smbus_sim_read_byte(bus_index, false) != crc)
+    {
+        status = SMBUS_SIM_PEC_ERROR;
+    }
+
+    return smbus_sim_finish(bus_index, status);
+}
+
+int smbus_sim_block_proc_call(uint bus_index, uint8_t address, uint8_t command, const uint8_t request[], uint8_t response[], size_t* response_len, bool pec)
+{
+    uint8_t crc = 0;
+    int status = SMBUS_SIM_OK;
+
+    crc = smbus_sim_pec_single(crc, address << 1);
+    crc = smbus_sim_pec_single(crc, command);
+
+    if(!smbus_sim_start(bus_index, address, false) || !smbus_sim_write_byte(bus_index, command))
+    {
+        return smbus_sim_finish(bus_index, SMBUS_SIM_NACK);
+    }
+
+    // Write half: count byte and data, no PEC before the RESTART
+    for (size_t i = 0; i <= request[0]; ++i)
+    {
+        crc = smbus_sim_pec_single(crc, request[i]);
+
+        if(!smbus_sim_write_byte(bus_index, request[i]))
+        {
+            return smbus_sim_finish(bus_index, SMBUS_SIM_NACK);
+        }
+    }
+
+    crc = smbus_sim_pec_single(crc, (address << 1) | 0x1);
+
+    if(!smbus_sim_start(bus_index, address, true))
+    {
+        return smbus_sim_finish(bus_index, SMBUS_SIM_NACK);
+    }
+
+    response[0] = smbus_sim_read_byte(bus_index, true);
+    crc = smbus_sim_pec_single(crc, response[0]);
+
+    for (size_t i = 1; i <= response[0]; ++i)
+    {
+        response[i] = smbus_sim_read_byte(bus_index, pec || (i < response[0]));
+        crc = smbus_sim_pec_single(crc, response[i]);
+    }
+
+    *response_len = (size_t)response[0] + 1;
+
+    if(pec && smbus_sim_read_byte(bus_index, false) != crc)
+    {
+        status = SMBUS_SIM_PEC_ERROR;
+    }
+
+    return smbus_sim_finish(bus_index, status);
+}
+
+// Pico SDK stand-ins
+
+uint __get_current_exception(void)
+{
+    return smbus_sim_current_exception;
+}
+
+uint i2c_init(i2c_inst_t* i2c, uint baudrate)
+{
+    uint bus_index = i2c_hw_index(i2c);
+    i2c_hw_t* hw = i2c_get_hw(i2c);
+
+    smbus_sim_buses[bus_index].baudrate = baudrate;
+
+    hw->enable = 0;
+    hw->con = (I2C_IC_CON_SPEED_BITS & (2 << 1))
+            | I2C_IC_CON_MASTER_MODE_BITS
+            | I2C_IC_CON_IC_SLAVE_DISABLE_BITS
+            | I2C_IC_CON_IC_RESTART_EN_BITS
+            | I2C_IC_CON_TX_EMPTY_CTRL_BITS;
+    hw->rx_tl = 0;
+    hw->tx_tl = 0;
+    hw->dma_cr = 0x3;
+    hw->enable = 1;
+
+    smbus_sim_update(bus_index);
+
+    return baudrate;
+}
+
+void i2c_deinit(i2c_inst_t* i2c)
+{
+    i2c_get_hw(i2c)->enable = 0;
+}
+
+void i2c_set_slave_mode(i2c_inst_t* i2c, bool slave, uint8_t addr)
+{
+    i2c_hw_t* hw = i2c_get_hw(i2c);
+    uint32_t ctrl_set_if_master = I2C_IC_CON_MASTER_MODE_BITS | I2C_IC_CON_IC_SLAVE_DISABLE_BITS;
+    uint32_t ctrl_set_if_slave = I2C_IC_CON_RX_FIFO_FULL_HLD_CTRL_BITS;
+
+    hw->enable = 0;
+
+    if(slave)
+    {
+        hw->con = (hw->con & ~(ctrl_set_if_master | ctrl_set_if_slave)) | ctrl_set_if_slave;
+        hw->sar = addr;
+    }
+    else
+    {
+        hw->con = (hw->con & ~(ctrl_set_if_master | ctrl_set_if_slave)) | ctrl_set_if_master;
+    }
+
+    hw->enable = 1;
+}
+
+uint8_t i2c_read_byte_raw(i2c_inst_t* i2c)
+{
+    return (uint8_t)i2c_sim_read_data_cmd(i2c);
+}
+
+uint32_t i2c_sim_read_data_cmd(i2c_inst_t* i2c)
+{
+    uint bus_index = i2c_hw_index(i2c);
+    smbus_sim_bus_t* bus = &smbus_sim_buses[bus_index];
+    uint32_t value = 0;
+
+    assert(bus->rx_count > 0);
+
+    if(bus->rx_count > 0)
+    {
+        value = bus->rx_fifo[bus->rx_head];
+        bus->rx_head = (bus->rx_head + 1) % SMBUS_SIM_FIFO_DEPTH;
+        bus->rx_count -= 1;
+    }
+
+    smbus_sim_update(bus_index);
+
+    return value;
+}
+
+void i2c_write_byte_raw(i2c_inst_t* i2c, uint8_t value)
+{
+    uint bus_index = i2c_hw_index(i2c);
+    smbus_sim_bus_t* bus = &smbus_sim_buses[bus_index];
+
+    assert(bus->tx_count < SMBUS_SIM_FIFO_DEPTH);
+
+    if(bus->tx_count < SMBUS_SIM_FIFO_DEPTH)
+    {
+        bus->tx_fifo[(bus->tx_head + bus->tx_count) % SMBUS_SIM_FIFO_DEPTH] = value;
+        bus->tx_count += 1;
+    }
+
+    smbus_sim_update(bus_index);
+}
+
+int spin_lock_claim_unused(bool required)
+{
+    for (uint lock_num = 0; lock_num < NUM_SPIN_LOCKS; ++lock_num)
+    {
+        if(!smbus_sim_spin_lock_claimed[lock_num])
+        {
+            smbus_sim_spin_lock_claimed[lock_num] = true;
+            return (int)lock_num;
+        }
+    }
+
+    assert(!required);
+
+    return -1;
+}
+
+void spin_lock_unclaim(uint lock_num)
+{
+    assert(lock_num < NUM_SPIN_LOCKS);
+
+    // Released as it is given back, as the SDK does
+    smbus_sim_spin_locks[lock_num] = 0;
+    smbus_sim_spin_lock_claimed[lock_num] = false;
+}
+
+int dma_claim_unused_channel(bool required)
+{
+    for (uint channel = 0; channel < NUM_DMA_CHANNELS; ++channel)
+    {
+        if(!smbus_sim_dma_channels[channel].is_claimed)
+        {
+            smbus_sim_dma_channels[channel].is_claimed = true;
+            return (int)channel;
+        }
+    }
+
+    assert(!required);
+
+    return -1;
+}
+
+void dma_channel_claim(uint channel)
+{
+    assert(channel < NUM_DMA_CHANNELS && !smbus_sim_dma_channels[channel].is_claimed);
+
+    smbus_sim_dma_channels[channel].is_claimed = true;
+}
+
+void dma_channel_unclaim(uint channel)
+{
+    assert(channel < NUM_DMA_CHANNELS);
+
+    smbus_sim_dma_channels[channel].is_claimed = false;
+}
+
+bool dma_channel_is_claimed(uint channel)
+{
+    assert(channel < NUM_DMA_CHANNELS);
+
+    return smbus_sim_dma_channels[channel].is_claimed;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel)
+{
+    dma_channel_config config = { DMA_SIZE_32, true, false, DREQ_FORCE };
+
+    assert(channel < NUM_DMA_CHANNELS);
+
+    return config;
+}
+
+dma_channel_hw_t* dma_channel_hw_addr(uint channel)
+{
+    assert(channel < NUM_DMA_CHANNELS);
+
+    return &smbus_sim_dma_hw[channel];
+}
+
+void dma_channel_configure(
+    uint channel,
+    const dma_channel_config* config,
+    volatile void* write_addr,
+    const volatile void* read_addr,
+    uint transfer_count,
+    bool trigger)
+{
+    smbus_sim_dma_channel_t* dma = &smbus_sim_dma_channels[channel];
+
+    assert(channel < NUM_DMA_CHANNELS && dma->is_claimed && !dma->is_busy);
+
+    dma->config = *config;
+    dma->write_addr = (volatile uint8_t*)write_addr;
+    dma->read_addr = (const volatile uint8_t*)read_addr;
+    smbus_sim_dma_hw[channel].transfer_count = transfer_count;
+
+    if(trigger && transfer_count > 0)
+    {
+        dma->is_busy = true;
+
+        if(config->dreq >= DREQ_I2C0_TX && config->dreq <= DREQ_I2C1_RX)
+        {
+            smbus_sim_update((config->dreq - DREQ_I2C0_TX) / 2);
+        }
+    }
+}
+
+void dma_channel_abort(uint channel)
+{
+    assert(channel < NUM_DMA_CHANNELS);
+
+    smbus_sim_dma_channels[channel].is_busy = false;
+}
+
+bool dma_channel_is_busy(uint channel)
+{
+    assert(channel < NUM_DMA_CHANNELS);
+
+    return smbus_sim_dma_channels[channel].is_busy;
+}
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler)
+{
+    assert(num < NUM_IRQS);
+    assert(smbus_sim_irq_handlers[num] == NULL || smbus_sim_irq_handlers[num] == handler);
+
+    smbus_sim_irq_handlers[num] = handler;
+}
+
+void irq_remove_handler(uint num, irq_handler_t handler)
+{
+    assert(num < NUM_IRQS);
+
+    if(smbus_sim_irq_handlers[num] == handler)
+    {
+        smbus_sim_irq_handlers[num] = NULL;
+    }
+}
+
+void irq_set_enabled(uint num, bool enabled)
+{
+    assert(num < NUM_IRQS);
+
+    smbus_sim_irq_enabled[num] = enabled;
+}
+
+bool irq_is_enabled(uint num)
+{
+    assert(num < NUM_IRQS);
+
+    return smbus_sim_irq_enabled[num];
+}
+
+void gpio_init(uint gpio)
+{
+    assert(gpio < NUM_BANK0_GPIOS);
+
+    smbus_sim_gpio_function[gpio] = GPIO_FUNC_SIO;
+}
+
+void gpio_deinit(uint gpio)
+{
+    assert(gpio < NUM_BANK0_GPIOS);
+
+    smbus_sim_gpio_function[gpio] = GPIO_FUNC_NULL;
+}
+
+void gpio_set_function(uint gpio, enum gpio_function fn)
+{
+    assert(gpio < NUM_BANK0_GPIOS);
+
+    smbus_sim_gpio_function[gpio] = fn;
+}
+
+void gpio_pull_up(uint gpio)
+{
+    assert(gpio < NUM_BANK0_GPIOS);
+
+    smbus_sim_gpio_level[gpio] = true;
+}
+
+bool gpio_get(uint gpio)
+{
+    assert(gpio < NUM_BANK0_GPIOS);
+
+    // Open drain: an output driven low pulls the line down
+    if(smbus_sim_gpio_is_output[gpio])
+    {
+        return smbus_sim_gpio_out[gpio];
+    }
+
+    return smbus_sim_gpio_level[gpio];
+}
+
+void gpio_put(uint gpio, bool value)
+{
+    assert(gpio < NUM_BANK0_GPIOS);
+
+    smbus_sim_gpio_out[gpio] = value;
+}
+
+void gpio_set_dir(uint gpio, bool out)
+{
+    assert(gpio < NUM_BANK0_GPIOS);
+
+    smbus_sim_gpio_is_output[gpio] = out;
+}
+
+uint32_t clock_get_hz(enum clock_index clk_index)
+{
+    return (clk_index == clk_sys) ? 125000000u : 48000000u;
+}
+
+uint64_t time_us_64(void)
+{
+    return smbus_sim_now_ns() / 1000u;
+}
+
+uint32_t time_us_32(void)
+{
+    return (uint32_t)time_us_64();
+}
+
+void busy_wait_us_32(uint32_t delay_us)
+{
+    busy_wait_us(delay_us);
+}
+
+void busy_wait_us(uint64_t delay_us)
+{
+    uint64_t until_ns = smbus_sim_now_ns() + delay_us * 1000u;
+
+    while (smbus_sim_now_ns() < until_ns);
+}
@@ -0,0 +1,82 @@
+#ifndef SMBUS_SIM_H
+#define SMBUS_SIM_H
+
+#include <pico.h>
+#include <hardware/i2c.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SMBUS_SIM_FIFO_DEPTH 16
+
+// The simulated SMBus host acknowledges Host Notify messages only
+#define SMBUS_SIM_HOST_ADDRESS 0x08
+
+typedef enum smbus_sim_status_t
+{
+    SMBUS_SIM_OK = 0,
+    SMBUS_SIM_NACK = -1,
+    SMBUS_SIM_PEC_ERROR = -2,
+    SMBUS_SIM_STALL = -3,
+}
+smbus_sim_status_t;
+
+typedef struct smbus_sim_stats_t
+{
+    uint32_t isr_entries;
+    uint64_t isr_ns;
+    uint64_t isr_ns_max;
+    uint64_t isr_instructions;
+    uint32_t stalls;
+    uint32_t stuck;
+}
+smbus_sim_stats_t;
+
+
+// Simulator control
+
+void smbus_sim_reset(void);
+void smbus_sim_service(uint bus_index);
+
+void smbus_sim_get_stats(uint bus_index, smbus_sim_stats_t* stats);
+void smbus_sim_reset_stats(uint bus_index);
+bool smbus_sim_has_instruction_counter(void);
+
+// The next count transfers in which the controller drives data lose
+// arbitration: Host Notify attempts in master mode and reads of the slave
+void smbus_sim_set_arbitration_loss(uint bus_index, uint count);
+
+// While delayed, the ISR is only entered where SCL is held for it (a full
+// RX FIFO, RD_REQ with an empty TX FIFO), so interrupt causes pile up as
+// behind a masked or late IRQ. Clearing the delay serves what is pending.
+void smbus_sim_set_irq_delay(uint bus_index, bool is_delayed);
+
+// Returns the last complete Host Notify message, once
+bool smbus_sim_get_host_notify(uint bus_index, uint8_t* address, uint16_t* status);
+
+
+// Bus primitives, driven as the SMBus master
+
+bool smbus_sim_start(uint bus_index, uint8_t address, bool read);
+bool smbus_sim_write_byte(uint bus_index, uint8_t value);
+uint8_t smbus_sim_read_byte(uint bus_index, bool ack);
+void smbus_sim_stop(uint bus_index);
+
+
+// SMBus protocol transactions, driven as the SMBus master
+
+int smbus_sim_quick(uint bus_index, uint8_t address, bool read);
+int smbus_sim_send_byte(uint bus_index, uint8_t address, uint8_t value, bool pec);
+int smbus_sim_receive_byte(uint bus_index, uint8_t address, uint8_t* value, bool pec);
+int smbus_sim_write(uint bus_index, uint8_t address, uint8_t command, const uint8_t data[], size_t data_len, bool pec);
+int smbus_sim_read(uint bus_index, uint8_t address, uint8_t command, uint8_t data[], size_t data_len, bool pec);
+int smbus_sim_block_read(uint bus_index, uint8_t address, uint8_t command, uint8_t data[], size_t* data_len, bool pec);
+int smbus_sim_proc_call(uint bus_index, uint8_t address, uint8_t command, uint16_t request, uint16_t* response, bool pec);
+int smbus_sim_block_proc_call(uint bus_index, uint8_t address, uint8_t command, const uint8_t request[], uint8_t response[], size_t* response_len, bool pec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SMBUS_SIM_H
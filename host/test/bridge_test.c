@@ -0,0 +1,301 @@
+#include "bridge.h"
+#include "bridge_posix.h"
+#include <smbus/smbus_slave.h>
+#include <smbus_sim.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define TEST_BUS            0
+#define TEST_I2C            i2c0
+#define TEST_ADDRESS        0x17
+#define TEST_BAUDRATE       100000
+#define TEST_SDA_PIN        12
+#define TEST_SCL_PIN        13
+
+#define TEST_CMD_BYTE       0xC1
+#define TEST_CMD_WORD       0xC2
+#define TEST_CMD_BLOCK      0xCB
+
+#define CHECK(cond)                                                         \
+    do                                                                      \
+    {                                                                       \
+        if(!(cond))                                                         \
+        {                                                                   \
+            printf("  %s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            test_failures += 1;                                             \
+        }                                                                   \
+    }                                                                       \
+    while (0)
+
+static uint test_failures;
+static uint test_writes;
+
+static uint8_t test_reg_byte = 0x01;
+static uint16_t test_reg_word = 0x0123;
+static uint8_t test_reg_block[1 + 8] = { 3, 0x10, 0x20, 0x30 };
+
+
+static void test_on_write(uint8_t command, const smbus_data_t* smbus_data)
+{
+    test_writes += 1;
+}
+
+static const smbus_reg_t test_registers[256] = {
+    [TEST_CMD_BYTE]  = SMBUS_REG_FIXED_ENTRY(test_reg_byte, SMBUS_REG_READ, NULL),
+    [TEST_CMD_WORD]  = SMBUS_REG_FIXED_ENTRY(test_reg_word, SMBUS_REG_RW, test_on_write),
+    [TEST_CMD_BLOCK] = SMBUS_REG_BLOCK_ENTRY(test_reg_block, SMBUS_REG_RW, test_on_write),
+};
+
+// The request used by every transport: read, write and read back the
+// word, two refused operations and the stats
+static const uint8_t test_request[] = {
+    0x53, 0x42, 0x34, 0x12,
+    BRIDGE_OP_READ, TEST_CMD_WORD,
+    BRIDGE_OP_WRITE, TEST_CMD_WORD, 2, 0, 0x21, 0x43,
+    BRIDGE_OP_READ, TEST_CMD_WORD,
+    BRIDGE_OP_WRITE, TEST_CMD_BYTE, 1, 0, 0x99,
+    BRIDGE_OP_READ, 0x10,
+    BRIDGE_OP_STATS,
+};
+
+static const uint8_t test_response[] = {
+    0x53, 0x42, 0x34, 0x12,
+    BRIDGE_OP_READ, TEST_CMD_WORD, BRIDGE_OK, 2, 0, 0x23, 0x01,
+    BRIDGE_OP_WRITE, TEST_CMD_WORD, BRIDGE_OK,
+    BRIDGE_OP_READ, TEST_CMD_WORD, BRIDGE_OK, 2, 0, 0x21, 0x43,
+    BRIDGE_OP_WRITE, TEST_CMD_BYTE, BRIDGE_REFUSED,
+    BRIDGE_OP_READ, 0x10, BRIDGE_REFUSED,
+    BRIDGE_OP_STATS, BRIDGE_OK, sizeof(smbus_stats_t), 0,
+};
+
+
+static void test_setup(void)
+{
+    smbus_sim_reset();
+
+    smbus_slave_init(TEST_I2C, TEST_ADDRESS, TEST_BAUDRATE, TEST_SDA_PIN, TEST_SCL_PIN);
+    smbus_set_regmap(TEST_I2C, test_registers);
+
+    test_reg_word = 0x0123;
+    test_writes = 0;
+}
+
+static void test_teardown(void)
+{
+    smbus_slave_deinit(TEST_I2C);
+}
+
+// Stats follow the fixed part of test_response; checks a bus read of
+// the word was counted
+static void test_check_response(const uint8_t* response, size_t response_len)
+{
+    const uint8_t* stats = &response[sizeof(test_response)];
+
+    CHECK(response_len == sizeof(test_response) + sizeof(smbus_stats_t));
+    CHECK(memcmp(response, test_response, sizeof(test_response)) == 0);
+
+    // transactions[SMBUS_SLAVE_READ_DATA]
+    const uint8_t* reads = &stats[SMBUS_SLAVE_READ_DATA * sizeof(uint32_t)];
+    CHECK(reads[0] == 1 && reads[1] == 0 && reads[2] == 0 && reads[3] == 0);
+
+    CHECK(test_reg_word == 0x4321);
+    CHECK(test_writes == 1);
+}
+
+static void test_process(void)
+{
+    uint8_t response[BRIDGE_MAX_MESSAGE_LEN];
+    uint8_t word[2];
+    size_t response_len;
+
+    printf("process\n");
+
+    test_setup();
+
+    CHECK(smbus_sim_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), false) == SMBUS_SIM_OK);
+
+    response_len = bridge_process(TEST_I2C, test_request, sizeof(test_request), response, sizeof(response));
+    test_check_response(response, response_len);
+
+    // The bus sees the remote write
+    CHECK(smbus_sim_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), false) == SMBUS_SIM_OK);
+    CHECK(word[0] == 0x21 && word[1] == 0x43);
+
+    // And the remote side a bus write, blocks with their count byte
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_BLOCK, (const uint8_t*)"\x02\xAA\xBB", 3, false) == SMBUS_SIM_OK);
+
+    const uint8_t block_request[] = { 0x53, 0x42, 0, 0, BRIDGE_OP_READ, TEST_CMD_BLOCK };
+    const uint8_t block_response[] = { 0x53, 0x42, 0, 0, BRIDGE_OP_READ, TEST_CMD_BLOCK, BRIDGE_OK, 3, 0, 0x02, 0xAA, 0xBB };
+
+    response_len = bridge_process(TEST_I2C, block_request, sizeof(block_request), response, sizeof(response));
+    CHECK(response_len == sizeof(block_response) && memcmp(response, block_response, sizeof(block_response)) == 0);
+
+    test_reg_block[0] = 3;
+    test_reg_block[1] = 0x10;
+    test_reg_block[2] = 0x20;
+
+    test_teardown();
+}
+
+static void test_malformed(void)
+{
+    uint8_t response[BRIDGE_MAX_MESSAGE_LEN];
+    size_t response_len;
+
+    printf("malformed\n");
+
+    test_setup();
+
+    // No answer without a valid header
+    CHECK(bridge_process(TEST_I2C, (const uint8_t*)"\x53\x42\x00", 3, response, sizeof(response)) == 0);
+    CHECK(bridge_process(TEST_I2C, (const uint8_t*)"\x42\x53\x00\x00", 4, response, sizeof(response)) == 0);
+
+    // Processing stops at the first malformed operation
+    const uint8_t truncated[] = { 0x53, 0x42, 1, 0, BRIDGE_OP_READ, TEST_CMD_BYTE, BRIDGE_OP_WRITE, TEST_CMD_WORD, 2, 0, 0x00 };
+    const uint8_t truncated_response[] = { 0x53, 0x42, 1, 0, BRIDGE_OP_READ, TEST_CMD_BYTE, BRIDGE_OK, 1, 0, 0x01, BRIDGE_OP_WRITE, BRIDGE_MALFORMED };
+
+    response_len = bridge_process(TEST_I2C, truncated, sizeof(truncated), response, sizeof(response));
+    CHECK(response_len == sizeof(truncated_response) && memcmp(response, truncated_response, sizeof(truncated_response)) == 0);
+    CHECK(test_reg_word == 0x0123);
+
+    const uint8_t unknown[] = { 0x53, 0x42, 2, 0, 0x7F, BRIDGE_OP_READ, TEST_CMD_BYTE };
+    const uint8_t unknown_response[] = { 0x53, 0x42, 2, 0, 0x7F, BRIDGE_MALFORMED };
+
+    response_len = bridge_process(TEST_I2C, unknown, sizeof(unknown), response, sizeof(response));
+    CHECK(response_len == sizeof(unknown_response) && memcmp(response, unknown_response, sizeof(unknown_response)) == 0);
+
+    // Results that do not fit are marked, later smaller ones still go out
+    const uint8_t batch[] = { 0x53, 0x42, 3, 0, BRIDGE_OP_STATS, BRIDGE_OP_READ, TEST_CMD_BYTE };
+    const uint8_t batch_response[] = { 0x53, 0x42, 3, 0, BRIDGE_OP_STATS, BRIDGE_NO_ROOM, BRIDGE_OP_READ, TEST_CMD_BYTE, BRIDGE_OK, 1, 0, 0x01 };
+
+    response_len = bridge_process(TEST_I2C, batch, sizeof(batch), response, sizeof(batch_response));
+    CHECK(response_len == sizeof(batch_response) && memcmp(response, batch_response, sizeof(batch_response)) == 0);
+
+    test_teardown();
+}
+
+// Receives on fd while the bridge is polled, until data_len bytes arrived
+// or the peer closed
+static size_t test_receive(int fd, uint8_t* data, size_t data_len)
+{
+    size_t received_len = 0;
+
+    for (uint i = 0; i < 100 && received_len < data_len; ++i)
+    {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+
+        bridge_posix_poll(10);
+
+        if(poll(&pfd, 1, 0) > 0)
+        {
+            ssize_t len = recv(fd, &data[received_len], data_len - received_len, 0);
+
+            if(len <= 0)
+            {
+                break;
+            }
+
+            received_len += len;
+        }
+    }
+
+    return received_len;
+}
+
+static void test_udp(uint16_t port)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    uint8_t response[BRIDGE_MAX_MESSAGE_LEN];
+    uint8_t word[2];
+
+    printf("udp\n");
+
+    test_setup();
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    CHECK(fd >= 0);
+
+    CHECK(smbus_sim_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), false) == SMBUS_SIM_OK);
+
+    CHECK(sendto(fd, test_request, sizeof(test_request), 0, (struct sockaddr*)&addr, sizeof(addr)) == sizeof(test_request));
+    size_t response_len = test_receive(fd, response, sizeof(test_response) + sizeof(smbus_stats_t));
+    test_check_response(response, response_len);
+
+    close(fd);
+    test_teardown();
+}
+
+static void test_tcp(uint16_t port)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    uint8_t stream[2 * (BRIDGE_FRAME_LEN_SIZE + sizeof(test_request))];
+    uint8_t response[BRIDGE_MAX_MESSAGE_LEN];
+    size_t frame_len = BRIDGE_FRAME_LEN_SIZE + sizeof(test_request);
+    size_t response_frame_len = BRIDGE_FRAME_LEN_SIZE + sizeof(test_response) + sizeof(smbus_stats_t);
+    uint8_t word[2];
+
+    printf("tcp\n");
+
+    test_setup();
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(fd >= 0);
+    CHECK(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+
+    CHECK(smbus_sim_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), false) == SMBUS_SIM_OK);
+
+    // Two requests back to back, the second split across sends
+    for (uint i = 0; i < 2; ++i)
+    {
+        stream[i * frame_len + 0] = sizeof(test_request);
+        stream[i * frame_len + 1] = 0;
+        memcpy(&stream[i * frame_len + BRIDGE_FRAME_LEN_SIZE], test_request, sizeof(test_request));
+    }
+
+    CHECK(send(fd, stream, frame_len + 5, 0) == (ssize_t)(frame_len + 5));
+    CHECK(test_receive(fd, response, response_frame_len) == response_frame_len);
+    CHECK(response[0] == response_frame_len - BRIDGE_FRAME_LEN_SIZE && response[1] == 0);
+    test_check_response(&response[BRIDGE_FRAME_LEN_SIZE], response_frame_len - BRIDGE_FRAME_LEN_SIZE);
+
+    CHECK(send(fd, &stream[frame_len + 5], frame_len - 5, 0) == (ssize_t)(frame_len - 5));
+    CHECK(test_receive(fd, response, response_frame_len) == response_frame_len);
+
+    // Its first read sees what the first request wrote
+    const uint8_t* second = &response[BRIDGE_FRAME_LEN_SIZE];
+    CHECK(second[9] == 0x21 && second[10] == 0x43);
+    CHECK(test_writes == 2);
+
+    // An over-long frame drops the connection
+    CHECK(send(fd, "\xFF\xFF", 2, 0) == 2);
+    CHECK(test_receive(fd, response, 1) == 0);
+
+    close(fd);
+    test_teardown();
+}
+
+
+int main()
+{
+    test_process();
+    test_malformed();
+
+    uint16_t port = bridge_posix_init(TEST_I2C, 0);
+    CHECK(port != 0);
+
+    if(port != 0)
+    {
+        test_udp(port);
+        test_tcp(port);
+    }
+
+    bridge_posix_deinit();
+
+    printf("%u failure(s)\n", test_failures);
+
+    return test_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,182 @@
+#include "handlers.h"
+#include "commands.h"
+#include "event_log.h"
+#include "event_log_decode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(cond)                                                         \
+    do                                                                      \
+    {                                                                       \
+        if(!(cond))                                                         \
+        {                                                                   \
+            printf("  %s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            test_failures += 1;                                             \
+        }                                                                   \
+    }                                                                       \
+    while (0)
+
+static uint test_failures;
+
+
+// Drains the log through the decoder in chunks of chunk_len so records
+// split across reads are exercised too
+static char* test_decode(size_t chunk_len)
+{
+    uint8_t data[EVENT_LOG_LEN + EVENT_LOG_HEADER_LEN + EVENT_LOG_MAX_PAYLOAD];
+    size_t data_len = 0;
+    char* text = NULL;
+    size_t text_len = 0;
+    FILE* out = open_memstream(&text, &text_len);
+
+    while (true)
+    {
+        size_t read_len = event_log_read(&data[data_len], chunk_len);
+
+        if(read_len == 0)
+        {
+            break;
+        }
+
+        data_len += read_len;
+
+        size_t decoded_len = event_log_decode(data, data_len, out);
+        memmove(data, &data[decoded_len], data_len - decoded_len);
+        data_len -= decoded_len;
+    }
+
+    CHECK(data_len == 0);
+    fclose(out);
+
+    return text;
+}
+
+static void test_handlers()
+{
+    smbus_data_t smbus_data;
+
+    printf("handlers\n");
+
+    quick_handler(true);
+    quick_handler(false);
+    write_reg_handler(0x42);
+
+    smbus_data.byte = 0x01;
+    write_data_handler(SMBUS_CMD_BYTE_DATA, &smbus_data);
+    smbus_data.word = 0x0123;
+    write_data_handler(SMBUS_CMD_WORD_DATA, &smbus_data);
+    smbus_data.dword = 0x01234567;
+    write_data_handler(SMBUS_CMD_DWORD_DATA, &smbus_data);
+    smbus_data.qword = 0x0123456789ABCDEF;
+    write_data_handler(SMBUS_CMD_QWORD_DATA, &smbus_data);
+
+    smbus_data.block[0] = 3;
+    smbus_data.block[1] = 0xA0;
+    smbus_data.block[2] = 0xA1;
+    smbus_data.block[3] = 0xA5;
+    write_data_handler(SMBUS_CMD_BLOCK_DATA, &smbus_data);
+    write_data_handler(0x55, &smbus_data);
+
+    CHECK(read_reg_handler() == SMBUS_CMD_REG);
+    CHECK(read_data_handler(0x55, &smbus_data) == 0);
+    CHECK(proc_call_handler(SMBUS_CMD_PROC_CALL, 0x1234) == 0x8246);
+
+    for (size_t chunk_len = 1; chunk_len <= 64; chunk_len *= 4)
+    {
+        if(chunk_len > 1)
+        {
+            quick_handler(true);
+            write_reg_handler(0x42);
+        }
+        else
+        {
+            printf("  decode byte by byte\n");
+        }
+
+        char* text = test_decode(chunk_len);
+
+        if(chunk_len == 1)
+        {
+            CHECK(strcmp(text,
+                "Q-ON\n"
+                "Q-OFF\n"
+                "W-42\n"
+                "W-C1 01\n"
+                "W-C2 0123\n"
+                "W-C3 01234567\n"
+                "W-C4 0123456789ABCDEF\n"
+                "W-CB 03 A0 A1 A5\n"
+                "W-55 \n"
+                "R-C0\n"
+                "R-55 ?\n"
+                "C-CC W 1234 R 8246\n"
+            ) == 0);
+        }
+        else
+        {
+            CHECK(strcmp(text, "Q-ON\nW-42\n") == 0);
+        }
+
+        free(text);
+    }
+}
+
+static void test_plain_text()
+{
+    printf("plain text\n");
+
+    const uint8_t data[] = { 'h', 'i', '\n', EVENT_LOG_SYNC, EVENT_LOG_WRITE_REG, 1, 0xC0, 'o', 'k', EVENT_LOG_SYNC, EVENT_LOG_QUICK };
+    char* text = NULL;
+    size_t text_len = 0;
+    FILE* out = open_memstream(&text, &text_len);
+
+    // The record cut off at the end waits for more data
+    CHECK(event_log_decode(data, sizeof(data), out) == sizeof(data) - 2);
+    fclose(out);
+
+    CHECK(strcmp(text, "hi\nW-C0\nok") == 0);
+    free(text);
+}
+
+static void test_overflow()
+{
+    uint records = 0;
+
+    printf("overflow\n");
+
+    // Each write reg record takes 4 bytes
+    for (uint i = 0; i < EVENT_LOG_LEN / 4 + 10; ++i)
+    {
+        write_reg_handler(0x42);
+    }
+
+    while (records < EVENT_LOG_LEN / 4)
+    {
+        uint8_t data[4];
+
+        CHECK(event_log_read(data, sizeof(data)) == sizeof(data));
+        records += 1;
+    }
+
+    CHECK(event_log_read(NULL, 0) == 0);
+
+    write_reg_handler(0x43);
+    char* text = test_decode(EVENT_LOG_LEN);
+    CHECK(strcmp(text, "LOST 10\nW-43\n") == 0);
+    free(text);
+}
+
+
+int main()
+{
+    event_log_init();
+
+    test_handlers();
+    test_plain_text();
+    test_overflow();
+
+    printf("%u failure(s)\n", test_failures);
+
+    return test_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,189 @@
+#include "exporter.h"
+#include "export_receiver.h"
+#include <smbus/smbus_slave.h>
+#include <smbus_sim.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define TEST_BUS            0
+#define TEST_I2C            i2c0
+#define TEST_ADDRESS        0x17
+#define TEST_BAUDRATE       100000
+#define TEST_SDA_PIN        12
+#define TEST_SCL_PIN        13
+
+#define CHECK(cond)                                                         \
+    do                                                                      \
+    {                                                                       \
+        if(!(cond))                                                         \
+        {                                                                   \
+            printf("  %s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            test_failures += 1;                                             \
+        }                                                                   \
+    }                                                                       \
+    while (0)
+
+static uint test_failures;
+
+static exporter_t test_exporter;
+static export_receiver_t test_receiver;
+static uint8_t test_datagram[EXPORTER_MAX_DATAGRAM_LEN];
+
+// The collector end of the loopback path
+static int test_rx_fd = -1;
+static int test_tx_fd = -1;
+static struct sockaddr_in test_collector;
+
+
+static void test_write_reg_handler(uint8_t reg)
+{}
+
+static void test_setup(void)
+{
+    smbus_sim_reset();
+
+    smbus_slave_init(TEST_I2C, TEST_ADDRESS, TEST_BAUDRATE, TEST_SDA_PIN, TEST_SCL_PIN);
+    smbus_set_write_reg_handler(TEST_I2C, test_write_reg_handler);
+}
+
+static void test_teardown(void)
+{
+    smbus_slave_deinit(TEST_I2C);
+}
+
+static void test_transactions(uint count)
+{
+    for (uint i = 0; i < count; ++i)
+    {
+        CHECK(smbus_sim_send_byte(TEST_BUS, TEST_ADDRESS, (uint8_t)i, false) == SMBUS_SIM_OK);
+    }
+}
+
+// Seals the datagram packed so far, sends it over loopback and parses
+// what the collector received
+static int test_send(exporter_header_t* header, smbus_trace_record_t records[])
+{
+    uint8_t datagram[EXPORTER_MAX_DATAGRAM_LEN];
+    size_t datagram_len = exporter_seal(&test_exporter, test_datagram);
+
+    CHECK(sendto(test_tx_fd, test_datagram, datagram_len, 0, (struct sockaddr*)&test_collector, sizeof(test_collector)) == (ssize_t)datagram_len);
+    CHECK(recv(test_rx_fd, datagram, sizeof(datagram), 0) == (ssize_t)datagram_len);
+
+    return export_receiver_parse(&test_receiver, datagram, datagram_len, header, records);
+}
+
+static void test_batch(void)
+{
+    exporter_header_t header;
+    smbus_trace_record_t records[EXPORTER_MAX_RECORDS];
+
+    printf("batch\n");
+
+    test_setup();
+    test_transactions(5);
+
+    CHECK(exporter_pack(&test_exporter, test_datagram, sizeof(test_datagram)) == 5);
+    CHECK(exporter_pack(&test_exporter, test_datagram, sizeof(test_datagram)) == 0);
+    CHECK(!exporter_is_full(&test_exporter, sizeof(test_datagram)));
+
+    CHECK(test_send(&header, records) == 5);
+    CHECK(header.sequence == 0 && header.lost == 0);
+    CHECK(records[0].address == TEST_ADDRESS && records[0].command == 0 && records[0].flags == SMBUS_TRACE_WRITE);
+    CHECK(records[4].command == 4 && records[4].timestamp_us >= records[0].timestamp_us);
+
+    // Records do not outgrow the datagram
+    test_transactions(5);
+
+    size_t small_len = EXPORTER_HEADER_LEN + 3 * EXPORTER_RECORD_LEN;
+    CHECK(exporter_pack(&test_exporter, test_datagram, small_len) == 3);
+    CHECK(exporter_is_full(&test_exporter, small_len));
+    CHECK(exporter_pack(&test_exporter, test_datagram, small_len) == 0);
+    CHECK(test_send(&header, records) == 3);
+    CHECK(records[2].command == 2);
+
+    CHECK(exporter_pack(&test_exporter, test_datagram, small_len) == 2);
+    CHECK(test_send(&header, records) == 2);
+    CHECK(header.sequence == 2 && records[1].command == 4);
+
+    CHECK(test_receiver.datagrams == 3 && test_receiver.records == 10 && test_receiver.missed_datagrams == 0);
+
+    test_teardown();
+}
+
+static void test_loss(void)
+{
+    exporter_header_t header;
+    smbus_trace_record_t records[EXPORTER_MAX_RECORDS];
+
+    printf("loss\n");
+
+    test_setup();
+
+    // The ring keeps SMBUS_TRACE_LEN - 1 records for a reader that is behind
+    test_transactions(SMBUS_TRACE_LEN + 8);
+
+    CHECK(exporter_pack(&test_exporter, test_datagram, sizeof(test_datagram)) == SMBUS_TRACE_LEN - 1);
+    CHECK(test_send(&header, records) == SMBUS_TRACE_LEN - 1);
+    CHECK(header.lost == 9 && test_receiver.lost == 9);
+    CHECK(records[0].command == 9);
+
+    // A datagram that could not be sent shows as a sequence gap and as lost records
+    test_transactions(4);
+    CHECK(exporter_pack(&test_exporter, test_datagram, sizeof(test_datagram)) == 4);
+    exporter_seal(&test_exporter, test_datagram);
+    exporter_drop(&test_exporter, 4);
+
+    test_transactions(1);
+    CHECK(exporter_pack(&test_exporter, test_datagram, sizeof(test_datagram)) == 1);
+    CHECK(test_send(&header, records) == 1);
+    CHECK(header.sequence == 5 && header.lost == 13);
+    CHECK(test_receiver.missed_datagrams == 1 && test_receiver.lost == 13);
+
+    // Late datagrams are not new loss
+    exporter_header_t late = { EXPORTER_MAGIC, EXPORTER_VERSION, 0, 4, 9 };
+    exporter_put_header(test_datagram, &late);
+    CHECK(export_receiver_parse(&test_receiver, test_datagram, EXPORTER_HEADER_LEN, &header, records) == 0);
+    CHECK(test_receiver.missed_datagrams == 0 && test_receiver.reordered == 1 && test_receiver.lost == 13);
+
+    // Nor is anything that is not an export
+    CHECK(export_receiver_parse(&test_receiver, test_datagram, EXPORTER_HEADER_LEN - 1, &header, records) < 0);
+    CHECK(export_receiver_parse(&test_receiver, test_datagram, EXPORTER_HEADER_LEN + 1, &header, records) < 0);
+    test_datagram[0] ^= 0xFF;
+    CHECK(export_receiver_parse(&test_receiver, test_datagram, EXPORTER_HEADER_LEN, &header, records) < 0);
+
+    test_teardown();
+}
+
+
+int main()
+{
+    socklen_t addr_len = sizeof(test_collector);
+
+    memset(&test_collector, 0, sizeof(test_collector));
+    test_collector.sin_family = AF_INET;
+    test_collector.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    test_rx_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    test_tx_fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    if(bind(test_rx_fd, (struct sockaddr*)&test_collector, sizeof(test_collector)) != 0 ||
+        getsockname(test_rx_fd, (struct sockaddr*)&test_collector, &addr_len) != 0)
+    {
+        perror("bind");
+        return 1;
+    }
+
+    test_batch();
+    test_loss();
+
+    close(test_tx_fd);
+    close(test_rx_fd);
+
+    printf("%u failure(s)\n", test_failures);
+
+    return test_failures == 0 ? 0 : 1;
+}
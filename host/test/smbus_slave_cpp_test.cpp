@@ -0,0 +1,205 @@
+#include <smbus/smbus_slave.hpp>
+#include <smbus_sim.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_ADDRESS        0x17
+#define TEST_BAUDRATE       100000
+
+// i2c0 on GPIO 12/13, i2c1 on GPIO 2/3
+#define TEST_SDA_PIN_0      12
+#define TEST_SCL_PIN_0      13
+#define TEST_SDA_PIN_1      2
+#define TEST_SCL_PIN_1      3
+
+#define TEST_CMD_WORD       0xC2
+#define TEST_CMD_PROC_CALL  0xCC
+#define TEST_REG            0xC0
+
+#define CHECK(cond)                                                         \
+    do                                                                      \
+    {                                                                       \
+        if(!(cond))                                                         \
+        {                                                                   \
+            printf("  %s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            test_failures += 1;                                             \
+        }                                                                   \
+    }                                                                       \
+    while (0)
+
+static uint test_failures;
+
+
+// Implements every handler, state lives in the object
+struct TestDevice
+{
+    explicit TestDevice(uint16_t word)
+        : word(word)
+    {}
+
+    void on_quick(bool is_on)
+    {
+        quick_calls += 1;
+        is_quick_on = is_on;
+    }
+
+    void on_write_reg(uint8_t reg)
+    {
+        last_reg = reg;
+    }
+
+    void on_write_data(uint8_t command, const smbus_data_t& data)
+    {
+        if(command == TEST_CMD_WORD)
+        {
+            word = data.word;
+        }
+    }
+
+    uint8_t on_read_reg()
+    {
+        return TEST_REG;
+    }
+
+    size_t on_read_data(uint8_t command, smbus_data_t& data)
+    {
+        if(command != TEST_CMD_WORD)
+        {
+            return 0;
+        }
+
+        data.word = word;
+
+        return sizeof(uint16_t);
+    }
+
+    uint16_t on_proc_call(uint8_t command, uint16_t request)
+    {
+        return request ^ word;
+    }
+
+    bool on_block_proc_call(uint8_t command, const smbus_data_t& request, smbus_data_t& response)
+    {
+        return false;
+    }
+
+    uint16_t word;
+    uint quick_calls = 0;
+    bool is_quick_on = false;
+    uint8_t last_reg = 0;
+};
+
+// Only answers reads, nothing else is registered
+struct ReadOnlyDevice
+{
+    size_t on_read_data(uint8_t command, smbus_data_t& data)
+    {
+        data.byte = command;
+
+        return sizeof(uint8_t);
+    }
+};
+
+
+static void test_device(bool pec)
+{
+    smbus::SmbusSlave<0, TestDevice> slave(0x0123);
+    uint8_t word[2];
+    uint16_t response = 0;
+    uint8_t value = 0;
+
+    smbus_sim_reset();
+
+    slave.init(TEST_ADDRESS, TEST_BAUDRATE, TEST_SDA_PIN_0, TEST_SCL_PIN_0);
+    slave.set_pec(pec);
+    CHECK(slave.i2c() == i2c0);
+
+    CHECK(smbus_sim_quick(0, TEST_ADDRESS, true) == SMBUS_SIM_OK);
+    CHECK(slave.device().quick_calls == 1 && slave.device().is_quick_on);
+
+    CHECK(smbus_sim_send_byte(0, TEST_ADDRESS, 0x42, pec) == SMBUS_SIM_OK);
+    CHECK(slave.device().last_reg == 0x42);
+
+    CHECK(smbus_sim_receive_byte(0, TEST_ADDRESS, &value, pec) == SMBUS_SIM_OK);
+    CHECK(value == TEST_REG);
+
+    CHECK(smbus_sim_read(0, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), pec) == SMBUS_SIM_OK);
+    CHECK(word[0] == 0x23 && word[1] == 0x01);
+
+    word[0] = 0x34;
+    word[1] = 0x12;
+    CHECK(smbus_sim_write(0, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), pec) == SMBUS_SIM_OK);
+    CHECK(slave.device().word == 0x1234);
+
+    CHECK(smbus_sim_proc_call(0, TEST_ADDRESS, TEST_CMD_PROC_CALL, 0xFFFF, &response, pec) == SMBUS_SIM_OK);
+    CHECK(response == (0xFFFF ^ 0x1234));
+
+    slave.deinit();
+
+    // Bound again once the bus is free
+    slave.init(TEST_ADDRESS, TEST_BAUDRATE, TEST_SDA_PIN_0, TEST_SCL_PIN_0);
+    CHECK(smbus_sim_quick(0, TEST_ADDRESS, false) == SMBUS_SIM_OK);
+    CHECK(slave.device().quick_calls == 2 && !slave.device().is_quick_on);
+}
+
+static void test_partial_device(void)
+{
+    smbus::SmbusSlave<1, ReadOnlyDevice> slave;
+    smbus_stats_t stats;
+    uint8_t byte[1];
+    uint8_t word[] = { 0x34, 0x12 };
+
+    smbus_sim_reset();
+
+    slave.init(TEST_ADDRESS, TEST_BAUDRATE, TEST_SDA_PIN_1, TEST_SCL_PIN_1);
+    CHECK(slave.i2c() == i2c1);
+
+    CHECK(smbus_sim_read(1, TEST_ADDRESS, 0x5A, byte, sizeof(byte), false) == SMBUS_SIM_OK);
+    CHECK(byte[0] == 0x5A);
+
+    // No write handler was registered, the write is acknowledged and dropped
+    CHECK(smbus_sim_write(1, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), false) == SMBUS_SIM_OK);
+    CHECK(smbus_sim_quick(1, TEST_ADDRESS, false) == SMBUS_SIM_OK);
+
+    slave.get_stats(stats);
+    CHECK(stats.unknown_commands == 1);
+    CHECK(stats.transactions[SMBUS_SLAVE_READ_DATA] == 1);
+    CHECK(stats.transactions[SMBUS_SLAVE_QUICK] == 1);
+
+    // Deinitialised when it goes out of scope
+}
+
+static void test_both_buses(void)
+{
+    smbus::SmbusSlave<0, TestDevice> slave0(0x1111);
+    smbus::SmbusSlave<1, TestDevice> slave1(0x2222);
+    uint8_t word[2];
+
+    smbus_sim_reset();
+
+    slave0.init(TEST_ADDRESS, TEST_BAUDRATE, TEST_SDA_PIN_0, TEST_SCL_PIN_0);
+    slave1.init(TEST_ADDRESS, TEST_BAUDRATE, TEST_SDA_PIN_1, TEST_SCL_PIN_1);
+
+    CHECK(smbus_sim_read(0, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), false) == SMBUS_SIM_OK);
+    CHECK(word[0] == 0x11 && word[1] == 0x11);
+
+    CHECK(smbus_sim_read(1, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), false) == SMBUS_SIM_OK);
+    CHECK(word[0] == 0x22 && word[1] == 0x22);
+}
+
+
+int main()
+{
+    static_assert(smbus::detail::has_on_read_data<ReadOnlyDevice>::value);
+    static_assert(!smbus::detail::has_on_write_data<ReadOnlyDevice>::value);
+    static_assert(smbus::detail::has_on_block_proc_call<TestDevice>::value);
+
+    test_device(false);
+    test_device(true);
+    test_partial_device();
+    test_both_buses();
+
+    printf("%u failure(s)\n", test_failures);
+
+    return test_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,1457 @@
+#include <smbus/smbus_slave.h>
+#include <smbus_pec.h>
+#include <smbus_sim.h>
+#include <hardware/gpio.h>
+#include <hardware/timer.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_BUS            0
+#define TEST_I2C            i2c0
+#define TEST_ADDRESS        0x17
+#define TEST_BAUDRATE       100000
+#define TEST_SDA_PIN        12
+#define TEST_SCL_PIN        13
+#define TEST_ALERT_PIN      14
+
+// Second bus, for handlers that serve both
+#define TEST_BUS_1          1
+#define TEST_I2C_1          i2c1
+#define TEST_SDA_PIN_1      2
+#define TEST_SCL_PIN_1      3
+
+#define TEST_CMD_BYTE       0xC1
+#define TEST_CMD_WORD       0xC2
+#define TEST_CMD_BLOCK      0xCB
+#define TEST_CMD_PROC_CALL  0xCC
+#define TEST_CMD_BLOCK_PROC_CALL 0xCD
+#define TEST_REG            0xC0
+
+#define CHECK(cond)                                                         \
+    do                                                                      \
+    {                                                                       \
+        if(!(cond))                                                         \
+        {                                                                   \
+            printf("  %s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            test_failures += 1;                                             \
+        }                                                                   \
+    }                                                                       \
+    while (0)
+
+typedef struct test_log_t
+{
+    uint calls;
+    smbus_slave_event_t event;
+    uint8_t command;
+    bool is_on;
+    smbus_data_t data;
+}
+test_log_t;
+
+// State of one device, passed to the ctx handlers
+typedef struct test_device_t
+{
+    uint calls;
+    uint16_t word;
+}
+test_device_t;
+
+static uint test_failures;
+static test_log_t test_log;
+
+
+static void test_quick_handler(bool is_on)
+{
+    test_log.calls += 1;
+    test_log.event = SMBUS_SLAVE_QUICK;
+    test_log.is_on = is_on;
+}
+
+static void test_write_reg_handler(uint8_t reg)
+{
+    test_log.calls += 1;
+    test_log.event = SMBUS_SLAVE_WRITE_REG;
+    test_log.command = reg;
+}
+
+static void test_write_data_handler(uint8_t command, const smbus_data_t* smbus_data)
+{
+    test_log.calls += 1;
+    test_log.event = SMBUS_SLAVE_WRITE_DATA;
+    test_log.command = command;
+    test_log.data = *smbus_data;
+}
+
+static uint8_t test_read_reg_handler()
+{
+    test_log.calls += 1;
+    test_log.event = SMBUS_SLAVE_READ_REG;
+
+    return TEST_REG;
+}
+
+static size_t test_read_data_handler(uint8_t command, smbus_data_t* smbus_data)
+{
+    size_t size = 0;
+
+    test_log.calls += 1;
+    test_log.event = SMBUS_SLAVE_READ_DATA;
+    test_log.command = command;
+
+    switch (command)
+    {
+        case TEST_CMD_BYTE:
+            smbus_data->byte = 0x5A;
+            size = sizeof(uint8_t);
+            break;
+
+        case TEST_CMD_WORD:
+            smbus_data->word = 0x0123;
+            size = sizeof(uint16_t);
+            break;
+
+        case TEST_CMD_BLOCK:
+            smbus_data->block[0] = SMBUS_MAX_BLOCK_LEN;
+
+            for (uint8_t i = 0; i < SMBUS_MAX_BLOCK_LEN; ++i)
+            {
+                smbus_data->block[i + 1] = 0xA0 | i;
+            }
+
+            size = SMBUS_MAX_BLOCK_LEN + 1;
+            break;
+    }
+
+    return size;
+}
+
+static uint16_t test_proc_call_handler(uint8_t command, uint16_t request)
+{
+    test_log.calls += 1;
+    test_log.event = SMBUS_SLAVE_PROC_CALL;
+    test_log.command = command;
+    test_log.data.word = request;
+
+    return request ^ 0xFFFF;
+}
+
+static void test_ctx_write_data_handler(uint8_t command, const smbus_data_t* smbus_data, void* ctx)
+{
+    test_device_t* device = ctx;
+
+    device->calls += 1;
+
+    if(command == TEST_CMD_WORD)
+    {
+        device->word = smbus_data->word;
+    }
+}
+
+static size_t test_ctx_read_data_handler(uint8_t command, smbus_data_t* smbus_data, void* ctx)
+{
+    test_device_t* device = ctx;
+
+    device->calls += 1;
+
+    if(command != TEST_CMD_WORD)
+    {
+        return 0;
+    }
+
+    smbus_data->word = device->word;
+
+    return sizeof(uint16_t);
+}
+
+static bool test_block_proc_call_handler(uint8_t command, const smbus_data_t* request, smbus_data_t* response)
+{
+    if(command != TEST_CMD_BLOCK_PROC_CALL)
+    {
+        return false;
+    }
+
+    test_log.calls += 1;
+    test_log.event = SMBUS_SLAVE_BLOCK_PROC_CALL;
+    test_log.command = command;
+    test_log.data = *request;
+
+    // Reversed request, one byte longer
+    response->block[0] = request->block[0] + 1;
+
+    for (uint8_t i = 0; i < request->block[0]; ++i)
+    {
+        response->block[i + 1] = request->block[request->block[0] - i];
+    }
+
+    response->block[request->block[0] + 1] = 0xEE;
+
+    return true;
+}
+
+
+static void test_setup(bool pec)
+{
+    smbus_sim_reset();
+
+    smbus_slave_init(TEST_I2C, TEST_ADDRESS, TEST_BAUDRATE, TEST_SDA_PIN, TEST_SCL_PIN);
+
+    smbus_set_quick_handler(TEST_I2C, test_quick_handler);
+    smbus_set_write_reg_handler(TEST_I2C, test_write_reg_handler);
+    smbus_set_write_data_handler(TEST_I2C, test_write_data_handler);
+    smbus_set_read_reg_handler(TEST_I2C, test_read_reg_handler);
+    smbus_set_read_data_handler(TEST_I2C, test_read_data_handler);
+    smbus_set_proc_call_handler(TEST_I2C, test_proc_call_handler);
+    smbus_set_block_proc_call_handler(TEST_I2C, test_block_proc_call_handler);
+
+    smbus_set_pec(TEST_I2C, pec);
+
+    memset(&test_log, 0, sizeof(test_log));
+}
+
+static void test_teardown(void)
+{
+    smbus_sim_stats_t stats;
+
+    smbus_sim_get_stats(TEST_BUS, &stats);
+
+    CHECK(stats.stalls == 0);
+    CHECK(stats.stuck == 0);
+
+    smbus_slave_deinit(TEST_I2C);
+}
+
+
+static void test_quick(bool pec)
+{
+    test_setup(pec);
+
+    CHECK(smbus_sim_quick(TEST_BUS, TEST_ADDRESS, false) == SMBUS_SIM_OK);
+    CHECK(test_log.calls == 1);
+    CHECK(test_log.event == SMBUS_SLAVE_QUICK);
+    CHECK(test_log.is_on == false);
+
+    // The read_reg handler answers first, a Quick Read is only known at STOP
+    CHECK(smbus_sim_quick(TEST_BUS, TEST_ADDRESS, true) == SMBUS_SIM_OK);
+    CHECK(test_log.calls == 3);
+    CHECK(test_log.event == SMBUS_SLAVE_QUICK);
+    CHECK(test_log.is_on == true);
+
+    test_teardown();
+}
+
+static void test_send_receive_byte(bool pec)
+{
+    uint8_t value = 0;
+
+    test_setup(pec);
+
+    CHECK(smbus_sim_send_byte(TEST_BUS, TEST_ADDRESS, 0x42, pec) == SMBUS_SIM_OK);
+    CHECK(test_log.calls == 1);
+    CHECK(test_log.event == SMBUS_SLAVE_WRITE_REG);
+    CHECK(test_log.command == 0x42);
+
+    CHECK(smbus_sim_receive_byte(TEST_BUS, TEST_ADDRESS, &value, pec) == SMBUS_SIM_OK);
+    CHECK(test_log.calls == 2);
+    CHECK(test_log.event == SMBUS_SLAVE_READ_REG);
+    CHECK(value == TEST_REG);
+
+    test_teardown();
+}
+
+static void test_write_data(bool pec)
+{
+    uint8_t block[SMBUS_MAX_BLOCK_LEN + 1];
+    uint8_t word[] = { 0x34, 0x12 };
+    uint8_t byte[] = { 0x99 };
+
+    test_setup(pec);
+
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_BYTE, byte, sizeof(byte), pec) == SMBUS_SIM_OK);
+    CHECK(test_log.event == SMBUS_SLAVE_WRITE_DATA);
+    CHECK(test_log.command == TEST_CMD_BYTE);
+    CHECK(test_log.data.byte == 0x99);
+
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), pec) == SMBUS_SIM_OK);
+    CHECK(test_log.command == TEST_CMD_WORD);
+    CHECK(test_log.data.word == 0x1234);
+
+    block[0] = SMBUS_MAX_BLOCK_LEN;
+
+    for (uint8_t i = 0; i < SMBUS_MAX_BLOCK_LEN; ++i)
+    {
+        block[i + 1] = i;
+    }
+
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_BLOCK, block, sizeof(block), pec) == SMBUS_SIM_OK);
+    CHECK(test_log.command == TEST_CMD_BLOCK);
+    CHECK(memcmp(test_log.data.block, block, sizeof(block)) == 0);
+    CHECK(test_log.calls == 3);
+
+    test_teardown();
+}
+
+static void test_read_data(bool pec)
+{
+    uint8_t block[SMBUS_MAX_BLOCK_LEN + 1];
+    size_t block_len = 0;
+    uint8_t word[2];
+    uint8_t byte[1];
+
+    test_setup(pec);
+
+    CHECK(smbus_sim_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_BYTE, byte, sizeof(byte), pec) == SMBUS_SIM_OK);
+    CHECK(byte[0] == 0x5A);
+
+    CHECK(smbus_sim_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), pec) == SMBUS_SIM_OK);
+    CHECK(word[0] == 0x23 && word[1] == 0x01);
+
+    CHECK(smbus_sim_block_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_BLOCK, block, &block_len, pec) == SMBUS_SIM_OK);
+    CHECK(block_len == SMBUS_MAX_BLOCK_LEN + 1);
+    CHECK(block[0] == SMBUS_MAX_BLOCK_LEN);
+    CHECK(block[SMBUS_MAX_BLOCK_LEN] == (0xA0 | (SMBUS_MAX_BLOCK_LEN - 1)));
+    CHECK(test_log.calls == 3);
+
+    test_teardown();
+}
+
+static void test_proc_call(bool pec)
+{
+    uint16_t response = 0;
+
+    test_setup(pec);
+
+    CHECK(smbus_sim_proc_call(TEST_BUS, TEST_ADDRESS, TEST_CMD_PROC_CALL, 0x1234, &response, pec) == SMBUS_SIM_OK);
+    CHECK(test_log.calls == 1);
+    CHECK(test_log.event == SMBUS_SLAVE_PROC_CALL);
+    CHECK(test_log.data.word == 0x1234);
+    CHECK(response == (0x1234 ^ 0xFFFF));
+
+    test_teardown();
+}
+
+static void test_rx_threshold(bool pec)
+{
+    uint8_t block[SMBUS_MAX_BLOCK_LEN + 1];
+    uint16_t response = 0;
+    smbus_sim_stats_t stats;
+
+    test_setup(pec);
+    smbus_set_fifo_thresholds(TEST_I2C, 8, 0);
+
+    block[0] = SMBUS_MAX_BLOCK_LEN;
+
+    for (uint8_t i = 0; i < SMBUS_MAX_BLOCK_LEN; ++i)
+    {
+        block[i + 1] = 0x80 | i;
+    }
+
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_BLOCK, block, sizeof(block), pec) == SMBUS_SIM_OK);
+    CHECK(test_log.calls == 1);
+    CHECK(test_log.command == TEST_CMD_BLOCK);
+    CHECK(memcmp(test_log.data.block, block, sizeof(block)) == 0);
+
+    // START, one RX_FULL per 8 bytes, STOP drains the tail
+    smbus_sim_get_stats(TEST_BUS, &stats);
+    CHECK(stats.isr_entries == 2 + (1 + sizeof(block) + pec) / 8);
+
+    // Command and request stay below the threshold until RESTART drains them
+    CHECK(smbus_sim_proc_call(TEST_BUS, TEST_ADDRESS, TEST_CMD_PROC_CALL, 0x1234, &response, pec) == SMBUS_SIM_OK);
+    CHECK(test_log.calls == 2);
+    CHECK(test_log.data.word == 0x1234);
+    CHECK(response == (0x1234 ^ 0xFFFF));
+
+    test_teardown();
+}
+
+static void test_block_read_early_nack(bool pec)
+{
+    uint8_t block[SMBUS_MAX_BLOCK_LEN + 1];
+    size_t block_len = 0;
+    uint8_t byte[1];
+
+    test_setup(pec);
+    smbus_set_fifo_thresholds(TEST_I2C, 1, 4);
+
+    CHECK(smbus_sim_start(TEST_BUS, TEST_ADDRESS, false));
+    CHECK(smbus_sim_write_byte(TEST_BUS, TEST_CMD_BLOCK));
+    CHECK(smbus_sim_start(TEST_BUS, TEST_ADDRESS, true));
+    CHECK(smbus_sim_read_byte(TEST_BUS, true) == SMBUS_MAX_BLOCK_LEN);
+    CHECK(smbus_sim_read_byte(TEST_BUS, true) == 0xA0);
+    CHECK(smbus_sim_read_byte(TEST_BUS, false) == 0xA1);
+    smbus_sim_stop(TEST_BUS);
+
+    // Bytes queued for the aborted read must not leak into the next ones
+    CHECK(smbus_sim_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_BYTE, byte, sizeof(byte), pec) == SMBUS_SIM_OK);
+    CHECK(byte[0] == 0x5A);
+
+    CHECK(smbus_sim_block_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_BLOCK, block, &block_len, pec) == SMBUS_SIM_OK);
+    CHECK(block_len == SMBUS_MAX_BLOCK_LEN + 1);
+    CHECK(block[SMBUS_MAX_BLOCK_LEN] == (0xA0 | (SMBUS_MAX_BLOCK_LEN - 1)));
+
+    test_teardown();
+}
+
+static void test_dma(bool pec)
+{
+    uint8_t block[SMBUS_MAX_BLOCK_LEN + 1];
+    size_t block_len = 0;
+    uint8_t word[] = { 0x34, 0x12 };
+    smbus_sim_stats_t stats;
+
+    test_setup(pec);
+    smbus_set_fifo_thresholds(TEST_I2C, 8, 0);
+    CHECK(smbus_set_dma(TEST_I2C, true));
+    CHECK(smbus_get_dma(TEST_I2C));
+
+    block[0] = SMBUS_MAX_BLOCK_LEN;
+
+    for (uint8_t i = 0; i < SMBUS_MAX_BLOCK_LEN; ++i)
+    {
+        block[i + 1] = 0x40 | i;
+    }
+
+    // START, RX_FULL until SMBUS_DMA_MIN_LEN bytes are in, then DMA until STOP
+    smbus_sim_reset_stats(TEST_BUS);
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_BLOCK, block, sizeof(block), pec) == SMBUS_SIM_OK);
+    CHECK(test_log.calls == 1);
+    CHECK(memcmp(test_log.data.block, block, sizeof(block)) == 0);
+    smbus_sim_get_stats(TEST_BUS, &stats);
+    CHECK(stats.isr_entries == 4);
+
+    // Short transfers stay on the interrupt path
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), pec) == SMBUS_SIM_OK);
+    CHECK(test_log.calls == 2);
+    CHECK(test_log.data.word == 0x1234);
+
+    // START, RESTART, RD_REQ, STOP
+    smbus_sim_reset_stats(TEST_BUS);
+    CHECK(smbus_sim_block_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_BLOCK, block, &block_len, pec) == SMBUS_SIM_OK);
+    CHECK(block_len == SMBUS_MAX_BLOCK_LEN + 1);
+    CHECK(block[SMBUS_MAX_BLOCK_LEN] == (0xA0 | (SMBUS_MAX_BLOCK_LEN - 1)));
+    smbus_sim_get_stats(TEST_BUS, &stats);
+    CHECK(stats.isr_entries == 4);
+
+    // An aborted DMA read leaves nothing behind for the next one
+    CHECK(smbus_sim_start(TEST_BUS, TEST_ADDRESS, false));
+    CHECK(smbus_sim_write_byte(TEST_BUS, TEST_CMD_BLOCK));
+    CHECK(smbus_sim_start(TEST_BUS, TEST_ADDRESS, true));
+    CHECK(smbus_sim_read_byte(TEST_BUS, true) == SMBUS_MAX_BLOCK_LEN);
+    CHECK(smbus_sim_read_byte(TEST_BUS, false) == 0xA0);
+    smbus_sim_stop(TEST_BUS);
+
+    CHECK(smbus_sim_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), pec) == SMBUS_SIM_OK);
+    CHECK(word[0] == 0x23 && word[1] == 0x01);
+
+    CHECK(smbus_sim_block_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_BLOCK, block, &block_len, pec) == SMBUS_SIM_OK);
+    CHECK(block[1] == 0xA0 && block[SMBUS_MAX_BLOCK_LEN] == (0xA0 | (SMBUS_MAX_BLOCK_LEN - 1)));
+
+    test_teardown();
+}
+
+static void test_deferred(bool pec)
+{
+    uint8_t word[] = { 0x34, 0x12 };
+    uint8_t byte[1];
+    smbus_queue_stats_t stats;
+
+    test_setup(pec);
+    smbus_set_deferred(TEST_I2C, true);
+    CHECK(smbus_get_deferred(TEST_I2C));
+
+    CHECK(smbus_sim_quick(TEST_BUS, TEST_ADDRESS, false) == SMBUS_SIM_OK);
+    CHECK(smbus_sim_send_byte(TEST_BUS, TEST_ADDRESS, 0x42, pec) == SMBUS_SIM_OK);
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), pec) == SMBUS_SIM_OK);
+    CHECK(test_log.calls == 0);
+
+    // Reads still answer from interrupt context
+    CHECK(smbus_sim_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_BYTE, byte, sizeof(byte), pec) == SMBUS_SIM_OK);
+    CHECK(byte[0] == 0x5A);
+    CHECK(test_log.calls == 1);
+
+    // The slot is reused by the next write, the handler must see the old data
+    CHECK(smbus_dispatch(TEST_I2C) == 3);
+    CHECK(test_log.calls == 4);
+    CHECK(test_log.event == SMBUS_SLAVE_WRITE_DATA);
+    CHECK(test_log.command == TEST_CMD_WORD);
+    CHECK(test_log.data.word == 0x1234);
+    CHECK(smbus_dispatch(TEST_I2C) == 0);
+
+    for (uint i = 0; i < 10; ++i)
+    {
+        CHECK(smbus_sim_send_byte(TEST_BUS, TEST_ADDRESS, (uint8_t)i, pec) == SMBUS_SIM_OK);
+    }
+
+    // Newest entries are dropped once the queue is full
+    CHECK(smbus_dispatch(TEST_I2C) == 8);
+    CHECK(test_log.command == 7);
+
+    smbus_get_queue_stats(TEST_I2C, &stats);
+    CHECK(stats.overflows == 2);
+    CHECK(stats.high_water == 8);
+
+    test_teardown();
+}
+
+static void test_published(bool pec)
+{
+    uint8_t block[SMBUS_MAX_BLOCK_LEN + 1];
+    size_t block_len = 0;
+    uint8_t published[SMBUS_MAX_BLOCK_LEN + 1];
+    uint8_t word[2];
+
+    test_setup(pec);
+
+    published[0] = SMBUS_MAX_BLOCK_LEN;
+
+    for (uint8_t i = 0; i < SMBUS_MAX_BLOCK_LEN; ++i)
+    {
+        published[i + 1] = 0x30 + i;
+    }
+
+    CHECK(smbus_publish(TEST_I2C, TEST_CMD_WORD, "\x78\x56", 2));
+    CHECK(smbus_publish(TEST_I2C, TEST_CMD_BLOCK, published, sizeof(published)));
+
+    CHECK(smbus_sim_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), pec) == SMBUS_SIM_OK);
+    CHECK(word[0] == 0x78 && word[1] == 0x56);
+
+    CHECK(smbus_sim_block_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_BLOCK, block, &block_len, pec) == SMBUS_SIM_OK);
+    CHECK(memcmp(block, published, sizeof(published)) == 0);
+
+    // The same response once more through DMA
+    CHECK(smbus_set_dma(TEST_I2C, true));
+    CHECK(smbus_sim_block_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_BLOCK, block, &block_len, pec) == SMBUS_SIM_OK);
+    CHECK(memcmp(block, published, sizeof(published)) == 0);
+    CHECK(test_log.calls == 0);
+
+    // Republishing replaces the response, unpublished commands go to the handler
+    CHECK(smbus_publish(TEST_I2C, TEST_CMD_WORD, "\xCD\xAB", 2));
+    CHECK(smbus_sim_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), pec) == SMBUS_SIM_OK);
+    CHECK(word[0] == 0xCD && word[1] == 0xAB);
+
+    smbus_unpublish(TEST_I2C, TEST_CMD_WORD);
+    CHECK(smbus_sim_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), pec) == SMBUS_SIM_OK);
+    CHECK(word[0] == 0x23 && word[1] == 0x01);
+    CHECK(test_log.calls == 1);
+
+    for (uint i = 0; i < 7; ++i)
+    {
+        CHECK(smbus_publish(TEST_I2C, (uint8_t)i, &i, 1));
+    }
+
+    CHECK(!smbus_publish(TEST_I2C, TEST_CMD_BYTE, "\x01", 1));
+    CHECK(!smbus_publish(TEST_I2C, TEST_CMD_WORD, published, sizeof(smbus_data_t)));
+
+    test_teardown();
+}
+
+static uint16_t test_reg_word = 0x0123;
+static uint32_t test_reg_dword = 0x89ABCDEF;
+static uint8_t test_reg_block[1 + 8] = { 3, 0x10, 0x20, 0x30 };
+
+static const smbus_reg_t test_registers[256] = {
+    [TEST_CMD_WORD]  = SMBUS_REG_FIXED_ENTRY(test_reg_word, SMBUS_REG_RW, NULL),
+    [TEST_CMD_BLOCK] = SMBUS_REG_BLOCK_ENTRY(test_reg_block, SMBUS_REG_RW, test_write_data_handler),
+    [0xD0]           = SMBUS_REG_FIXED_ENTRY(test_reg_dword, SMBUS_REG_READ, NULL),
+    [0xD1]           = SMBUS_REG_FIXED_ENTRY(test_reg_dword, SMBUS_REG_WRITE, NULL),
+};
+
+static void test_regmap(bool pec)
+{
+    uint8_t block[SMBUS_MAX_BLOCK_LEN + 1];
+    size_t block_len = 0;
+    uint8_t word[2];
+    uint8_t dword[4];
+
+    test_setup(pec);
+    smbus_set_regmap(TEST_I2C, test_registers);
+
+    CHECK(smbus_sim_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), pec) == SMBUS_SIM_OK);
+    CHECK(word[0] == 0x23 && word[1] == 0x01);
+
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, (const uint8_t*)"\x34\x12", 2, pec) == SMBUS_SIM_OK);
+    CHECK(test_reg_word == 0x1234);
+
+    CHECK(smbus_sim_block_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_BLOCK, block, &block_len, pec) == SMBUS_SIM_OK);
+    CHECK(block_len == 4 && block[1] == 0x10 && block[3] == 0x30);
+
+    CHECK(smbus_sim_read(TEST_BUS, TEST_ADDRESS, 0xD0, dword, sizeof(dword), pec) == SMBUS_SIM_OK);
+    CHECK(dword[0] == 0xEF && dword[3] == 0x89);
+    CHECK(test_log.calls == 0);
+
+    // on_write sees the transaction after storage was updated
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_BLOCK, (const uint8_t*)"\x02\xAA\xBB", 3, pec) == SMBUS_SIM_OK);
+    CHECK(test_log.calls == 1);
+    CHECK(test_log.data.block[0] == 2 && test_log.data.block[2] == 0xBB);
+    CHECK(test_reg_block[0] == 2 && test_reg_block[1] == 0xAA && test_reg_block[2] == 0xBB);
+
+    // Wrong lengths, over-long blocks and read-only registers are ignored
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, (const uint8_t*)"\x99", 1, pec) == SMBUS_SIM_OK);
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_BLOCK, (const uint8_t*)"\x09\x01", 2, pec) == SMBUS_SIM_OK);
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, 0xD0, (const uint8_t*)"\x00\x00\x00\x00", 4, pec) == SMBUS_SIM_OK);
+    CHECK(test_reg_word == 0x1234);
+    CHECK(test_reg_block[0] == 2);
+    CHECK(test_reg_dword == 0x89ABCDEF);
+    CHECK(test_log.calls == 1);
+
+    // Write-only registers have no data to read, only the PEC if enabled
+    if(!pec)
+    {
+        CHECK(smbus_sim_read(TEST_BUS, TEST_ADDRESS, 0xD1, word, sizeof(word), pec) == SMBUS_SIM_OK);
+        CHECK(word[0] == 0xFF && word[1] == 0xFF);
+    }
+
+    // Unmapped commands still reach the handlers
+    CHECK(smbus_sim_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_BYTE, word, 1, pec) == SMBUS_SIM_OK);
+    CHECK(word[0] == 0x5A);
+    CHECK(test_log.calls == 2);
+
+    test_reg_word = 0x0123;
+    test_reg_block[0] = 3;
+    test_reg_block[1] = 0x10;
+    test_reg_block[2] = 0x20;
+
+    test_teardown();
+}
+
+static void test_reg_access(void)
+{
+    uint8_t data[SMBUS_MAX_BLOCK_LEN + 1];
+    uint8_t word[2];
+
+    printf("reg access\n");
+
+    test_setup(false);
+
+    CHECK(smbus_reg_read(TEST_I2C, TEST_CMD_WORD, data, sizeof(data)) == 0);
+
+    smbus_set_regmap(TEST_I2C, test_registers);
+
+    CHECK(smbus_reg_read(TEST_I2C, TEST_CMD_WORD, data, sizeof(data)) == 2);
+    CHECK(data[0] == 0x23 && data[1] == 0x01);
+    CHECK(smbus_reg_read(TEST_I2C, TEST_CMD_WORD, data, 1) == 0);
+    CHECK(smbus_reg_read(TEST_I2C, TEST_CMD_BLOCK, data, sizeof(data)) == 4);
+    CHECK(data[0] == 3 && data[3] == 0x30);
+    CHECK(smbus_reg_read(TEST_I2C, 0xD1, data, sizeof(data)) == 0);
+    CHECK(smbus_reg_read(TEST_I2C, TEST_CMD_BYTE, data, sizeof(data)) == 0);
+
+    // Visible on the bus, on_write called as for a bus write
+    CHECK(smbus_reg_write(TEST_I2C, TEST_CMD_WORD, "\x21\x43", 2));
+    CHECK(smbus_sim_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), false) == SMBUS_SIM_OK);
+    CHECK(word[0] == 0x21 && word[1] == 0x43);
+
+    CHECK(smbus_reg_write(TEST_I2C, TEST_CMD_BLOCK, "\x01\xCC", 2));
+    CHECK(test_log.calls == 1 && test_log.command == TEST_CMD_BLOCK);
+    CHECK(test_log.data.block[0] == 1 && test_log.data.block[1] == 0xCC);
+
+    // The same checks as on the bus
+    CHECK(!smbus_reg_write(TEST_I2C, TEST_CMD_WORD, "\x99", 1));
+    CHECK(!smbus_reg_write(TEST_I2C, TEST_CMD_BLOCK, "\x09\x01", 2));
+    CHECK(!smbus_reg_write(TEST_I2C, TEST_CMD_BLOCK, "\x02\x01", 2));
+    CHECK(!smbus_reg_write(TEST_I2C, 0xD0, "\x00\x00\x00\x00", 4));
+    CHECK(!smbus_reg_write(TEST_I2C, TEST_CMD_BYTE, "\x00", 1));
+    CHECK(test_reg_word == 0x4321 && test_reg_block[0] == 1 && test_reg_dword == 0x89ABCDEF);
+
+    test_reg_word = 0x0123;
+    test_reg_block[0] = 3;
+    test_reg_block[1] = 0x10;
+
+    test_teardown();
+}
+
+static void test_speed_grades(void)
+{
+    const uint baudrates[] = { SMBUS_BAUDRATE_STANDARD, SMBUS_BAUDRATE_FAST, SMBUS_BAUDRATE_FAST_PLUS };
+    uint8_t block[SMBUS_MAX_BLOCK_LEN + 1];
+    size_t block_len = 0;
+
+    for (size_t i = 0; i < sizeof(baudrates) / sizeof(baudrates[0]); ++i)
+    {
+        smbus_sim_reset();
+        smbus_slave_init(TEST_I2C, TEST_ADDRESS, baudrates[i], TEST_SDA_PIN, TEST_SCL_PIN);
+        smbus_set_read_data_handler(TEST_I2C, test_read_data_handler);
+        smbus_set_pec(TEST_I2C, true);
+
+        CHECK(smbus_sim_block_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_BLOCK, block, &block_len, true) == SMBUS_SIM_OK);
+        CHECK(block_len == SMBUS_MAX_BLOCK_LEN + 1);
+
+        test_teardown();
+    }
+}
+
+static uint8_t test_read_reg_low_handler()
+{
+    test_log.calls += 1;
+    test_log.event = SMBUS_SLAVE_READ_REG;
+
+    return 0x12;
+}
+
+static void test_receive_byte_quick_read(bool pec)
+{
+    uint8_t value = 0;
+    smbus_sim_stats_t sim_stats;
+    smbus_stats_t stats;
+
+    test_setup(pec);
+
+    // Only a byte clocked out and NACKed raises RX_DONE
+    CHECK(smbus_sim_receive_byte(TEST_BUS, TEST_ADDRESS, &value, pec) == SMBUS_SIM_OK);
+    CHECK(test_log.event == SMBUS_SLAVE_READ_REG);
+    CHECK(value == TEST_REG);
+
+    CHECK(smbus_sim_quick(TEST_BUS, TEST_ADDRESS, true) == SMBUS_SIM_OK);
+    CHECK(test_log.event == SMBUS_SLAVE_QUICK);
+    CHECK(test_log.is_on == true);
+
+    // The answer left queued by the Quick Read is flushed, not sent
+    CHECK(smbus_sim_receive_byte(TEST_BUS, TEST_ADDRESS, &value, pec) == SMBUS_SIM_OK);
+    CHECK(test_log.event == SMBUS_SLAVE_READ_REG);
+    CHECK(value == TEST_REG);
+
+    smbus_get_stats(TEST_I2C, &stats);
+    CHECK(stats.transactions[SMBUS_SLAVE_READ_REG] == 2);
+    CHECK(stats.transactions[SMBUS_SLAVE_QUICK] == 1);
+
+    // Without a read_reg handler the answer is 0xFF
+    smbus_reset_handler(TEST_I2C, SMBUS_SLAVE_READ_REG);
+
+    CHECK(smbus_sim_receive_byte(TEST_BUS, TEST_ADDRESS, &value, pec) == SMBUS_SIM_OK);
+    CHECK(value == 0xFF);
+    CHECK(smbus_sim_quick(TEST_BUS, TEST_ADDRESS, true) == SMBUS_SIM_OK);
+    CHECK(test_log.event == SMBUS_SLAVE_QUICK);
+
+    smbus_sim_get_stats(TEST_BUS, &sim_stats);
+    CHECK(sim_stats.stalls == 0);
+
+    // Unsupported: an answer with the top bit clear holds SDA low through
+    // the STOP of a Quick Read
+    smbus_set_read_reg_handler(TEST_I2C, test_read_reg_low_handler);
+
+    CHECK(smbus_sim_quick(TEST_BUS, TEST_ADDRESS, true) == SMBUS_SIM_STALL);
+
+    smbus_sim_reset_stats(TEST_BUS);
+    test_teardown();
+}
+
+static uint8_t test_buffer[SMBUS_REG_BUFFER_SIZE(SMBUS_MAX_BUFFER_LEN)];
+static uint8_t test_small_buffer[SMBUS_REG_BUFFER_SIZE(40)];
+static const uint8_t* test_buffer_written;
+
+static void test_buffer_write_handler(uint8_t command, const smbus_data_t* smbus_data)
+{
+    test_log.calls += 1;
+    test_log.command = command;
+    test_log.data.byte = smbus_data->block[1];
+    test_buffer_written = smbus_data->block;
+}
+
+static const smbus_reg_t test_buffer_registers[256] = {
+    [TEST_CMD_BLOCK] = SMBUS_REG_BUFFER_ENTRY(test_buffer, SMBUS_REG_RW, test_buffer_write_handler),
+    [TEST_CMD_WORD] = SMBUS_REG_BUFFER_ENTRY(test_small_buffer, SMBUS_REG_RW, NULL),
+};
+
+static void test_large_buffer(bool pec, bool dma)
+{
+    static uint8_t block[1 + SMBUS_MAX_BUFFER_LEN];
+    size_t block_len = 0;
+    uint8_t byte[] = { 0x99 };
+    uint8_t short_block[] = { 5, 0xCC, 0xDD };
+    uint8_t unchecked_block[] = { 2, 0xAA, 0xBB };
+
+    test_setup(pec);
+    smbus_set_fifo_thresholds(TEST_I2C, 8, 4);
+    smbus_set_regmap(TEST_I2C, test_buffer_registers);
+    CHECK(smbus_set_dma(TEST_I2C, dma));
+    memset(test_buffer, 0, sizeof(test_buffer));
+
+    block[0] = SMBUS_MAX_BUFFER_LEN;
+
+    for (uint i = 0; i < SMBUS_MAX_BUFFER_LEN; ++i)
+    {
+        block[i + 1] = (uint8_t)(i * 7);
+    }
+
+    // Received in place into the second half, which readers see once
+    // checked, and on_write sees that half itself
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_BLOCK, block, sizeof(block), pec) == SMBUS_SIM_OK);
+    CHECK(test_log.calls == 1);
+    CHECK(test_buffer[0] == 1);
+    CHECK(test_buffer_written == &test_buffer[1 + sizeof(block)]);
+    CHECK(memcmp(test_buffer_written, block, sizeof(block)) == 0);
+
+    memset(block, 0, sizeof(block));
+
+    CHECK(smbus_sim_block_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_BLOCK, block, &block_len, pec) == SMBUS_SIM_OK);
+    CHECK(block_len == 1 + SMBUS_MAX_BUFFER_LEN);
+    CHECK(memcmp(test_buffer_written, block, sizeof(block)) == 0);
+
+    // Rejected writes leave storage as it was: fewer bytes than the count
+    // says and, with PEC on, a missing PEC
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_BLOCK, short_block, sizeof(short_block), pec) == SMBUS_SIM_OK);
+
+    if(pec)
+    {
+        CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_BLOCK, unchecked_block, sizeof(unchecked_block), false) == SMBUS_SIM_OK);
+    }
+
+    CHECK(test_log.calls == 1);
+    CHECK(test_buffer[0] == 1);
+    CHECK(memcmp(test_buffer_written, block, sizeof(block)) == 0);
+
+    // Other commands still go through smbus_data_t, cleared after every use
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_BYTE, byte, sizeof(byte), pec) == SMBUS_SIM_OK);
+    CHECK(test_log.calls == 2);
+    CHECK(test_log.data.block[0] == 0x99 && test_log.data.block[2] == 0x00);
+
+    test_teardown();
+}
+
+static void test_buffer_reader(bool pec)
+{
+    uint8_t block[1 + 40];
+    size_t block_len = 0;
+    uint8_t update[] = { 2, 0x77, 0x88 };
+    uint8_t data[3];
+
+    test_setup(pec);
+    smbus_set_regmap(TEST_I2C, test_buffer_registers);
+
+    // A count past the entry's length is clamped as it goes out
+    memset(test_small_buffer, 0, sizeof(test_small_buffer));
+    test_small_buffer[1] = 200;
+    test_small_buffer[2] = 0x55;
+
+    CHECK(smbus_sim_block_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, block, &block_len, pec) == SMBUS_SIM_OK);
+    CHECK(block_len == sizeof(block));
+    CHECK(block[0] == 40 && block[1] == 0x55);
+
+    // A write from thread context during a bus read goes to the other
+    // half, the read carries on with what it started from
+    CHECK(smbus_sim_start(TEST_BUS, TEST_ADDRESS, false));
+    CHECK(smbus_sim_write_byte(TEST_BUS, TEST_CMD_WORD));
+    CHECK(smbus_sim_start(TEST_BUS, TEST_ADDRESS, true));
+    CHECK(smbus_sim_read_byte(TEST_BUS, true) == 40);
+
+    CHECK(smbus_reg_write(TEST_I2C, TEST_CMD_WORD, update, sizeof(update)));
+
+    CHECK(smbus_sim_read_byte(TEST_BUS, false) == 0x55);
+    smbus_sim_stop(TEST_BUS);
+
+    CHECK(smbus_reg_read(TEST_I2C, TEST_CMD_WORD, data, sizeof(data)) == sizeof(update));
+    CHECK(memcmp(data, update, sizeof(update)) == 0);
+
+    CHECK(smbus_sim_block_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, block, &block_len, pec) == SMBUS_SIM_OK);
+    CHECK(block_len == sizeof(update));
+    CHECK(memcmp(block, update, sizeof(update)) == 0);
+
+    test_teardown();
+}
+
+static void test_deferred_buffer(bool pec)
+{
+    uint8_t first[] = { 1, 0x11 };
+    uint8_t second[] = { 1, 0x22 };
+
+    test_setup(pec);
+    smbus_set_regmap(TEST_I2C, test_buffer_registers);
+    smbus_set_deferred(TEST_I2C, true);
+
+    // Storage is replaced by the next write, each on_write runs at once
+    // and sees its own data
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_BLOCK, first, sizeof(first), pec) == SMBUS_SIM_OK);
+    CHECK(test_log.calls == 1 && test_log.data.byte == 0x11);
+
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_BLOCK, second, sizeof(second), pec) == SMBUS_SIM_OK);
+    CHECK(test_log.calls == 2 && test_log.data.byte == 0x22);
+
+    CHECK(smbus_dispatch(TEST_I2C) == 0);
+    CHECK(test_log.calls == 2);
+
+    test_teardown();
+}
+
+static void test_block_proc_call(bool pec)
+{
+    uint8_t request[] = { 4, 0x11, 0x22, 0x33, 0x44 };
+    uint8_t response[SMBUS_MAX_BLOCK_LEN + 1];
+    size_t response_len = 0;
+    uint16_t word_response = 0;
+
+    test_setup(pec);
+
+    CHECK(smbus_sim_block_proc_call(TEST_BUS, TEST_ADDRESS, TEST_CMD_BLOCK_PROC_CALL, request, response, &response_len, pec) == SMBUS_SIM_OK);
+    CHECK(test_log.calls == 1);
+    CHECK(test_log.event == SMBUS_SLAVE_BLOCK_PROC_CALL);
+    CHECK(memcmp(test_log.data.block, request, sizeof(request)) == 0);
+    CHECK(response_len == 6);
+    CHECK(response[0] == 5 && response[1] == 0x44 && response[4] == 0x11 && response[5] == 0xEE);
+
+    // A one byte block looks like a word request on the wire
+    request[0] = 1;
+    CHECK(smbus_sim_block_proc_call(TEST_BUS, TEST_ADDRESS, TEST_CMD_BLOCK_PROC_CALL, request, response, &response_len, pec) == SMBUS_SIM_OK);
+    CHECK(response_len == 3 && response[1] == 0x11 && response[2] == 0xEE);
+
+    // ...and word process calls are still told apart by the handler
+    CHECK(smbus_sim_proc_call(TEST_BUS, TEST_ADDRESS, TEST_CMD_PROC_CALL, 0x1201, &word_response, pec) == SMBUS_SIM_OK);
+    CHECK(test_log.event == SMBUS_SLAVE_PROC_CALL);
+    CHECK(word_response == (0x1201 ^ 0xFFFF));
+
+    test_teardown();
+}
+
+static void test_host_notify(void)
+{
+    uint8_t address = 0;
+    uint16_t status = 0;
+    uint8_t data[2];
+
+    test_setup(false);
+
+    CHECK(smbus_notify_host(TEST_I2C, 0xBEEF) == SMBUS_NOTIFY_OK);
+    CHECK(smbus_sim_get_host_notify(TEST_BUS, &address, &status));
+    CHECK(address == TEST_ADDRESS && status == 0xBEEF);
+
+    // Lost arbitration is retried...
+    smbus_sim_set_arbitration_loss(TEST_BUS, 2);
+    CHECK(smbus_notify_host(TEST_I2C, 0x1234) == SMBUS_NOTIFY_OK);
+    CHECK(smbus_sim_get_host_notify(TEST_BUS, &address, &status));
+    CHECK(status == 0x1234);
+
+    // ...but not forever
+    smbus_sim_set_arbitration_loss(TEST_BUS, 3);
+    CHECK(smbus_notify_host(TEST_I2C, 0x5678) == SMBUS_NOTIFY_ARB_LOST);
+    CHECK(!smbus_sim_get_host_notify(TEST_BUS, &address, &status));
+
+    // Not while the slave is being talked to
+    CHECK(smbus_sim_start(TEST_BUS, TEST_ADDRESS, false));
+    CHECK(smbus_sim_write_byte(TEST_BUS, TEST_CMD_WORD));
+    CHECK(smbus_notify_host(TEST_I2C, 0x5678) == SMBUS_NOTIFY_BUSY);
+    smbus_sim_stop(TEST_BUS);
+
+    // Back in slave mode afterwards
+    CHECK(smbus_sim_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, data, sizeof(data), false) == SMBUS_SIM_OK);
+    CHECK(data[0] == 0x23 && data[1] == 0x01);
+
+    test_teardown();
+}
+
+static void test_alert(bool pec)
+{
+    uint8_t value = 0;
+    uint8_t data[2];
+
+    test_setup(pec);
+    smbus_set_alert(TEST_I2C, true, TEST_ALERT_PIN);
+
+    CHECK(smbus_get_alert(TEST_I2C));
+    CHECK(gpio_get(TEST_ALERT_PIN));
+
+    CHECK(smbus_alert_host(TEST_I2C) == SMBUS_NOTIFY_OK);
+    CHECK(smbus_is_alert_raised(TEST_I2C));
+    CHECK(!gpio_get(TEST_ALERT_PIN));
+
+    // A device with a lower address answers the first ARA read
+    smbus_sim_set_arbitration_loss(TEST_BUS, 1);
+    smbus_sim_receive_byte(TEST_BUS, SMBUS_ALERT_RESPONSE_ADDRESS, &value, pec);
+    CHECK(smbus_is_alert_raised(TEST_I2C));
+    CHECK(!gpio_get(TEST_ALERT_PIN));
+
+    CHECK(smbus_sim_receive_byte(TEST_BUS, SMBUS_ALERT_RESPONSE_ADDRESS, &value, pec) == SMBUS_SIM_OK);
+    CHECK(value == (TEST_ADDRESS << 1));
+    CHECK(!smbus_is_alert_raised(TEST_I2C));
+    CHECK(gpio_get(TEST_ALERT_PIN));
+    CHECK(test_log.calls == 0);
+
+    // Own address again, ARA no more
+    CHECK(smbus_sim_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, data, sizeof(data), pec) == SMBUS_SIM_OK);
+    CHECK(data[0] == 0x23 && data[1] == 0x01);
+    CHECK(smbus_sim_receive_byte(TEST_BUS, SMBUS_ALERT_RESPONSE_ADDRESS, &value, pec) == SMBUS_SIM_NACK);
+
+    test_teardown();
+}
+
+static uint32_t test_histogram_total(const uint32_t buckets[])
+{
+    uint32_t total = 0;
+
+    for (uint i = 0; i < SMBUS_STATS_BUCKETS; ++i)
+    {
+        total += buckets[i];
+    }
+
+    return total;
+}
+
+static void test_stats(bool pec)
+{
+    smbus_stats_t stats;
+    smbus_sim_stats_t sim_stats;
+    uint8_t word[] = { 0x34, 0x12 };
+    uint8_t request[] = { 2, 0x11, 0x22 };
+    uint8_t response[SMBUS_MAX_BLOCK_LEN + 1];
+    uint8_t overrun[sizeof(smbus_data_t) + 6];
+    size_t response_len = 0;
+    uint16_t word_response = 0;
+    uint8_t value = 0;
+
+    test_setup(pec);
+    smbus_sim_reset_stats(TEST_BUS);
+
+    smbus_get_stats(TEST_I2C, &stats);
+    CHECK(stats.transactions[SMBUS_SLAVE_QUICK] == 0);
+
+    CHECK(smbus_sim_quick(TEST_BUS, TEST_ADDRESS, false) == SMBUS_SIM_OK);
+    CHECK(smbus_sim_send_byte(TEST_BUS, TEST_ADDRESS, TEST_REG, pec) == SMBUS_SIM_OK);
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), pec) == SMBUS_SIM_OK);
+    CHECK(smbus_sim_receive_byte(TEST_BUS, TEST_ADDRESS, &value, pec) == SMBUS_SIM_OK);
+    CHECK(smbus_sim_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), pec) == SMBUS_SIM_OK);
+    CHECK(smbus_sim_proc_call(TEST_BUS, TEST_ADDRESS, TEST_CMD_PROC_CALL, 0x1234, &word_response, pec) == SMBUS_SIM_OK);
+    CHECK(smbus_sim_block_proc_call(TEST_BUS, TEST_ADDRESS, TEST_CMD_BLOCK_PROC_CALL, request, response, &response_len, pec) == SMBUS_SIM_OK);
+
+    smbus_get_stats(TEST_I2C, &stats);
+    smbus_sim_get_stats(TEST_BUS, &sim_stats);
+
+    for (uint event = 0; event < SMBUS_SLAVE_EVENTS; ++event)
+    {
+        CHECK(stats.transactions[event] == 1);
+    }
+
+    CHECK(stats.pec_errors == 0 && stats.tx_aborts == 0 && stats.unknown_commands == 0 && stats.rx_overruns == 0);
+    CHECK(test_histogram_total(stats.isr_cycles) == sim_stats.isr_entries);
+    CHECK(test_histogram_total(stats.handler_cycles) == test_log.calls);
+
+    // Nothing answers 0x55
+    smbus_sim_read(TEST_BUS, TEST_ADDRESS, 0x55, word, sizeof(word), false);
+    smbus_reset_handler(TEST_I2C, SMBUS_SLAVE_WRITE_DATA);
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, 0x55, word, sizeof(word), pec) == SMBUS_SIM_OK);
+
+    // More than smbus_data_t holds
+    memset(overrun, 0, sizeof(overrun));
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, 0x55, overrun, sizeof(overrun), false) == SMBUS_SIM_OK);
+
+    // A block read cut short leaves bytes to be flushed at the next read
+    CHECK(smbus_sim_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_BLOCK, word, sizeof(word), false) == SMBUS_SIM_OK);
+    CHECK(smbus_sim_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_BYTE, &value, sizeof(value), pec) == SMBUS_SIM_OK);
+
+    smbus_get_stats(TEST_I2C, &stats);
+    CHECK(stats.unknown_commands == 3);
+    CHECK(stats.rx_overruns == sizeof(overrun) - sizeof(smbus_data_t));
+    CHECK(stats.tx_aborts == 1);
+
+    // The overrun write ends in a byte that is no PEC
+    CHECK(stats.pec_errors == (pec ? 1 : 0));
+
+    smbus_reset_stats(TEST_I2C);
+    smbus_get_stats(TEST_I2C, &stats);
+    CHECK(stats.transactions[SMBUS_SLAVE_READ_DATA] == 0 && test_histogram_total(stats.isr_cycles) == 0);
+
+    test_teardown();
+}
+
+static uint8_t test_slow_read_reg_handler()
+{
+    busy_wait_us(100);
+
+    return 0x3C;
+}
+
+static void test_trace(bool pec)
+{
+    smbus_trace_cursor_t cursor = { 0 };
+    smbus_trace_record_t records[SMBUS_TRACE_LEN];
+    uint8_t word[] = { 0x34, 0x12 };
+    uint8_t value = 0;
+
+    test_setup(pec);
+
+    // Skip what earlier tests left behind
+    while (smbus_trace_read(&cursor, records, SMBUS_TRACE_LEN) > 0);
+    cursor.lost = 0;
+
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), pec) == SMBUS_SIM_OK);
+    CHECK(smbus_sim_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), pec) == SMBUS_SIM_OK);
+    CHECK(smbus_sim_quick(TEST_BUS, TEST_ADDRESS, false) == SMBUS_SIM_OK);
+
+    smbus_set_read_reg_handler(TEST_I2C, test_slow_read_reg_handler);
+    CHECK(smbus_sim_receive_byte(TEST_BUS, TEST_ADDRESS, &value, pec) == SMBUS_SIM_OK);
+
+    CHECK(smbus_trace_read(&cursor, records, SMBUS_TRACE_LEN) == 4);
+    CHECK(cursor.lost == 0);
+
+    CHECK(records[0].bus_index == TEST_BUS && records[0].address == TEST_ADDRESS);
+    CHECK(records[0].command == TEST_CMD_WORD && records[0].data_len == 2);
+    CHECK(records[0].flags == (SMBUS_TRACE_WRITE | (pec ? SMBUS_TRACE_PEC : 0)));
+
+    CHECK(records[1].command == TEST_CMD_WORD && records[1].data_len == 2);
+    CHECK(records[1].flags == (SMBUS_TRACE_WRITE | SMBUS_TRACE_READ | (pec ? SMBUS_TRACE_PEC : 0)));
+    CHECK(records[1].timestamp_us >= records[0].timestamp_us);
+
+    CHECK(records[2].data_len == 0 && (records[2].flags & ~SMBUS_TRACE_PEC) == 0);
+
+    CHECK(records[3].command == 0x3C && (records[3].flags & SMBUS_TRACE_READ));
+    CHECK(records[3].handler_us >= 100);
+
+    // A word without its PEC: the high byte is taken for the PEC
+    if(pec)
+    {
+        CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), false) == SMBUS_SIM_OK);
+        CHECK(smbus_trace_read(&cursor, records, 1) == 1);
+        CHECK(records[0].flags & SMBUS_TRACE_PEC_ERROR);
+        CHECK(records[0].data_len == 1);
+    }
+
+    // A reader that falls behind loses the oldest records and knows it
+    for (uint i = 0; i < SMBUS_TRACE_LEN + 8; ++i)
+    {
+        smbus_sim_quick(TEST_BUS, TEST_ADDRESS, false);
+    }
+
+    CHECK(smbus_trace_read(&cursor, records, SMBUS_TRACE_LEN) == SMBUS_TRACE_LEN - 1);
+    CHECK(cursor.lost == 9);
+    CHECK(smbus_trace_read(&cursor, records, SMBUS_TRACE_LEN) == 0);
+
+    test_teardown();
+}
+
+static void test_late_irq(bool pec)
+{
+    smbus_trace_cursor_t cursor = { 0 };
+    smbus_trace_record_t records[SMBUS_TRACE_LEN];
+    uint8_t block[SMBUS_MAX_BLOCK_LEN + 1];
+    uint8_t word[] = { 0x34, 0x12 };
+    uint8_t value = 0;
+    smbus_stats_t slave_stats;
+    smbus_sim_stats_t stats;
+
+    test_setup(pec);
+
+    while (smbus_trace_read(&cursor, records, SMBUS_TRACE_LEN) > 0);
+
+    // START, RX_FULL and STOP pending together: the data is taken before
+    // the STOP ends the transaction, all in one entry
+    smbus_sim_reset_stats(TEST_BUS);
+    smbus_sim_set_irq_delay(TEST_BUS, true);
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), pec) == SMBUS_SIM_OK);
+    CHECK(test_log.calls == 0);
+    smbus_sim_set_irq_delay(TEST_BUS, false);
+
+    CHECK(test_log.calls == 1);
+    CHECK(test_log.event == SMBUS_SLAVE_WRITE_DATA);
+    CHECK(test_log.data.word == 0x1234);
+    smbus_sim_get_stats(TEST_BUS, &stats);
+    CHECK(stats.isr_entries == 1);
+
+    // RESTART ahead of RD_REQ, then the STOP
+    smbus_sim_reset_stats(TEST_BUS);
+    smbus_sim_set_irq_delay(TEST_BUS, true);
+    CHECK(smbus_sim_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), pec) == SMBUS_SIM_OK);
+    smbus_sim_set_irq_delay(TEST_BUS, false);
+
+    CHECK(word[0] == 0x23 && word[1] == 0x01);
+    smbus_sim_get_stats(TEST_BUS, &stats);
+    CHECK(stats.isr_entries == 2);
+
+    // Entered only when the RX FIFO is full, twice, and for the STOP
+    block[0] = SMBUS_MAX_BLOCK_LEN;
+
+    for (uint8_t i = 0; i < SMBUS_MAX_BLOCK_LEN; ++i)
+    {
+        block[i + 1] = 0x40 | i;
+    }
+
+    smbus_set_fifo_thresholds(TEST_I2C, 8, 0);
+    smbus_sim_reset_stats(TEST_BUS);
+    smbus_sim_set_irq_delay(TEST_BUS, true);
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_BLOCK, block, sizeof(block), pec) == SMBUS_SIM_OK);
+    smbus_sim_set_irq_delay(TEST_BUS, false);
+
+    CHECK(test_log.command == TEST_CMD_BLOCK);
+    CHECK(memcmp(test_log.data.block, block, sizeof(block)) == 0);
+    smbus_sim_get_stats(TEST_BUS, &stats);
+    CHECK(stats.isr_entries == 3);
+
+    // The STOP of a write is still pending when the next transaction
+    // starts and reads: STOP, START and RD_REQ are served in that order
+    smbus_reset_stats(TEST_I2C);
+    smbus_sim_reset_stats(TEST_BUS);
+    test_log.calls = 0;
+
+    CHECK(smbus_sim_start(TEST_BUS, TEST_ADDRESS, false));
+    CHECK(smbus_sim_write_byte(TEST_BUS, TEST_CMD_BYTE));
+    CHECK(smbus_sim_write_byte(TEST_BUS, 0x99));
+
+    if(pec)
+    {
+        uint8_t crc = smbus_pec_single(0, TEST_ADDRESS << 1);
+        crc = smbus_pec_single(crc, TEST_CMD_BYTE);
+        crc = smbus_pec_single(crc, 0x99);
+
+        CHECK(smbus_sim_write_byte(TEST_BUS, crc));
+    }
+
+    smbus_sim_set_irq_delay(TEST_BUS, true);
+    smbus_sim_stop(TEST_BUS);
+    CHECK(test_log.calls == 0);
+    CHECK(smbus_sim_receive_byte(TEST_BUS, TEST_ADDRESS, &value, pec) == SMBUS_SIM_OK);
+    smbus_sim_set_irq_delay(TEST_BUS, false);
+
+    CHECK(test_log.calls == 2);
+    CHECK(test_log.event == SMBUS_SLAVE_READ_REG);
+    CHECK(value == TEST_REG);
+
+    smbus_get_stats(TEST_I2C, &slave_stats);
+    CHECK(slave_stats.transactions[SMBUS_SLAVE_WRITE_DATA] == 1);
+    CHECK(slave_stats.transactions[SMBUS_SLAVE_READ_REG] == 1);
+    CHECK(slave_stats.pec_errors == 0);
+
+    CHECK(smbus_trace_read(&cursor, records, SMBUS_TRACE_LEN) == 5);
+    CHECK(records[3].command == TEST_CMD_BYTE && records[3].data_len == 1);
+    CHECK(records[4].command == TEST_REG && (records[4].flags & SMBUS_TRACE_READ));
+    CHECK(records[4].timestamp_us >= records[3].timestamp_us);
+
+    test_teardown();
+}
+
+static void test_late_irq_write_after_stop(bool pec)
+{
+    uint8_t byte[] = { 0x11 };
+    uint8_t word[] = { 0x22, 0x33 };
+    smbus_stats_t stats;
+
+    test_setup(pec);
+
+    // Both writes are over before the ISR runs: one START, one STOP and
+    // the bytes of both in the RX FIFO
+    smbus_sim_set_irq_delay(TEST_BUS, true);
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_BYTE, byte, sizeof(byte), pec) == SMBUS_SIM_OK);
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), pec) == SMBUS_SIM_OK);
+    CHECK(test_log.calls == 0);
+    smbus_sim_set_irq_delay(TEST_BUS, false);
+
+    CHECK(test_log.calls == 2);
+    CHECK(test_log.command == TEST_CMD_WORD);
+    CHECK(test_log.data.word == 0x3322);
+
+    smbus_get_stats(TEST_I2C, &stats);
+    CHECK(stats.transactions[SMBUS_SLAVE_WRITE_DATA] == 2);
+    CHECK(stats.pec_errors == 0);
+    CHECK(stats.rx_overruns == 0);
+
+    // The STOP of a write is still pending when the next write is under
+    // way, the rest of which arrives after the ISR ran
+    test_log.calls = 0;
+
+    CHECK(smbus_sim_start(TEST_BUS, TEST_ADDRESS, false));
+    CHECK(smbus_sim_write_byte(TEST_BUS, TEST_CMD_BYTE));
+    CHECK(smbus_sim_write_byte(TEST_BUS, 0x44));
+
+    if(pec)
+    {
+        uint8_t crc = smbus_pec_single(0, TEST_ADDRESS << 1);
+        crc = smbus_pec_single(crc, TEST_CMD_BYTE);
+        crc = smbus_pec_single(crc, 0x44);
+
+        CHECK(smbus_sim_write_byte(TEST_BUS, crc));
+    }
+
+    smbus_sim_set_irq_delay(TEST_BUS, true);
+    smbus_sim_stop(TEST_BUS);
+    CHECK(smbus_sim_start(TEST_BUS, TEST_ADDRESS, false));
+    CHECK(smbus_sim_write_byte(TEST_BUS, TEST_CMD_WORD));
+    smbus_sim_set_irq_delay(TEST_BUS, false);
+
+    CHECK(test_log.calls == 1);
+    CHECK(test_log.command == TEST_CMD_BYTE);
+    CHECK(test_log.data.byte == 0x44);
+
+    CHECK(smbus_sim_write_byte(TEST_BUS, 0x55));
+    CHECK(smbus_sim_write_byte(TEST_BUS, 0x66));
+
+    if(pec)
+    {
+        uint8_t crc = smbus_pec_single(0, TEST_ADDRESS << 1);
+        crc = smbus_pec_single(crc, TEST_CMD_WORD);
+        crc = smbus_pec_single(crc, 0x55);
+        crc = smbus_pec_single(crc, 0x66);
+
+        CHECK(smbus_sim_write_byte(TEST_BUS, crc));
+    }
+
+    smbus_sim_stop(TEST_BUS);
+
+    CHECK(test_log.calls == 2);
+    CHECK(test_log.command == TEST_CMD_WORD);
+    CHECK(test_log.data.word == 0x6655);
+
+    smbus_get_stats(TEST_I2C, &stats);
+    CHECK(stats.transactions[SMBUS_SLAVE_WRITE_DATA] == 4);
+    CHECK(stats.pec_errors == 0);
+
+    test_teardown();
+}
+
+static void test_write_restart_write(bool pec)
+{
+    uint8_t word[] = { 0x22, 0x33 };
+    smbus_sim_stats_t sim_stats;
+    smbus_stats_t stats;
+
+    test_setup(pec);
+
+    // Not an SMBus protocol: the bytes after the repeated START are flagged
+    // as first data again and must neither stall the ISR nor be taken for
+    // a transaction of their own. More of them follow than the FIFO holds.
+    CHECK(smbus_sim_start(TEST_BUS, TEST_ADDRESS, false));
+    CHECK(smbus_sim_write_byte(TEST_BUS, TEST_CMD_BYTE));
+    CHECK(smbus_sim_write_byte(TEST_BUS, 0x11));
+    CHECK(smbus_sim_start(TEST_BUS, TEST_ADDRESS, false));
+
+    for (uint i = 0; i < 20; ++i)
+    {
+        CHECK(smbus_sim_write_byte(TEST_BUS, (uint8_t)i));
+    }
+
+    smbus_sim_stop(TEST_BUS);
+
+    CHECK(test_log.calls == 0);
+
+    smbus_sim_get_stats(TEST_BUS, &sim_stats);
+    CHECK(sim_stats.stuck == 0);
+    CHECK(sim_stats.stalls == 0);
+
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), pec) == SMBUS_SIM_OK);
+    CHECK(test_log.calls == 1);
+    CHECK(test_log.command == TEST_CMD_WORD);
+    CHECK(test_log.data.word == 0x3322);
+
+    // The same with the ISR entered only after a write that follows it
+    test_log.calls = 0;
+    smbus_sim_set_irq_delay(TEST_BUS, true);
+
+    CHECK(smbus_sim_start(TEST_BUS, TEST_ADDRESS, false));
+    CHECK(smbus_sim_write_byte(TEST_BUS, TEST_CMD_BYTE));
+    CHECK(smbus_sim_write_byte(TEST_BUS, 0x11));
+    CHECK(smbus_sim_start(TEST_BUS, TEST_ADDRESS, false));
+    CHECK(smbus_sim_write_byte(TEST_BUS, 0x44));
+    CHECK(smbus_sim_write_byte(TEST_BUS, 0x55));
+    smbus_sim_stop(TEST_BUS);
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), pec) == SMBUS_SIM_OK);
+
+    smbus_sim_set_irq_delay(TEST_BUS, false);
+
+    CHECK(test_log.calls == 1);
+    CHECK(test_log.command == TEST_CMD_WORD);
+    CHECK(test_log.data.word == 0x3322);
+
+    smbus_sim_get_stats(TEST_BUS, &sim_stats);
+    CHECK(sim_stats.stuck == 0);
+
+    smbus_get_stats(TEST_I2C, &stats);
+    CHECK(stats.transactions[SMBUS_SLAVE_WRITE_DATA] == 2);
+    CHECK(stats.pec_errors == 0);
+
+    test_teardown();
+}
+
+static void test_pec_mismatch_rejects_write(void)
+{
+    uint8_t word[] = { 0x34, 0x12 };
+
+    test_setup(true);
+
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), false) == SMBUS_SIM_OK);
+    CHECK(test_log.calls == 0);
+
+    test_teardown();
+}
+
+static void test_ctx_handlers(bool pec)
+{
+    test_device_t devices[2] = { { .word = 0x1111 }, { .word = 0x2222 } };
+    i2c_inst_t* i2cs[2] = { TEST_I2C, TEST_I2C_1 };
+    uint8_t word[2];
+
+    test_setup(pec);
+    smbus_slave_init(TEST_I2C_1, TEST_ADDRESS, TEST_BAUDRATE, TEST_SDA_PIN_1, TEST_SCL_PIN_1);
+    smbus_set_pec(TEST_I2C_1, pec);
+
+    // The same handlers on both buses, each with its own device
+    for (uint i = 0; i < 2; ++i)
+    {
+        smbus_set_write_data_ctx_handler(i2cs[i], test_ctx_write_data_handler, &devices[i]);
+        smbus_set_read_data_ctx_handler(i2cs[i], test_ctx_read_data_handler, &devices[i]);
+    }
+
+    CHECK(smbus_sim_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), pec) == SMBUS_SIM_OK);
+    CHECK(word[0] == 0x11 && word[1] == 0x11);
+    CHECK(smbus_sim_read(TEST_BUS_1, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), pec) == SMBUS_SIM_OK);
+    CHECK(word[0] == 0x22 && word[1] == 0x22);
+
+    word[0] = 0x34;
+    word[1] = 0x12;
+    CHECK(smbus_sim_write(TEST_BUS_1, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), pec) == SMBUS_SIM_OK);
+    CHECK(devices[0].word == 0x1111 && devices[1].word == 0x1234);
+    CHECK(devices[0].calls == 1 && devices[1].calls == 2);
+
+    // The plain handlers they replaced are not called
+    CHECK(test_log.calls == 0);
+
+    // Deferred writes get their ctx as well
+    smbus_set_deferred(TEST_I2C, true);
+    CHECK(smbus_sim_write(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), pec) == SMBUS_SIM_OK);
+    CHECK(devices[0].word == 0x1111);
+    CHECK(smbus_dispatch(TEST_I2C) == 1);
+    CHECK(devices[0].word == 0x1234 && devices[0].calls == 2);
+
+    // And a plain handler replaces a ctx one
+    smbus_set_read_data_handler(TEST_I2C, test_read_data_handler);
+    CHECK(smbus_sim_read(TEST_BUS, TEST_ADDRESS, TEST_CMD_WORD, word, sizeof(word), pec) == SMBUS_SIM_OK);
+    CHECK(word[0] == 0x23 && word[1] == 0x01);
+    CHECK(test_log.calls == 1 && devices[0].calls == 2);
+
+    smbus_slave_deinit(TEST_I2C_1);
+    test_teardown();
+}
+
+
+int main()
+{
+    for (uint pec = 0; pec <= 1; ++pec)
+    {
+        printf("PEC %s\n", pec ? "on" : "off");
+
+        test_quick(pec);
+        test_send_receive_byte(pec);
+        test_write_data(pec);
+        test_read_data(pec);
+        test_proc_call(pec);
+        test_block_proc_call(pec);
+        test_rx_threshold(pec);
+        test_block_read_early_nack(pec);
+        test_dma(pec);
+        test_deferred(pec);
+        test_published(pec);
+        test_regmap(pec);
+        test_receive_byte_quick_read(pec);
+        test_large_buffer(pec, false);
+        test_large_buffer(pec, true);
+        test_buffer_reader(pec);
+        test_deferred_buffer(pec);
+        test_alert(pec);
+        test_trace(pec);
+        test_stats(pec);
+        test_late_irq(pec);
+        test_late_irq_write_after_stop(pec);
+        test_write_restart_write(pec);
+        test_ctx_handlers(pec);
+    }
+
+    test_pec_mismatch_rejects_write();
+    test_speed_grades();
+    test_host_notify();
+    test_reg_access();
+
+    printf("%u failure(s)\n", test_failures);
+
+    return test_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,177 @@
+#include "bridge_posix.h"
+#include "bridge.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+typedef struct bridge_posix_t
+{
+    i2c_inst_t* i2c;
+    int udp_fd;
+    int listen_fd;
+    int client_fd;
+    uint8_t request[BRIDGE_FRAME_LEN_SIZE + BRIDGE_MAX_MESSAGE_LEN];
+    size_t request_len;
+    uint8_t response[BRIDGE_MAX_MESSAGE_LEN];
+}
+bridge_posix_t;
+
+static bridge_posix_t bridge_posix = { .udp_fd = -1, .listen_fd = -1, .client_fd = -1 };
+
+
+static void bridge_posix_close(int* fd)
+{
+    if(*fd >= 0)
+    {
+        close(*fd);
+        *fd = -1;
+    }
+}
+
+static bool bridge_posix_send(void* context, const uint8_t* data, size_t data_len)
+{
+    int fd = *(int*)context;
+
+    return send(fd, data, data_len, MSG_NOSIGNAL) == (ssize_t)data_len;
+}
+
+static void bridge_posix_udp_recv()
+{
+    struct sockaddr_in from;
+    socklen_t from_len = sizeof(from);
+    uint8_t request[BRIDGE_MAX_MESSAGE_LEN];
+
+    ssize_t request_len = recvfrom(bridge_posix.udp_fd, request, sizeof(request), MSG_TRUNC, (struct sockaddr*)&from, &from_len);
+
+    // Anything longer was not sent by a client of this protocol
+    if(request_len < 0 || (size_t)request_len > sizeof(request))
+    {
+        return;
+    }
+
+    size_t response_len = bridge_process(bridge_posix.i2c, request, request_len, bridge_posix.response, sizeof(bridge_posix.response));
+
+    if(response_len > 0)
+    {
+        sendto(bridge_posix.udp_fd, bridge_posix.response, response_len, 0, (struct sockaddr*)&from, from_len);
+    }
+}
+
+static void bridge_posix_tcp_recv()
+{
+    size_t space = sizeof(bridge_posix.request) - bridge_posix.request_len;
+    ssize_t data_len = recv(bridge_posix.client_fd, &bridge_posix.request[bridge_posix.request_len], space, 0);
+
+    if(data_len <= 0)
+    {
+        bridge_posix_close(&bridge_posix.client_fd);
+        return;
+    }
+
+    bridge_posix.request_len += data_len;
+
+    if(!bridge_process_stream(bridge_posix.i2c, bridge_posix.request, &bridge_posix.request_len, bridge_posix_send, &bridge_posix.client_fd))
+    {
+        bridge_posix_close(&bridge_posix.client_fd);
+    }
+}
+
+static void bridge_posix_accept()
+{
+    int fd = accept(bridge_posix.listen_fd, NULL, NULL);
+    int is_enabled = 1;
+
+    if(fd < 0)
+    {
+        return;
+    }
+
+    // One client at a time, as on the Pico
+    if(bridge_posix.client_fd >= 0)
+    {
+        close(fd);
+        return;
+    }
+
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &is_enabled, sizeof(is_enabled));
+
+    bridge_posix.client_fd = fd;
+    bridge_posix.request_len = 0;
+}
+
+uint16_t bridge_posix_init(i2c_inst_t* i2c, uint16_t port)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    int is_enabled = 1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+
+    bridge_posix.i2c = i2c;
+    bridge_posix.udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    bridge_posix.listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    if(bridge_posix.udp_fd < 0 || bridge_posix.listen_fd < 0)
+    {
+        bridge_posix_deinit();
+        return 0;
+    }
+
+    setsockopt(bridge_posix.listen_fd, SOL_SOCKET, SO_REUSEADDR, &is_enabled, sizeof(is_enabled));
+
+    // TCP takes the port UDP was given
+    if(bind(bridge_posix.udp_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        getsockname(bridge_posix.udp_fd, (struct sockaddr*)&addr, &addr_len) != 0 ||
+        bind(bridge_posix.listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(bridge_posix.listen_fd, 1) != 0)
+    {
+        bridge_posix_deinit();
+        return 0;
+    }
+
+    return ntohs(addr.sin_port);
+}
+
+void bridge_posix_deinit()
+{
+    bridge_posix_close(&bridge_posix.client_fd);
+    bridge_posix_close(&bridge_posix.listen_fd);
+    bridge_posix_close(&bridge_posix.udp_fd);
+}
+
+void bridge_posix_poll(int timeout_ms)
+{
+    struct pollfd fds[] = {
+        { bridge_posix.udp_fd, POLLIN, 0 },
+        { bridge_posix.listen_fd, POLLIN, 0 },
+        { bridge_posix.client_fd, POLLIN, 0 },
+    };
+
+    if(poll(fds, bridge_posix.client_fd >= 0 ? 3 : 2, timeout_ms) <= 0)
+    {
+        return;
+    }
+
+    if(fds[0].revents & POLLIN)
+    {
+        bridge_posix_udp_recv();
+    }
+
+    if(fds[1].revents & POLLIN)
+    {
+        bridge_posix_accept();
+    }
+
+    if(fds[2].revents & (POLLIN | POLLHUP | POLLERR))
+    {
+        bridge_posix_tcp_recv();
+    }
+}
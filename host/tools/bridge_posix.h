@@ -0,0 +1,19 @@
+#ifndef BRIDGE_POSIX_H
+#define BRIDGE_POSIX_H
+
+#include <stdint.h>
+#include <hardware/i2c.h>
+
+// Loopback stand-in for firmware/bridge_lwip.c: the same UDP and TCP
+// service on 127.0.0.1, over POSIX sockets, so the bridge can be driven
+// by real network clients against the simulated bus.
+
+// Port 0 picks a free one. Returns the port bound, 0 on failure.
+uint16_t bridge_posix_init(i2c_inst_t* i2c, uint16_t port);
+void bridge_posix_deinit();
+
+// Serves whatever arrives within timeout_ms, what lwIP does in
+// cyw43_arch_poll() on the Pico
+void bridge_posix_poll(int timeout_ms);
+
+#endif // BRIDGE_POSIX_H
@@ -0,0 +1,103 @@
+#include "event_log_decode.h"
+#include "event_log.h"
+
+
+static void event_log_print_bytes(FILE* out, const uint8_t* data, size_t data_len, const char* separator)
+{
+    for (size_t i = 0; i < data_len; ++i)
+    {
+        fprintf(out, "%s%02X", i ? separator : "", data[i]);
+    }
+}
+
+static void event_log_print(FILE* out, uint8_t type, const uint8_t* payload, size_t payload_len)
+{
+    // Layouts as printed by the handlers before they logged in binary
+    switch (type)
+    {
+        case EVENT_LOG_QUICK:
+        {
+            fprintf(out, "Q-%s", payload_len && payload[0] ? "ON" : "OFF");
+        }
+        break;
+
+        case EVENT_LOG_WRITE_REG:
+        case EVENT_LOG_READ_REG:
+        {
+            fprintf(out, "%c-", type == EVENT_LOG_WRITE_REG ? 'W' : 'R');
+            event_log_print_bytes(out, payload, payload_len, "");
+        }
+        break;
+
+        case EVENT_LOG_WRITE_DATA:
+        case EVENT_LOG_WRITE_BLOCK:
+        {
+            fprintf(out, "W-");
+            event_log_print_bytes(out, payload, payload_len ? 1 : 0, "");
+            fprintf(out, " ");
+
+            if(payload_len > 1)
+            {
+                event_log_print_bytes(out, &payload[1], payload_len - 1, type == EVENT_LOG_WRITE_BLOCK ? " " : "");
+            }
+        }
+        break;
+
+        case EVENT_LOG_READ_UNKNOWN:
+        {
+            fprintf(out, "R-");
+            event_log_print_bytes(out, payload, payload_len, "");
+            fprintf(out, " ?");
+        }
+        break;
+
+        case EVENT_LOG_LOST:
+        {
+            fprintf(out, "LOST %u", payload_len == 2 ? payload[0] | (payload[1] << 8) : 0);
+        }
+        break;
+
+        case EVENT_LOG_PROC_CALL:
+        {
+            if(payload_len == 5)
+            {
+                fprintf(out, "C-%02X W %02X%02X R %02X%02X", payload[0], payload[1], payload[2], payload[3], payload[4]);
+                break;
+            }
+        }
+        // fall through
+
+        default:
+        {
+            fprintf(out, "?-%02X ", type);
+            event_log_print_bytes(out, payload, payload_len, " ");
+        }
+        break;
+    }
+
+    fprintf(out, "\n");
+}
+
+size_t event_log_decode(const uint8_t* data, size_t data_len, FILE* out)
+{
+    size_t i = 0;
+
+    while (i < data_len)
+    {
+        if(data[i] != EVENT_LOG_SYNC)
+        {
+            fputc(data[i++], out);
+            continue;
+        }
+
+        if(data_len - i < EVENT_LOG_HEADER_LEN || data_len - i < EVENT_LOG_HEADER_LEN + data[i + 2])
+        {
+            break;
+        }
+
+        event_log_print(out, data[i + 1], &data[i + EVENT_LOG_HEADER_LEN], data[i + 2]);
+        i += EVENT_LOG_HEADER_LEN + data[i + 2];
+    }
+
+    return i;
+}
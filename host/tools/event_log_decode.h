@@ -0,0 +1,14 @@
+#ifndef EVENT_LOG_DECODE_H
+#define EVENT_LOG_DECODE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Turns the firmware's binary event log back into one text line per
+// record. Bytes outside records, i.e. plain printf output, are copied
+// through unchanged. Returns how much of data was consumed; a record cut
+// off at the end is left for the next call.
+size_t event_log_decode(const uint8_t* data, size_t data_len, FILE* out);
+
+#endif // EVENT_LOG_DECODE_H
@@ -0,0 +1,60 @@
+#include "export_receiver.h"
+
+
+int export_receiver_parse(
+    export_receiver_t* receiver,
+    const uint8_t* datagram,
+    size_t datagram_len,
+    exporter_header_t* header,
+    smbus_trace_record_t records[EXPORTER_MAX_RECORDS]
+)
+{
+    if(datagram_len < EXPORTER_HEADER_LEN)
+    {
+        return -1;
+    }
+
+    exporter_get_header(datagram, header);
+
+    if(header->magic != EXPORTER_MAGIC || header->version != EXPORTER_VERSION ||
+        header->record_count > EXPORTER_MAX_RECORDS ||
+        datagram_len != EXPORTER_HEADER_LEN + header->record_count * EXPORTER_RECORD_LEN)
+    {
+        return -1;
+    }
+
+    for (uint i = 0; i < header->record_count; ++i)
+    {
+        exporter_get_record(&datagram[EXPORTER_HEADER_LEN + i * EXPORTER_RECORD_LEN], &records[i]);
+    }
+
+    // Wraparound safe: a sequence behind the expected one is late, not new
+    int32_t gap = (int32_t)(header->sequence - receiver->next_sequence);
+
+    if(!receiver->is_started || gap >= 0)
+    {
+        if(receiver->is_started)
+        {
+            receiver->missed_datagrams += gap;
+        }
+
+        receiver->is_started = true;
+        receiver->next_sequence = header->sequence + 1;
+        receiver->lost = header->lost;
+    }
+    else
+    {
+        // Counted as missed when the gap was seen, unless it is a duplicate
+        if(receiver->missed_datagrams > 0)
+        {
+            receiver->missed_datagrams -= 1;
+        }
+
+        receiver->reordered += 1;
+    }
+
+    receiver->datagrams += 1;
+    receiver->records += header->record_count;
+
+    return header->record_count;
+}
@@ -0,0 +1,29 @@
+#ifndef EXPORT_RECEIVER_H
+#define EXPORT_RECEIVER_H
+
+#include "exporter.h"
+
+// Collector side of firmware/exporter.c: validates datagrams and tracks
+// loss per exporter.
+typedef struct export_receiver_t
+{
+    bool is_started;
+    uint32_t next_sequence;
+    uint32_t datagrams;
+    uint32_t missed_datagrams;  // Sequence gaps, i.e. lost on the network
+    uint32_t reordered;         // Arrived after a later datagram
+    uint32_t records;
+    uint32_t lost;              // Records the exporter lost, from the header
+}
+export_receiver_t;
+
+// Returns the number of records, -1 for datagrams that are not exports
+int export_receiver_parse(
+    export_receiver_t* receiver,
+    const uint8_t* datagram,
+    size_t datagram_len,
+    exporter_header_t* header,
+    smbus_trace_record_t records[EXPORTER_MAX_RECORDS]
+);
+
+#endif // EXPORT_RECEIVER_H
@@ -0,0 +1,80 @@
+#include "export_receiver.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Prints the transactions a Pico exports, one per line, and reports loss:
+//
+//   smbus-export-recv [port]
+
+int main(int argc, char* argv[])
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_ANY) };
+    export_receiver_t receiver = { 0 };
+    exporter_header_t header;
+    smbus_trace_record_t records[EXPORTER_MAX_RECORDS];
+    uint8_t datagram[EXPORTER_MAX_DATAGRAM_LEN];
+    uint32_t lost = 0;
+    uint32_t missed = 0;
+
+    addr.sin_port = htons(argc > 1 ? atoi(argv[1]) : EXPORTER_PORT);
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    if(fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        perror("bind");
+        return 1;
+    }
+
+    while (true)
+    {
+        ssize_t datagram_len = recv(fd, datagram, sizeof(datagram), 0);
+
+        if(datagram_len < 0)
+        {
+            perror("recv");
+            return 1;
+        }
+
+        int count = export_receiver_parse(&receiver, datagram, datagram_len, &header, records);
+
+        if(count < 0)
+        {
+            fprintf(stderr, "ignored %zd byte datagram\n", datagram_len);
+            continue;
+        }
+
+        if(receiver.missed_datagrams != missed || receiver.lost != lost)
+        {
+            printf("# seq %u: %u datagram(s) missed, %u record(s) lost on the Pico\n",
+                header.sequence, receiver.missed_datagrams - missed, receiver.lost - lost);
+
+            missed = receiver.missed_datagrams;
+            lost = receiver.lost;
+        }
+
+        for (int i = 0; i < count; ++i)
+        {
+            printf("%10u bus%u 0x%02X cmd %02X len %3u %c%c%c%c handler %u us\n",
+                records[i].timestamp_us,
+                records[i].bus_index,
+                records[i].address,
+                records[i].command,
+                records[i].data_len,
+                (records[i].flags & SMBUS_TRACE_WRITE) ? 'W' : '-',
+                (records[i].flags & SMBUS_TRACE_READ) ? 'R' : '-',
+                (records[i].flags & SMBUS_TRACE_PEC) ? 'P' : '-',
+                (records[i].flags & SMBUS_TRACE_PEC_ERROR) ? '!' : '-',
+                records[i].handler_us
+            );
+        }
+
+        fflush(stdout);
+    }
+
+    return 0;
+}
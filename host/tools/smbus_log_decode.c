@@ -0,0 +1,63 @@
+#include "event_log_decode.h"
+#include "event_log.h"
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+// Decodes the firmware's stdio stream, e.g.
+//
+//   stty -F /dev/ttyACM0 115200 raw && smbus-log-decode /dev/ttyACM0
+
+int main(int argc, char* argv[])
+{
+    uint8_t data[4096];
+    size_t data_len = 0;
+    FILE* in = stdin;
+
+    if(argc > 2)
+    {
+        fprintf(stderr, "usage: %s [serial device or log file]\n", argv[0]);
+        return 2;
+    }
+
+    if(argc == 2)
+    {
+        in = fopen(argv[1], "rb");
+
+        if(!in)
+        {
+            perror(argv[1]);
+            return 1;
+        }
+    }
+
+    while (true)
+    {
+        // read() returns what a serial port has, fread() would wait for a full buffer
+        ssize_t read_len = read(fileno(in), &data[data_len], sizeof(data) - data_len);
+
+        if(read_len <= 0)
+        {
+            break;
+        }
+
+        data_len += read_len;
+
+        size_t decoded_len = event_log_decode(data, data_len, stdout);
+        memmove(data, &data[decoded_len], data_len - decoded_len);
+        data_len -= decoded_len;
+
+        fflush(stdout);
+    }
+
+    // Whatever is left is a record cut off when the stream ended
+    fwrite(data, 1, data_len, stdout);
+
+    if(in != stdin)
+    {
+        fclose(in);
+    }
+
+    return 0;
+}
@@ -9,6 +9,18 @@ extern "C" {
 
 #define SMBUS_MAX_BLOCK_LEN 32
 
+// SMBus 3.x blocks, only through SMBUS_REG_BUFFER entries
+#define SMBUS_MAX_BUFFER_LEN 255
+
+// Addresses reserved by SMBus for notifying the host
+#define SMBUS_HOST_NOTIFY_ADDRESS       0x08
+#define SMBUS_ALERT_RESPONSE_ADDRESS    0x0C
+
+// SMBus 3.x speed classes
+#define SMBUS_BAUDRATE_STANDARD     100000
+#define SMBUS_BAUDRATE_FAST         400000
+#define SMBUS_BAUDRATE_FAST_PLUS    1000000
+
 typedef enum smbus_slave_event_t
 {
     SMBUS_SLAVE_QUICK,
@@ -17,9 +29,12 @@ typedef enum smbus_slave_event_t
     SMBUS_SLAVE_READ_REG, 
     SMBUS_SLAVE_READ_DATA,
     SMBUS_SLAVE_PROC_CALL,
+    SMBUS_SLAVE_BLOCK_PROC_CALL,
 }
 smbus_slave_event_t;
 
+#define SMBUS_SLAVE_EVENTS (SMBUS_SLAVE_BLOCK_PROC_CALL + 1)
+
 typedef union 
 {
     uint8_t byte;
@@ -31,6 +46,88 @@ typedef union
 smbus_data_t;
 
 
+typedef enum smbus_reg_type_t
+{
+    SMBUS_REG_NONE,
+    SMBUS_REG_FIXED,    // Exactly len bytes: byte, word, dword, qword data
+    SMBUS_REG_BLOCK,    // Count byte followed by up to len bytes
+    SMBUS_REG_BUFFER,   // Block of up to 255 bytes, transferred in place
+}
+smbus_reg_type_t;
+
+#define SMBUS_REG_READ      0x1
+#define SMBUS_REG_WRITE     0x2
+#define SMBUS_REG_RW        (SMBUS_REG_READ | SMBUS_REG_WRITE)
+
+typedef enum smbus_notify_result_t
+{
+    SMBUS_NOTIFY_OK,
+    SMBUS_NOTIFY_BUSY,          // The slave is in a transaction, try again later
+    SMBUS_NOTIFY_NACK,          // No host acknowledged the message
+    SMBUS_NOTIFY_ARB_LOST,      // Lost arbitration on every attempt
+    SMBUS_NOTIFY_TIMEOUT,
+}
+smbus_notify_result_t;
+
+// Log2 histogram buckets: bucket n > 0 counts durations of 2^(n-1) up to
+// 2^n - 1 SysTick cycles, the last one everything longer
+#define SMBUS_STATS_BUCKETS 16
+
+// Counted by the ISR per bus. Transactions are counted by the event they
+// would be handled as, PEC failures and unknown commands included.
+typedef struct smbus_stats_t
+{
+    uint32_t transactions[SMBUS_SLAVE_EVENTS];
+    uint32_t pec_errors;        // Writes dropped for a missing or wrong PEC
+    uint32_t tx_aborts;
+    uint32_t unknown_commands;  // Nothing was registered to answer them
+    uint32_t rx_overruns;       // Bytes past the end of the receive buffer
+    uint32_t isr_cycles[SMBUS_STATS_BUCKETS];
+    uint32_t handler_cycles[SMBUS_STATS_BUCKETS];
+}
+smbus_stats_t;
+
+// Records kept by the transaction trace, a power of two. 0 compiles
+// tracing out of the ISR.
+#ifndef SMBUS_TRACE_LEN
+#define SMBUS_TRACE_LEN 0
+#endif
+
+#define SMBUS_TRACE_WRITE       0x01    // A command byte was written
+#define SMBUS_TRACE_READ        0x02    // The master read from us
+#define SMBUS_TRACE_PEC         0x04    // PEC was enabled
+#define SMBUS_TRACE_PEC_ERROR   0x08    // The write was dropped for its PEC
+
+// One per transaction, written at its STOP
+typedef struct smbus_trace_record_t
+{
+    uint32_t timestamp_us;  // time_us_32() at the START
+    uint16_t data_len;      // Bytes after the command, PEC excluded
+    uint16_t handler_us;    // Time spent in handlers from the ISR
+    uint8_t bus_index;
+    uint8_t address;
+    uint8_t command;
+    uint8_t flags;
+}
+smbus_trace_record_t;
+
+// Each reader keeps its own cursor, zero initialised it starts at the
+// oldest record still held
+typedef struct smbus_trace_cursor_t
+{
+    uint32_t next;
+    uint32_t lost;          // Records overwritten before they were read
+}
+smbus_trace_cursor_t;
+
+typedef struct smbus_queue_stats_t
+{
+    uint32_t overflows;
+    uint32_t high_water;
+}
+smbus_queue_stats_t;
+
+
 typedef void (*quick_handler_t)(bool is_on);
 typedef void (*write_reg_handler_t)(uint8_t reg);
 typedef void (*write_data_handler_t)(uint8_t command, const smbus_data_t* smbus_data);
@@ -38,7 +135,84 @@ typedef uint8_t (*read_reg_handler_t)();
 typedef size_t (*read_data_handler_t)(uint8_t command, smbus_data_t* smbus_data);
 typedef uint16_t (*proc_call_handler_t)(uint8_t command, uint16_t request);
 
+// Block Write-Block Read Process Call: request and response are blocks with
+// the count byte first. Returning false hands a 2 byte request on to the
+// word process call handler.
+typedef bool (*block_proc_call_handler_t)(uint8_t command, const smbus_data_t* request, smbus_data_t* response);
+
+// The same handlers with the ctx given when they were set, e.g. the state
+// of the device on that bus, so one handler can serve both buses
+typedef void (*quick_ctx_handler_t)(bool is_on, void* ctx);
+typedef void (*write_reg_ctx_handler_t)(uint8_t reg, void* ctx);
+typedef void (*write_data_ctx_handler_t)(uint8_t command, const smbus_data_t* smbus_data, void* ctx);
+typedef uint8_t (*read_reg_ctx_handler_t)(void* ctx);
+typedef size_t (*read_data_ctx_handler_t)(uint8_t command, smbus_data_t* smbus_data, void* ctx);
+typedef uint16_t (*proc_call_ctx_handler_t)(uint8_t command, uint16_t request, void* ctx);
+typedef bool (*block_proc_call_ctx_handler_t)(uint8_t command, const smbus_data_t* request, smbus_data_t* response, void* ctx);
 
+// One entry per command byte. Reads and writes of mapped commands are
+// answered from storage by the ISR, on_write (optional) is called like
+// a write data handler once storage was updated.
+typedef struct smbus_reg_t
+{
+    uint8_t type;
+    uint8_t access;
+    uint8_t len;
+    void* storage;
+    write_data_handler_t on_write;
+}
+smbus_reg_t;
+
+// Static initializers, e.g. [0xC2] = SMBUS_REG_FIXED_ENTRY(word, SMBUS_REG_RW, NULL).
+// Block storage holds the count byte first.
+#define SMBUS_REG_FIXED_ENTRY(storage, access, on_write) \
+    { SMBUS_REG_FIXED, (access), sizeof(storage), &(storage), (on_write) }
+
+#define SMBUS_REG_BLOCK_ENTRY(storage, access, on_write) \
+    { SMBUS_REG_BLOCK, (access), sizeof(storage) - 1, (storage), (on_write) }
+
+// Storage is declared as uint8_t storage[SMBUS_REG_BUFFER_SIZE(len)] for
+// up to len bytes: the index of the half readers see, then two halves of
+// count byte and data. Both ISR and smbus_reg_write() write the other
+// half in place and switch readers over once length and PEC were checked,
+// the PEC is never stored. Set initial contents with smbus_reg_write().
+// on_write gets smbus_data pointing at the half just written, whose block
+// runs past SMBUS_MAX_BLOCK_LEN; the write after next reuses it.
+#define SMBUS_REG_BUFFER_SIZE(len) (1 + 2 * (1 + (len)))
+
+#define SMBUS_REG_BUFFER_ENTRY(storage, access, on_write) \
+    { SMBUS_REG_BUFFER, (access), SMBUS_REG_BUFFER_LEN(storage), (storage), (on_write) }
+
+// len is a uint8_t, larger storage would wrap around
+#define SMBUS_REG_BUFFER_LEN_MESSAGE \
+    "SMBUS_REG_BUFFER_ENTRY storage must be SMBUS_REG_BUFFER_SIZE(len), len up to SMBUS_MAX_BUFFER_LEN"
+
+#define SMBUS_REG_BUFFER_IS_SIZE(size) \
+    ((size) >= SMBUS_REG_BUFFER_SIZE(0) && (size) <= SMBUS_REG_BUFFER_SIZE(SMBUS_MAX_BUFFER_LEN) && (size) % 2 == 1)
+
+#ifdef __cplusplus
+extern "C++" template <size_t storage_size>
+constexpr uint8_t smbus_reg_buffer_len()
+{
+    static_assert(SMBUS_REG_BUFFER_IS_SIZE(storage_size), SMBUS_REG_BUFFER_LEN_MESSAGE);
+
+    return (storage_size - SMBUS_REG_BUFFER_SIZE(0)) / 2;
+}
+
+#define SMBUS_REG_BUFFER_LEN(storage) smbus_reg_buffer_len<sizeof(storage)>()
+#else
+#define SMBUS_REG_BUFFER_LEN(storage) ((uint8_t)((sizeof(storage) - SMBUS_REG_BUFFER_SIZE(0)) / 2 + \
+    0 * sizeof(struct {                                                                         \
+        _Static_assert(SMBUS_REG_BUFFER_IS_SIZE(sizeof(storage)), SMBUS_REG_BUFFER_LEN_MESSAGE); \
+        char c; })))
+#endif
+
+
+// The bus IRQ is registered and enabled on the calling core, so ISR and
+// handlers run on whichever core calls this, e.g. core1 when launched from
+// multicore_launch_core1(). The functions below that mask the IRQ for a
+// moment (notify and alert) must be called from that core too; the others
+// may be called from either core.
 void smbus_slave_init(
     i2c_inst_t* i2c, 
     uint8_t address, 
@@ -58,12 +232,89 @@ void smbus_set_write_data_handler(i2c_inst_t* i2c, write_data_handler_t handler)
 void smbus_set_read_reg_handler(i2c_inst_t* i2c, read_reg_handler_t handler);
 void smbus_set_read_data_handler(i2c_inst_t* i2c, read_data_handler_t handler);
 void smbus_set_proc_call_handler(i2c_inst_t* i2c, proc_call_handler_t handler);
+void smbus_set_block_proc_call_handler(i2c_inst_t* i2c, block_proc_call_handler_t handler);
+
+// Either kind replaces the other for its event. Replace a handler during
+// traffic from the bus core only: from the other core, a handler the ISR
+// is just about to call may get the new ctx.
+void smbus_set_quick_ctx_handler(i2c_inst_t* i2c, quick_ctx_handler_t handler, void* ctx);
+void smbus_set_write_reg_ctx_handler(i2c_inst_t* i2c, write_reg_ctx_handler_t handler, void* ctx);
+void smbus_set_write_data_ctx_handler(i2c_inst_t* i2c, write_data_ctx_handler_t handler, void* ctx);
+void smbus_set_read_reg_ctx_handler(i2c_inst_t* i2c, read_reg_ctx_handler_t handler, void* ctx);
+void smbus_set_read_data_ctx_handler(i2c_inst_t* i2c, read_data_ctx_handler_t handler, void* ctx);
+void smbus_set_proc_call_ctx_handler(i2c_inst_t* i2c, proc_call_ctx_handler_t handler, void* ctx);
+void smbus_set_block_proc_call_ctx_handler(i2c_inst_t* i2c, block_proc_call_ctx_handler_t handler, void* ctx);
 
 void smbus_reset_handler(i2c_inst_t* i2c, smbus_slave_event_t slave_event);
 
 void smbus_set_pec(i2c_inst_t* i2c, bool is_enabled);
 bool smbus_get_pec(i2c_inst_t* i2c);
 
+// RX_FULL fires once rx_threshold bytes (1-16) are buffered, TX_EMPTY once
+// tx_threshold bytes (0-15) or fewer are left. Bytes below the RX threshold
+// are picked up at RESTART/STOP.
+void smbus_set_fifo_thresholds(i2c_inst_t* i2c, uint rx_threshold, uint tx_threshold);
+
+// Claims a DMA channel pair for block transfers; false if none are free
+bool smbus_set_dma(i2c_inst_t* i2c, bool is_enabled);
+bool smbus_get_dma(i2c_inst_t* i2c);
+
+// Quick, write reg and write data handlers are queued by the ISR and run by
+// smbus_dispatch() on the calling thread. Read and process call handlers
+// produce the response and keep running in interrupt context, and so does
+// on_write of SMBUS_REG_BUFFER entries, whose half the write after next reuses.
+void smbus_set_deferred(i2c_inst_t* i2c, bool is_enabled);
+bool smbus_get_deferred(i2c_inst_t* i2c);
+
+// Runs the queued handlers, returns how many were run
+size_t smbus_dispatch(i2c_inst_t* i2c);
+void smbus_get_queue_stats(i2c_inst_t* i2c, smbus_queue_stats_t* stats);
+
+// Reads of command are answered from a copy of data (the count byte
+// included for blocks) with its PEC computed here, without calling
+// read_data_handler. Publish after smbus_slave_init() from a single
+// thread; the ISR never blocks on it. False if all slots are taken.
+bool smbus_publish(i2c_inst_t* i2c, uint8_t command, const void* data, size_t data_len);
+void smbus_unpublish(i2c_inst_t* i2c, uint8_t command);
+
+// regmap has 256 entries (or is NULL) and is not copied, so it can be a
+// const table in flash. Unmapped commands go to the handlers.
+void smbus_set_regmap(i2c_inst_t* i2c, const smbus_reg_t* regmap);
+
+// Access a mapped register from thread context on either core, e.g. for
+// remote access. Storage is copied under a hardware spin lock the ISR
+// takes as well when it copies fixed and block registers, so neither side
+// sees half a write of those. SMBUS_REG_BUFFER entries are written into
+// the half readers do not see; while a bus transfer still uses that half,
+// the write waits for its STOP. The entry's access and length are checked
+// as for a bus transaction, and a write calls on_write from here.
+// Read returns the bytes copied, 0 if it was refused.
+size_t smbus_reg_read(i2c_inst_t* i2c, uint8_t command, void* data, size_t data_max);
+bool smbus_reg_write(i2c_inst_t* i2c, uint8_t command, const void* data, size_t data_len);
+
+// Sends status to the host at SMBUS_HOST_NOTIFY_ADDRESS in master mode,
+// retrying when arbitration is lost. Blocks for the transfer with this
+// bus's interrupt disabled, so call it from thread context.
+smbus_notify_result_t smbus_notify_host(i2c_inst_t* i2c, uint16_t status);
+
+// SMBALERT# on alert_pin, which needs to be wired to the host's open drain
+// alert line. smbus_alert_host() pulls it low and the slave answers at
+// SMBUS_ALERT_RESPONSE_ADDRESS instead of its own address until the host
+// has read its address from there.
+void smbus_set_alert(i2c_inst_t* i2c, bool is_enabled, uint alert_pin);
+bool smbus_get_alert(i2c_inst_t* i2c);
+smbus_notify_result_t smbus_alert_host(i2c_inst_t* i2c);
+bool smbus_is_alert_raised(i2c_inst_t* i2c);
+
+// A snapshot, each counter is consistent on its own. Handler time covers
+// handlers called from the ISR, not those run by smbus_dispatch().
+void smbus_get_stats(i2c_inst_t* i2c, smbus_stats_t* stats);
+void smbus_reset_stats(i2c_inst_t* i2c);
+
+// Copies up to max_records records past cursor without blocking the ISR,
+// returns how many. Always 0 with SMBUS_TRACE_LEN 0.
+size_t smbus_trace_read(smbus_trace_cursor_t* cursor, smbus_trace_record_t records[], size_t max_records);
+
 
 #ifdef __cplusplus
 }
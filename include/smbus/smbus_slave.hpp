@@ -0,0 +1,214 @@
+#ifndef PICO_SMBUS_SLAVE_HPP
+#define PICO_SMBUS_SLAVE_HPP
+
+#include <smbus/smbus_slave.h>
+#include <cassert>
+#include <type_traits>
+#include <utility>
+
+namespace smbus
+{
+
+namespace detail
+{
+
+// Handlers a device may implement, detected at compile time
+#define SMBUS_DETAIL_HAS_HANDLER(name, ...)                                     \
+    template <typename T, typename = void>                                      \
+    struct has_##name : std::false_type {};                                     \
+                                                                                \
+    template <typename T>                                                       \
+    struct has_##name<T, std::void_t<decltype(std::declval<T&>().name(__VA_ARGS__))>> \
+        : std::true_type {};
+
+SMBUS_DETAIL_HAS_HANDLER(on_quick, bool())
+SMBUS_DETAIL_HAS_HANDLER(on_write_reg, uint8_t())
+SMBUS_DETAIL_HAS_HANDLER(on_write_data, uint8_t(), std::declval<const smbus_data_t&>())
+SMBUS_DETAIL_HAS_HANDLER(on_read_reg)
+SMBUS_DETAIL_HAS_HANDLER(on_read_data, uint8_t(), std::declval<smbus_data_t&>())
+SMBUS_DETAIL_HAS_HANDLER(on_proc_call, uint8_t(), uint16_t())
+SMBUS_DETAIL_HAS_HANDLER(on_block_proc_call, uint8_t(), std::declval<const smbus_data_t&>(), std::declval<smbus_data_t&>())
+
+#undef SMBUS_DETAIL_HAS_HANDLER
+
+} // namespace detail
+
+
+// Binds the members of Device that handle SMBus events to bus I2cIndex:
+//
+//   void on_quick(bool is_on);
+//   void on_write_reg(uint8_t reg);
+//   void on_write_data(uint8_t command, const smbus_data_t& data);
+//   uint8_t on_read_reg();
+//   size_t on_read_data(uint8_t command, smbus_data_t& data);
+//   uint16_t on_proc_call(uint8_t command, uint16_t request);
+//   bool on_block_proc_call(uint8_t command, const smbus_data_t& request, smbus_data_t& response);
+//
+// Each one that Device implements gets its own static trampoline, into
+// which the member is inlined, and only those are registered with the C
+// API, with the object as their ctx. The device is held by the object,
+// one object per bus at a time.
+template <uint I2cIndex, typename Device>
+class SmbusSlave
+{
+    static_assert(I2cIndex < 2, "RP2040 has i2c0 and i2c1");
+
+public:
+    template <typename... Args>
+    explicit SmbusSlave(Args&&... args)
+        : device_(std::forward<Args>(args)...)
+    {}
+
+    ~SmbusSlave()
+    {
+        if(is_initialized_)
+        {
+            deinit();
+        }
+    }
+
+    SmbusSlave(const SmbusSlave&) = delete;
+    SmbusSlave& operator=(const SmbusSlave&) = delete;
+
+    static i2c_inst_t* i2c()
+    {
+        return I2cIndex == 0 ? i2c0 : i2c1;
+    }
+
+    // The IRQ is taken by the calling core, as with smbus_slave_init()
+    void init(uint8_t address, uint baudrate, uint sda_pin, uint scl_pin)
+    {
+        assert(!is_initialized_);
+
+        is_initialized_ = true;
+        smbus_slave_init(i2c(), address, baudrate, sda_pin, scl_pin);
+
+        if constexpr (detail::has_on_quick<Device>::value)
+        {
+            smbus_set_quick_ctx_handler(i2c(), quick, this);
+        }
+
+        if constexpr (detail::has_on_write_reg<Device>::value)
+        {
+            smbus_set_write_reg_ctx_handler(i2c(), write_reg, this);
+        }
+
+        if constexpr (detail::has_on_write_data<Device>::value)
+        {
+            smbus_set_write_data_ctx_handler(i2c(), write_data, this);
+        }
+
+        if constexpr (detail::has_on_read_reg<Device>::value)
+        {
+            smbus_set_read_reg_ctx_handler(i2c(), read_reg, this);
+        }
+
+        if constexpr (detail::has_on_read_data<Device>::value)
+        {
+            smbus_set_read_data_ctx_handler(i2c(), read_data, this);
+        }
+
+        if constexpr (detail::has_on_proc_call<Device>::value)
+        {
+            smbus_set_proc_call_ctx_handler(i2c(), proc_call, this);
+        }
+
+        if constexpr (detail::has_on_block_proc_call<Device>::value)
+        {
+            smbus_set_block_proc_call_ctx_handler(i2c(), block_proc_call, this);
+        }
+    }
+
+    void deinit()
+    {
+        assert(is_initialized_);
+
+        smbus_slave_deinit(i2c());
+        is_initialized_ = false;
+    }
+
+    Device& device()
+    {
+        return device_;
+    }
+
+    const Device& device() const
+    {
+        return device_;
+    }
+
+    // The rest of the C API takes i2c()
+    void set_pec(bool is_enabled)
+    {
+        smbus_set_pec(i2c(), is_enabled);
+    }
+
+    void set_deferred(bool is_enabled)
+    {
+        smbus_set_deferred(i2c(), is_enabled);
+    }
+
+    size_t dispatch()
+    {
+        return smbus_dispatch(i2c());
+    }
+
+    void set_regmap(const smbus_reg_t* regmap)
+    {
+        smbus_set_regmap(i2c(), regmap);
+    }
+
+    bool publish(uint8_t command, const void* data, size_t data_len)
+    {
+        return smbus_publish(i2c(), command, data, data_len);
+    }
+
+    void get_stats(smbus_stats_t& stats)
+    {
+        smbus_get_stats(i2c(), &stats);
+    }
+
+private:
+    // Called from the ISR, kept out of flash like the rest of the hot path
+    static void __not_in_flash_func(quick)(bool is_on, void* ctx)
+    {
+        static_cast<SmbusSlave*>(ctx)->device_.on_quick(is_on);
+    }
+
+    static void __not_in_flash_func(write_reg)(uint8_t reg, void* ctx)
+    {
+        static_cast<SmbusSlave*>(ctx)->device_.on_write_reg(reg);
+    }
+
+    static void __not_in_flash_func(write_data)(uint8_t command, const smbus_data_t* smbus_data, void* ctx)
+    {
+        static_cast<SmbusSlave*>(ctx)->device_.on_write_data(command, *smbus_data);
+    }
+
+    static uint8_t __not_in_flash_func(read_reg)(void* ctx)
+    {
+        return static_cast<SmbusSlave*>(ctx)->device_.on_read_reg();
+    }
+
+    static size_t __not_in_flash_func(read_data)(uint8_t command, smbus_data_t* smbus_data, void* ctx)
+    {
+        return static_cast<SmbusSlave*>(ctx)->device_.on_read_data(command, *smbus_data);
+    }
+
+    static uint16_t __not_in_flash_func(proc_call)(uint8_t command, uint16_t request, void* ctx)
+    {
+        return static_cast<SmbusSlave*>(ctx)->device_.on_proc_call(command, request);
+    }
+
+    static bool __not_in_flash_func(block_proc_call)(uint8_t command, const smbus_data_t* request, smbus_data_t* response, void* ctx)
+    {
+        return static_cast<SmbusSlave*>(ctx)->device_.on_block_proc_call(command, *request, *response);
+    }
+
+    Device device_;
+    bool is_initialized_ = false;
+};
+
+} // namespace smbus
+
+#endif // PICO_SMBUS_SLAVE_HPP
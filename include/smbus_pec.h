@@ -5,7 +5,20 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#define SMBUS_PEC_KERNEL_BYTEWISE   0   // 256-byte table, one lookup per byte
+#define SMBUS_PEC_KERNEL_SLICE4     1   // 1 KiB of tables, four bytes per step
+#define SMBUS_PEC_KERNEL_NIBBLE     2   // 32-byte tables, two lookups per byte
+
+// Kernel behind smbus_pec_block
+#ifndef SMBUS_PEC_KERNEL
+#define SMBUS_PEC_KERNEL SMBUS_PEC_KERNEL_SLICE4
+#endif
+
 uint8_t smbus_pec_single(uint8_t crc, uint8_t data);
-uint8_t smbus_pec_block(uint8_t crc, uint8_t block[], size_t block_len);
+uint8_t smbus_pec_block(uint8_t crc, const uint8_t block[], size_t block_len);
+
+uint8_t smbus_pec_block_bytewise(uint8_t crc, const uint8_t block[], size_t block_len);
+uint8_t smbus_pec_block_slice4(uint8_t crc, const uint8_t block[], size_t block_len);
+uint8_t smbus_pec_block_nibble(uint8_t crc, const uint8_t block[], size_t block_len);
 
-#endif // SMBUS_PEC_H
\ No newline at end of file
+#endif // SMBUS_PEC_H
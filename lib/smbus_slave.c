@@ -1,476 +1,2285 @@
 #include <smbus/smbus_slave.h>
 #include <hardware/irq.h>
 #include <hardware/gpio.h> 
+#include <hardware/dma.h>
+#include <hardware/sync.h>
+#include <hardware/claim.h>
+#include <hardware/clocks.h>
+#include <hardware/timer.h>
+#include <hardware/structs/systick.h>
 #include <smbus_pec.h>
 #include <string.h>
 
-#include <stdio.h>
-
 #define SMBUS_MIN_BAUD_RATE_HZ _u(10000)
-#define SMBUS_MAX_BAUD_RATE_HZ _u(100000)
+#define SMBUS_MAX_BAUD_RATE_HZ _u(1000000)
+
+#define SMBUS_FIFO_DEPTH 16
+
+// Shorter transfers stay on the interrupt path, arming DMA costs more
+#ifndef SMBUS_DMA_MIN_LEN
+#define SMBUS_DMA_MIN_LEN 8
+#endif
+
+// Completed write transactions held for smbus_dispatch(), a power of two
+#ifndef SMBUS_QUEUE_LEN
+#define SMBUS_QUEUE_LEN 8
+#endif
+
+// Host Notify attempts when arbitration is lost, and the SMBus t_TIMEOUT
+// bound for each of them
+#ifndef SMBUS_NOTIFY_RETRIES
+#define SMBUS_NOTIFY_RETRIES 3
+#endif
+
+#ifndef SMBUS_NOTIFY_TIMEOUT_US
+#define SMBUS_NOTIFY_TIMEOUT_US 35000
+#endif
+
+// IC_DATA_CMD with FIRST_DATA_BYTE, which i2c_read_byte_raw() drops
+#ifndef smbus_i2c_read_data_cmd
+#define smbus_i2c_read_data_cmd(i2c) (i2c_get_hw(i2c)->data_cmd)
+#endif
+
+static_assert((SMBUS_QUEUE_LEN & (SMBUS_QUEUE_LEN - 1)) == 0, "SMBUS_QUEUE_LEN must be a power of two");
+static_assert((SMBUS_TRACE_LEN & (SMBUS_TRACE_LEN - 1)) == 0, "SMBUS_TRACE_LEN must be a power of two");
+
+typedef struct smbus_queue_entry_t
+{
+    smbus_slave_event_t event;
+    uint8_t cmd_byte;
+    bool is_quick_on;
+    smbus_data_t smbus_data;
+}
+smbus_queue_entry_t;
+
+// Single producer (the ISR) and single consumer (smbus_dispatch): head is
+// only written by the former and tail by the latter
+typedef struct smbus_queue_t
+{
+    smbus_queue_entry_t entries[SMBUS_QUEUE_LEN];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    uint32_t overflows;
+    uint32_t high_water;
+}
+smbus_queue_t;
+
+// Commands whose responses can be published with smbus_publish()
+#ifndef SMBUS_CACHE_SLOTS
+#define SMBUS_CACHE_SLOTS 8
+#endif
+
+typedef struct smbus_cache_buffer_t
+{
+    uint8_t data_len;
+    uint8_t pec;
+    uint8_t data[sizeof(smbus_data_t) - 1];
+}
+smbus_cache_buffer_t;
+
+// Latched seqlock: readers take buffers[seq & 1], which the writer never
+// touches while seq points at it, so the ISR never has to wait for it
+typedef struct smbus_cache_slot_t
+{
+    volatile uint32_t seq;
+    smbus_cache_buffer_t buffers[2];
+}
+smbus_cache_slot_t;
+
+// A handler set with or without a ctx, is_ctx tells which one, so a
+// plain handler is called directly. Either pointer being NULL means unset.
+#define SMBUS_SLAVE_HANDLER_TYPE(name)      \
+    typedef struct                          \
+    {                                       \
+        union                               \
+        {                                   \
+            name##_handler_t plain;         \
+            name##_ctx_handler_t with_ctx;  \
+        };                                  \
+        void* ctx;                          \
+        bool is_ctx;                        \
+    }                                       \
+    smbus_slave_##name##_handler_t
+
+SMBUS_SLAVE_HANDLER_TYPE(quick);
+SMBUS_SLAVE_HANDLER_TYPE(write_reg);
+SMBUS_SLAVE_HANDLER_TYPE(write_data);
+SMBUS_SLAVE_HANDLER_TYPE(read_reg);
+SMBUS_SLAVE_HANDLER_TYPE(read_data);
+SMBUS_SLAVE_HANDLER_TYPE(proc_call);
+SMBUS_SLAVE_HANDLER_TYPE(block_proc_call);
+
+// Arguments are the handler's own, the ctx is appended for a ctx handler
+#define SMBUS_SLAVE_CALL_HANDLER(handler, ...)                  \
+    ((handler).is_ctx                                           \
+        ? (handler).with_ctx(__VA_ARGS__, (handler).ctx)        \
+        : (handler).plain(__VA_ARGS__))
 
 typedef struct smbus_slave_t
 {
-    quick_handler_t quick_handler;
-    write_reg_handler_t write_reg_handler;
-    write_data_handler_t write_data_handler;
-    read_reg_handler_t read_reg_handler;
-    read_data_handler_t read_data_handler;
-    proc_call_handler_t proc_call_handler;
+    smbus_slave_quick_handler_t quick_handler;
+    smbus_slave_write_reg_handler_t write_reg_handler;
+    smbus_slave_write_data_handler_t write_data_handler;
+    smbus_slave_read_reg_handler_t read_reg_handler;
+    smbus_slave_read_data_handler_t read_data_handler;
+    smbus_slave_proc_call_handler_t proc_call_handler;
+    smbus_slave_block_proc_call_handler_t block_proc_call_handler;
     bool is_pec_enabled;
 
+    // Cached from IC_SAR, which answers at the Alert Response Address
+    // while an alert is raised: the address bytes and the PEC seeded
+    // with them, so the ISR neither reads SAR nor folds them in
+    i2c_hw_t* hw;
+    uint8_t write_address;
+    uint8_t read_address;
+    uint8_t write_address_crc;
+    uint8_t read_address_crc;
+
+    uint8_t address;
     uint scl_pin;
     uint sda_pin;
+
+    bool is_alert_enabled;
+    uint alert_pin;
+    volatile bool is_alert_raised;
+    bool is_alert_answered;
     
+    bool is_started;        // START served, STOP not yet
     bool is_cmd_received;
+    bool is_rx_held;        // rx_held_byte opens the next transaction
+    uint8_t rx_held_byte;
     bool is_cmd_sent;
     bool is_restarted;
     bool is_quick_on;
     
     uint8_t cmd_byte;
     smbus_data_t smbus_data;
-    uint8_t io_next_byte;
+    smbus_data_t response_data;
+    // Also pins a half of an SMBUS_REG_BUFFER entry against smbus_reg_write()
+    uint8_t* io_buffer;
+    bool is_io_buffer_reg;
+    uint16_t io_capacity;
+    uint16_t io_next_byte;
+    uint16_t io_data_len;
+    uint16_t io_dirty_len;
+    uint8_t crc;
+
+    bool is_dma_enabled;
+    uint dma_rx_channel;
+    uint dma_tx_channel;
+    uint16_t dma_rx_len;
+    uint8_t dma_rx_tl;
+    uint16_t dma_tx_buffer[sizeof(smbus_data_t)];
+
+    bool is_deferred;
+    smbus_queue_t queue;
+
+    const smbus_reg_t* regmap;
+    spin_lock_t* regmap_lock;
+    uint core_num;
+
+    smbus_stats_t stats;
+    smbus_slave_event_t read_event;
+    uint32_t cycles_per_us;
+
+    bool is_pec_precomputed;
+    volatile uint8_t cache_map[256];
+    smbus_cache_slot_t cache_slots[SMBUS_CACHE_SLOTS];
+
+#if SMBUS_TRACE_LEN > 0
+    uint32_t trace_start_us;
+    uint32_t trace_handler_cycles;
+#endif
 }
 smbus_slave_t;
 
 static smbus_slave_t smbus_slaves[2];
 
+// i2c_get_instance() is only static inline, an out of line copy of it
+// would be called from flash
+static __force_inline i2c_inst_t* smbus_slave_i2c(uint bus_index)
+{
+    return bus_index == 0 ? i2c0 : i2c1;
+}
+
+// SMBUS_REG_BUFFER storage: the index of the half readers see, then the
+// halves of count byte and data
+#define SMBUS_REG_BUFFER_LIVE(reg) (((volatile uint8_t*)(reg)->storage)[0])
+
+static __force_inline uint8_t* smbus_reg_buffer_half(const smbus_reg_t* reg, uint half)
+{
+    return (uint8_t*)reg->storage + 1 + half * (reg->len + 1);
+}
+
+static inline uint32_t smbus_slave_cycles(void)
+{
+    return systick_hw->cvr;
+}
+
+static inline uint32_t smbus_slave_cycles_since(uint32_t start_cycles)
+{
+    uint32_t now_cycles = systick_hw->cvr;
+
+    // SysTick counts down and reloads from RVR, which an RTOS may have set
+    if(now_cycles <= start_cycles)
+    {
+        return start_cycles - now_cycles;
+    }
+
+    return start_cycles + (systick_hw->rvr & M0PLUS_SYST_RVR_BITS) + 1 - now_cycles;
+}
+
+static inline uint smbus_stats_bucket(uint32_t cycles)
+{
+    uint bucket = (cycles == 0) ? 0 : 32 - __builtin_clz(cycles);
+
+    return MIN(bucket, SMBUS_STATS_BUCKETS - 1);
+}
+
+
+#if SMBUS_TRACE_LEN > 0
+
+// The ISR keeps raw cycles, the reader turns them into handler_us so the
+// ISR never divides
+typedef struct smbus_trace_entry_t
+{
+    smbus_trace_record_t record;
+    uint32_t handler_cycles;
+}
+smbus_trace_entry_t;
+
+// Written by the I2C ISRs, which may run on different cores, under the
+// spin lock. Readers take no lock, they detect overwritten records through
+// head.
+typedef struct smbus_trace_t
+{
+    smbus_trace_entry_t entries[SMBUS_TRACE_LEN];
+    volatile uint32_t head;
+    spin_lock_t* lock;
+}
+smbus_trace_t;
+
+static smbus_trace_t smbus_trace;
+
+static inline void smbus_slave_trace_init(void)
+{
+    // The first bus to be initialised claims it, on whichever core
+    uint32_t token = hw_claim_lock();
+
+    if(smbus_trace.lock == NULL)
+    {
+        smbus_trace.lock = spin_lock_instance(spin_lock_claim_unused(true));
+    }
+
+    hw_claim_unlock(token);
+}
+
+static inline void smbus_slave_trace_start(uint bus_index)
+{
+    smbus_slaves[bus_index].trace_start_us = time_us_32();
+}
+
+static inline void smbus_slave_trace_handler(uint bus_index, uint32_t cycles)
+{
+    smbus_slaves[bus_index].trace_handler_cycles += cycles;
+}
+
+static inline void smbus_slave_trace_stop(uint bus_index, bool is_pec_error)
+{
+    smbus_slave_t* slave = &smbus_slaves[bus_index];
+    uint8_t flags = 0;
+
+    if(slave->is_cmd_received)
+    {
+        flags |= SMBUS_TRACE_WRITE;
+    }
+
+    if(slave->is_restarted || slave->is_cmd_sent || slave->is_quick_on)
+    {
+        flags |= SMBUS_TRACE_READ;
+    }
+
+    if(slave->is_pec_enabled)
+    {
+        flags |= SMBUS_TRACE_PEC;
+    }
+
+    if(is_pec_error)
+    {
+        flags |= SMBUS_TRACE_PEC_ERROR;
+    }
+
+    // Both ISRs share a priority, so this core never preempts the holder
+    spin_lock_unsafe_blocking(smbus_trace.lock);
+
+    uint32_t head = smbus_trace.head;
+    smbus_trace_entry_t* entry = &smbus_trace.entries[head % SMBUS_TRACE_LEN];
+    smbus_trace_record_t* record = &entry->record;
+
+    record->timestamp_us = slave->trace_start_us;
+    record->data_len = slave->is_restarted ? slave->io_data_len : slave->io_next_byte;
+    entry->handler_cycles = slave->trace_handler_cycles;
+    record->bus_index = (uint8_t)bus_index;
+    record->address = slave->write_address >> 1;
+    record->command = slave->cmd_byte;
+    record->flags = flags;
+
+    // Publish the record before readers can see the new head
+    __mem_fence_release();
+    smbus_trace.head = head + 1;
+
+    spin_unlock_unsafe(smbus_trace.lock);
+
+    slave->trace_handler_cycles = 0;
+}
+
+#else
+
+static inline void smbus_slave_trace_init(void)
+{}
+
+static inline void smbus_slave_trace_start(uint bus_index)
+{}
+
+static inline void smbus_slave_trace_handler(uint bus_index, uint32_t cycles)
+{}
+
+static inline void smbus_slave_trace_stop(uint bus_index, bool is_pec_error)
+{}
+
+#endif // SMBUS_TRACE_LEN > 0
+
+static inline void smbus_slave_handler_done(uint bus_index, uint32_t start_cycles)
+{
+    uint32_t cycles = smbus_slave_cycles_since(start_cycles);
+
+    smbus_slaves[bus_index].stats.handler_cycles[smbus_stats_bucket(cycles)] += 1;
+    smbus_slave_trace_handler(bus_index, cycles);
+}
+
 static void __isr __not_in_flash_func(smbus_slave_irq_restart)(uint bus_index);
 static void __isr __not_in_flash_func(smbus_slave_irq_start)(uint bus_index);
 static void __isr __not_in_flash_func(smbus_slave_irq_stop)(uint bus_index);
 static void __isr __not_in_flash_func(smbus_slave_irq_tx_abrt)(uint bus_index);
 static void __isr __not_in_flash_func(smbus_slave_irq_rx_full)(uint bus_index);
 static void __isr __not_in_flash_func(smbus_slave_irq_rd_req)(uint bus_index);
-static void __isr __not_in_flash_func(smbus_slave_irq_handler)(void);
+static void __isr __not_in_flash_func(smbus_slave_irq_tx_empty)(uint bus_index);
+static void __isr __not_in_flash_func(smbus_slave_irq_handler_0)(void);
+static void __isr __not_in_flash_func(smbus_slave_irq_handler_1)(void);
+static __force_inline void smbus_slave_irq_handler(uint bus_index);
+static __force_inline void smbus_slave_irq_dispatch(uint bus_index);
 
 static void smbus_init_i2c_gpio(uint gpio);
-static uint8_t smbus_get_unshifted_address(uint bus_index, bool readwrite_bit);
+static void __not_in_flash_func(smbus_slave_rx_drain)(uint bus_index);
+static __force_inline void smbus_slave_rx_byte(uint bus_index, uint8_t rx_byte);
+static __force_inline void smbus_slave_irq_stop_all(uint bus_index);
+static size_t __not_in_flash_func(smbus_slave_tx_fill)(uint bus_index);
+static void __not_in_flash_func(smbus_slave_dma_rx_start)(uint bus_index);
+static void __not_in_flash_func(smbus_slave_dma_rx_finish)(uint bus_index);
+static bool __not_in_flash_func(smbus_slave_dma_tx_start)(uint bus_index);
+static void __not_in_flash_func(smbus_slave_dma_tx_finish)(uint bus_index);
+static void __not_in_flash_func(smbus_slave_write_event)(uint bus_index, smbus_slave_event_t event);
+static bool __not_in_flash_func(smbus_slave_cache_read)(uint bus_index);
+static const smbus_reg_t* __not_in_flash_func(smbus_slave_get_reg)(uint bus_index);
+static void __not_in_flash_func(smbus_slave_reg_read)(uint bus_index, const smbus_reg_t* reg);
+static bool __not_in_flash_func(smbus_slave_reg_write)(uint bus_index, const smbus_reg_t* reg);
+static void __not_in_flash_func(smbus_slave_rx_buffer)(uint bus_index);
+static void __not_in_flash_func(smbus_slave_mark_dirty)(uint bus_index, size_t data_len);
+static bool __not_in_flash_func(smbus_slave_block_proc_call)(uint bus_index);
+static void __not_in_flash_func(smbus_slave_set_address)(uint bus_index, uint8_t address);
+static void __not_in_flash_func(smbus_slave_cache_address)(uint bus_index, uint8_t address);
+static smbus_notify_result_t smbus_master_write(i2c_inst_t* i2c, uint8_t address, const uint8_t data[], size_t data_len);
+static smbus_slave_write_data_handler_t __not_in_flash_func(smbus_slave_get_write_data_handler)(uint bus_index, uint8_t command);
 
 
 void smbus_slave_irq_restart(uint bus_index)
 {
     smbus_slave_t* slave = &smbus_slaves[bus_index];
 
-    if(slave->io_next_byte == 0)
+    // A byte held for a pending STOP came after this repeated START and
+    // belongs to the transaction still open
+    if(slave->is_rx_held)
+    {
+        slave->is_rx_held = false;
+        smbus_slave_rx_byte(bus_index, slave->rx_held_byte);
+    }
+
+    // Bytes below the RX threshold have not raised RX_FULL yet
+    smbus_slave_rx_drain(bus_index);
+
+    slave->read_event = SMBUS_SLAVE_READ_DATA;
+
+    // Published and mapped responses are served without calling the handler
+    if(slave->io_next_byte == 0 && !smbus_slave_cache_read(bus_index))
     {
-        if(slave->read_data_handler != NULL)
+        const smbus_reg_t* reg = smbus_slave_get_reg(bus_index);
+
+        if(reg != NULL)
         {
-            size_t data_len = slave->read_data_handler(slave->cmd_byte, &slave->smbus_data);
+            smbus_slave_reg_read(bus_index, reg);
+        }
+        else
+        if(slave->read_data_handler.plain != NULL)
+        {
+            uint32_t handler_cycles = smbus_slave_cycles();
+            size_t data_len = SMBUS_SLAVE_CALL_HANDLER(slave->read_data_handler, slave->cmd_byte, &slave->smbus_data);
 
-            if(slave->is_pec_enabled)
-            {
-                uint8_t read_address = smbus_get_unshifted_address(bus_index, true);
-                uint8_t write_address = smbus_get_unshifted_address(bus_index, false);
-                uint8_t crc = 0;
+            smbus_slave_handler_done(bus_index, handler_cycles);
 
-                crc = smbus_pec_single(crc, write_address);
-                crc = smbus_pec_single(crc, slave->cmd_byte);
-                crc = smbus_pec_single(crc, read_address);
-                crc = smbus_pec_block(crc, slave->smbus_data.block, data_len);
+            // Leave room for the PEC byte
+            slave->io_data_len = MIN(data_len, sizeof(smbus_data_t) - 1);
+            smbus_slave_mark_dirty(bus_index, sizeof(smbus_data_t));
+        }
 
-                slave->smbus_data.block[data_len] = crc;
-            }
+        if(slave->io_data_len == 0)
+        {
+            slave->stats.unknown_commands += 1;
         }
     }
     else
-    if(slave->io_next_byte == 2)
+    if(slave->io_next_byte > 0 && slave->io_buffer == slave->smbus_data.block)
     {
-        if(slave->proc_call_handler != NULL)
+        // Commands the block handler turns down may still be word process calls
+        if(smbus_slave_block_proc_call(bus_index))
+        {
+            slave->read_event = SMBUS_SLAVE_BLOCK_PROC_CALL;
+        }
+        else
+        if(slave->io_next_byte == 2 && slave->proc_call_handler.plain != NULL)
         {
+            slave->read_event = SMBUS_SLAVE_PROC_CALL;
+
+            uint32_t handler_cycles = smbus_slave_cycles();
             uint16_t request = slave->smbus_data.word;
-            uint16_t response = slave->proc_call_handler(slave->cmd_byte, request);
-            
-            if(slave->is_pec_enabled)
-            {
-                uint8_t read_address = smbus_get_unshifted_address(bus_index, true);
-                uint8_t write_address = smbus_get_unshifted_address(bus_index, false);
-                uint8_t crc = 0;
-
-                crc = smbus_pec_single(crc, write_address);
-                crc = smbus_pec_single(crc, slave->cmd_byte);
-                crc = smbus_pec_block(crc, slave->smbus_data.block, slave->io_next_byte);
-                slave->smbus_data.word = response;
-                crc = smbus_pec_single(crc, read_address);
-                crc = smbus_pec_block(crc, slave->smbus_data.block, slave->io_next_byte);
-
-                slave->smbus_data.block[slave->io_next_byte] = crc;
-            }
-            else
-            {
-                slave->smbus_data.word = response;
-            }
+            uint16_t response = SMBUS_SLAVE_CALL_HANDLER(slave->proc_call_handler, slave->cmd_byte, request);
 
+            smbus_slave_handler_done(bus_index, handler_cycles);
+
+            slave->smbus_data.word = response;
+            slave->io_data_len = sizeof(uint16_t);
             slave->io_next_byte = 0;
         }
+        else
+        {
+            slave->stats.unknown_commands += 1;
+        }
+    }
+
+    if(slave->is_pec_enabled && !slave->is_pec_precomputed)
+    {
+        slave->crc = smbus_pec_single(slave->crc, slave->read_address);
     }
 
     slave->is_restarted = true;
 }
 
 void smbus_slave_irq_start(uint bus_index)
-{}
+{
+    smbus_slaves[bus_index].is_started = true;
+    smbus_slave_trace_start(bus_index);
+}
 
 void smbus_slave_irq_tx_abrt(uint bus_index)
-{}
+{
+    i2c_hw_t* hw = smbus_slaves[bus_index].hw;
+
+    // Bytes left over after a master NACK or early STOP are flushed by the
+    // hardware once the next read command arrives. Nothing of the current
+    // transaction has been queued at that point, so only stop topping up.
+    hw_clear_bits(&hw->intr_mask, I2C_IC_INTR_MASK_M_TX_EMPTY_BITS);
+    smbus_slave_dma_tx_finish(bus_index);
+
+    smbus_slaves[bus_index].stats.tx_aborts += 1;
+
+    // A device with a lower address won the Alert Response Address read,
+    // keep SMBALERT# asserted for the next one
+    if(hw->tx_abrt_source & I2C_IC_TX_ABRT_SOURCE_ABRT_SLV_ARBLOST_BITS)
+    {
+        smbus_slaves[bus_index].is_alert_answered = false;
+    }
+}
 
 void smbus_slave_irq_stop(uint bus_index)
 {    
+    i2c_hw_t* hw = smbus_slaves[bus_index].hw;
     smbus_slave_t* slave = &smbus_slaves[bus_index];
 
-    if(slave->is_cmd_received && !slave->is_restarted)
+    // Bytes below the RX threshold have not raised RX_FULL yet
+    smbus_slave_rx_drain(bus_index);
+
+    smbus_slave_event_t event = SMBUS_SLAVE_QUICK;
+    bool is_pec_error = false;
+
+    // The Receive Byte answer was never clocked out, so this was a Quick
+    // Read. What was queued is flushed on the next read command. While an
+    // alert is raised the slave answers at the Alert Response Address,
+    // which is only ever read with Receive Byte.
+    if(slave->is_cmd_sent && !slave->is_alert_raised &&
+       !(hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_RX_DONE_BITS))
     {
-        bool allow_write = true;
+        slave->is_cmd_sent = false;
+        slave->is_quick_on = true;
+        slave->io_next_byte = 0;
+    }
 
+    hw->clr_rx_done;
+
+    if(slave->is_cmd_received && !slave->is_restarted)
+    {
         if(slave->is_pec_enabled)
         {
             if(slave->io_next_byte > 0)
             {
-                uint8_t write_address = smbus_get_unshifted_address(bus_index, false);
-                uint8_t crc = 0;
-                
-                crc = smbus_pec_single(crc, write_address);
-                crc = smbus_pec_single(crc, slave->cmd_byte);
-
+                // The PEC byte was folded in by rx_full as well,
+                // so a matching PEC leaves the running CRC at zero
                 slave->io_next_byte -= 1;
-
-                if(slave->io_next_byte > 0)
-                {
-                    crc = smbus_pec_block(crc, slave->smbus_data.block, slave->io_next_byte);
-                }
-
-                allow_write = (crc == slave->smbus_data.block[slave->io_next_byte]);            
+                is_pec_error = (slave->crc != 0);
             }
             else
             {
-                allow_write = false;
+                is_pec_error = true;
             }
         }
 
+        bool allow_write = !is_pec_error;
+
         if(slave->io_next_byte == 0)
         {
-            if(slave->write_reg_handler != NULL && allow_write)
+            event = SMBUS_SLAVE_WRITE_REG;
+
+            if(slave->write_reg_handler.plain != NULL && allow_write)
             {
-                slave->write_reg_handler(slave->cmd_byte);
+                smbus_slave_write_event(bus_index, SMBUS_SLAVE_WRITE_REG);
             }       
         }
         else
         {
-            if(slave->write_data_handler != NULL && allow_write)
+            const smbus_reg_t* reg = smbus_slave_get_reg(bus_index);
+            smbus_slave_write_data_handler_t handler = smbus_slave_get_write_data_handler(bus_index, slave->cmd_byte);
+
+            event = SMBUS_SLAVE_WRITE_DATA;
+
+            if(reg == NULL && handler.plain == NULL)
+            {
+                slave->stats.unknown_commands += 1;
+            }
+
+            if(reg != NULL && allow_write)
+            {
+                allow_write = smbus_slave_reg_write(bus_index, reg);
+            }
+
+            if(handler.plain != NULL && allow_write)
             {
-                slave->write_data_handler(slave->cmd_byte, &slave->smbus_data);
+                smbus_slave_write_event(bus_index, SMBUS_SLAVE_WRITE_DATA);
             }   
         }
     }  
     else
     if(slave->io_next_byte == 0 && !slave->is_cmd_received && !slave->is_cmd_sent)
     {
-        if(slave->quick_handler != NULL)
+        if(slave->quick_handler.plain != NULL)
         {
-            slave->quick_handler(slave->is_quick_on);
+            smbus_slave_write_event(bus_index, SMBUS_SLAVE_QUICK);
         }
     }
+    else
+    if(slave->is_restarted)
+    {
+        event = slave->read_event;
+    }
+    else
+    if(slave->is_cmd_sent)
+    {
+        event = SMBUS_SLAVE_READ_REG;
+    }
+
+    slave->stats.transactions[event] += 1;
+
+    if(is_pec_error)
+    {
+        slave->stats.pec_errors += 1;
+    }
     
+    // Bytes the master did not read stay queued until the next read command
+    hw_clear_bits(&hw->intr_mask, I2C_IC_INTR_MASK_M_TX_EMPTY_BITS);
+    smbus_slave_dma_tx_finish(bus_index);
+
+    smbus_slave_trace_stop(bus_index, is_pec_error);
+
+    if(slave->is_alert_answered)
+    {
+        // The host has our address, release SMBALERT# and answer at it again
+        smbus_slave_set_address(bus_index, slave->address);
+        gpio_set_dir(slave->alert_pin, GPIO_IN);
+
+        slave->is_alert_answered = false;
+        slave->is_alert_raised = false;
+    }
+
+    slave->is_started = false;
     slave->is_cmd_received = false;
     slave->is_cmd_sent = false;
     slave->is_quick_on = false;
     slave->is_restarted = false;
+    slave->is_pec_precomputed = false;
+    // Only the bytes this transaction touched need clearing
+    memset(&slave->smbus_data, 0, slave->io_dirty_len);
+
+    slave->io_buffer = slave->smbus_data.block;
+    slave->is_io_buffer_reg = false;
+    slave->io_capacity = sizeof(smbus_data_t);
     slave->io_next_byte = 0;
+    slave->io_data_len = 0;
+    slave->io_dirty_len = 0;
     slave->cmd_byte = 0x00;
-    memset(&slave->smbus_data, 0, sizeof(smbus_data_t));
+    slave->crc = 0;
 }
 
 void smbus_slave_irq_rx_full(uint bus_index)
 {
-    i2c_inst_t* i2c = i2c_get_instance(bus_index);
+    smbus_slave_t* slave = &smbus_slaves[bus_index];
+
+    smbus_slave_rx_drain(bus_index);
+
+    if(slave->is_dma_enabled && slave->io_next_byte >= SMBUS_DMA_MIN_LEN)
+    {
+        smbus_slave_dma_rx_start(bus_index);
+    }
+}
+
+void smbus_slave_rx_drain(uint bus_index)
+{
+    i2c_inst_t* i2c = smbus_slave_i2c(bus_index);
+    smbus_slave_t* slave = &smbus_slaves[bus_index];
+    i2c_hw_t* hw = slave->hw;
+
+    smbus_slave_dma_rx_finish(bus_index);
+
+    if(slave->is_rx_held)
+    {
+        // The transaction it opens has not been reached yet
+        if(slave->is_cmd_received)
+        {
+            return;
+        }
+
+        slave->is_rx_held = false;
+        smbus_slave_rx_byte(bus_index, slave->rx_held_byte);
+    }
+
+    while (i2c_get_read_available(i2c) > 0)
+    {
+        uint32_t data_cmd = smbus_i2c_read_data_cmd(i2c);
+        uint8_t rx_byte = (uint8_t)(data_cmd & I2C_IC_DATA_CMD_DAT_BITS);
+
+        // A late STOP finds the next transaction's bytes behind its own.
+        // The first one is held, the rest stay in the FIFO for later. The
+        // STOP is served in the same pass, which bounds the hold. Without
+        // one pending the byte follows a repeated START and is taken.
+        if((data_cmd & I2C_IC_DATA_CMD_FIRST_DATA_BYTE_BITS) && slave->is_cmd_received &&
+           (hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_STOP_DET_BITS))
+        {
+            slave->is_rx_held = true;
+            slave->rx_held_byte = rx_byte;
+            break;
+        }
+
+        smbus_slave_rx_byte(bus_index, rx_byte);
+    }
+
+    smbus_slave_mark_dirty(bus_index, slave->io_next_byte);
+}
+
+void smbus_slave_rx_byte(uint bus_index, uint8_t rx_byte)
+{
     smbus_slave_t* slave = &smbus_slaves[bus_index];
 
     if(slave->is_cmd_received)
     {
-        slave->smbus_data.block[slave->io_next_byte] = i2c_read_byte_raw(i2c);
-        slave->io_next_byte += 1;
+        if(slave->io_next_byte < slave->io_capacity)
+        {
+            slave->io_buffer[slave->io_next_byte] = rx_byte;
+            slave->io_next_byte += 1;
+        }
+        else
+        if(slave->is_io_buffer_reg && slave->is_pec_enabled && slave->io_next_byte == slave->io_capacity)
+        {
+            // Buffer halves have no room for the PEC, it only goes into the CRC
+            slave->io_next_byte += 1;
+        }
+        else
+        {
+            slave->stats.rx_overruns += 1;
+        }
     }
     else
     {
-        slave->cmd_byte = i2c_read_byte_raw(i2c);
+        slave->cmd_byte = rx_byte;
         slave->is_cmd_received = true;
+
+        smbus_slave_rx_buffer(bus_index);
+
+        if(slave->is_pec_enabled)
+        {
+            slave->crc = slave->write_address_crc;
+        }
+    }
+
+    if(slave->is_pec_enabled)
+    {
+        slave->crc = smbus_pec_single(slave->crc, rx_byte);
     }
 }
 
 void smbus_slave_irq_rd_req(uint bus_index)
 {
-    i2c_inst_t* i2c = i2c_get_instance(bus_index);
+    i2c_inst_t* i2c = smbus_slave_i2c(bus_index);
     smbus_slave_t* slave = &smbus_slaves[bus_index];
 
     if(slave->is_cmd_received || slave->is_cmd_sent)
     {
-        i2c_write_byte_raw(i2c, slave->smbus_data.block[slave->io_next_byte]);
-        slave->io_next_byte += 1;
+        if(smbus_slave_dma_tx_start(bus_index))
+        {
+            return;
+        }
+
+        if(smbus_slave_tx_fill(bus_index) == 0)
+        {
+            // Master reads past the response and PEC
+            i2c_write_byte_raw(i2c, 0xFF);
+        }
     }
     else
     {
-        busy_wait_us(2);
-
-        if(gpio_get(slave->sda_pin))
+        // Receive Byte and Quick Read look the same up to here, both are
+        // answered as Receive Byte. The STOP tells them apart: only a byte
+        // the master clocked out and NACKed raises RX_DONE.
+        if(slave->is_alert_raised)
         {
-            if(slave->read_reg_handler != NULL)
-            {
-                slave->cmd_byte = slave->read_reg_handler();
-
-                if(slave->is_pec_enabled)
-                {
-                    uint8_t read_address = smbus_get_unshifted_address(bus_index, true);
-                    uint8_t crc = 0;
-
-                    crc = smbus_pec_single(crc, read_address);
-                    crc = smbus_pec_single(crc, slave->cmd_byte);
+            slave->cmd_byte = (uint8_t)(slave->address << 1);
+            slave->is_alert_answered = true;
+        }
+        else
+        if(slave->read_reg_handler.plain != NULL)
+        {
+            uint32_t handler_cycles = smbus_slave_cycles();
 
-                    slave->smbus_data.block[slave->io_next_byte] = crc;
-                }
+            if(slave->read_reg_handler.is_ctx)
+            {
+                slave->cmd_byte = slave->read_reg_handler.with_ctx(slave->read_reg_handler.ctx);
+            }
+            else
+            {
+                slave->cmd_byte = slave->read_reg_handler.plain();
             }
 
-            slave->is_cmd_sent = true;
+            smbus_slave_handler_done(bus_index, handler_cycles);
         }
         else
         {
+            // Leaves SDA released for the STOP of a Quick Read
             slave->cmd_byte = 0xFF;
-            slave->is_quick_on = true;
         }
 
+        if(slave->is_pec_enabled)
+        {
+            slave->crc = smbus_pec_single(slave->read_address_crc, slave->cmd_byte);
+        }
+
+        slave->is_cmd_sent = true;
         i2c_write_byte_raw(i2c, slave->cmd_byte);
+        smbus_slave_tx_fill(bus_index);
     }
 }
 
-void smbus_slave_irq_handler(void)
+void smbus_slave_irq_tx_empty(uint bus_index)
 {
-    uint bus_index = __get_current_exception() - VTABLE_FIRST_IRQ - I2C0_IRQ;
-    i2c_inst_t* i2c = i2c_get_instance(bus_index);
-    i2c_hw_t* hw = i2c_get_hw(i2c);    
-    uint32_t intr_stat = hw->intr_stat;
+    smbus_slave_tx_fill(bus_index);
+}
 
+// One ISR per instance: with the bus index a constant, the handler and the
+// dispatcher inlined into it address their slave and registers directly
+#define SMBUS_SLAVE_IRQ_HANDLER(bus_index)          \
+    void smbus_slave_irq_handler_##bus_index(void)  \
+    {                                               \
+        smbus_slave_irq_handler(bus_index);         \
+    }
 
-    if(intr_stat & I2C_IC_INTR_STAT_R_RESTART_DET_BITS)
-    {
-        smbus_slave_irq_restart(bus_index);
-        hw->clr_restart_det;
+SMBUS_SLAVE_IRQ_HANDLER(0)
+SMBUS_SLAVE_IRQ_HANDLER(1)
 
-        return;
+static const irq_handler_t smbus_slave_irq_handlers[2] = {
+    smbus_slave_irq_handler_0,
+    smbus_slave_irq_handler_1,
+};
+
+void smbus_slave_irq_handler(uint bus_index)
+{
+    uint32_t isr_cycles = smbus_slave_cycles();
+
+    smbus_slave_irq_dispatch(bus_index);
+
+    isr_cycles = smbus_slave_cycles_since(isr_cycles);
+    smbus_slaves[bus_index].stats.isr_cycles[smbus_stats_bucket(isr_cycles)] += 1;
+}
+
+void smbus_slave_irq_dispatch(uint bus_index)
+{
+    smbus_slave_t* slave = &smbus_slaves[bus_index];
+    i2c_hw_t* hw = slave->hw;
+    uint32_t intr_status;
+
+    // Everything pending is served in bus order before returning, a late
+    // entry sees several causes at once and must not take one exception
+    // per cause. Each pass picks up what was raised during the last one.
+    while ((intr_status = hw->intr_stat) != 0)
+    {
+        // Flushed bytes of an earlier read must not be topped up again
+        if(intr_status & I2C_IC_INTR_STAT_R_TX_ABRT_BITS)
+        {
+            smbus_slave_irq_tx_abrt(bus_index);
+            hw->clr_tx_abrt;
+        }
+
+        // The STOP of an open transaction comes before the next START,
+        // which the next pass serves
+        if((intr_status & I2C_IC_INTR_STAT_R_STOP_DET_BITS) && 
+           (intr_status & I2C_IC_INTR_STAT_R_START_DET_BITS) && 
+           slave->is_started)
+        {
+            smbus_slave_irq_stop_all(bus_index);
+
+            continue;
+        }
+
+        if(intr_status & I2C_IC_INTR_STAT_R_START_DET_BITS)
+        {
+            smbus_slave_irq_start(bus_index);
+            hw->clr_start_det;
+        }
+
+        // Levels are sampled again, an earlier handler may have served them
+        if(hw->intr_stat & I2C_IC_INTR_STAT_R_RX_FULL_BITS)
+        {
+            smbus_slave_irq_rx_full(bus_index);
+        }
+
+        if(intr_status & I2C_IC_INTR_STAT_R_RESTART_DET_BITS)
+        {
+            smbus_slave_irq_restart(bus_index);
+            hw->clr_restart_det;
+        }
+
+        if(intr_status & I2C_IC_INTR_STAT_R_RD_REQ_BITS)
+        {
+            smbus_slave_irq_rd_req(bus_index);
+            hw->clr_rd_req;
+        }
+
+        if(hw->intr_stat & I2C_IC_INTR_STAT_R_TX_EMPTY_BITS)
+        {
+            smbus_slave_irq_tx_empty(bus_index);
+        }
+
+        // Last, so it sees every byte of its transaction
+        if(intr_status & I2C_IC_INTR_STAT_R_STOP_DET_BITS)
+        {
+            smbus_slave_irq_stop_all(bus_index);
+        }
+    }
+}
+
+void smbus_slave_irq_stop_all(uint bus_index)
+{
+    smbus_slave_t* slave = &smbus_slaves[bus_index];
+    i2c_hw_t* hw = slave->hw;
+
+    smbus_slave_irq_stop(bus_index);
+    hw->clr_stop_det;
+
+    // The STOP drained up to a transaction that followed its own. Once the
+    // bus is idle that one is over too, and its START and STOP went with
+    // those just cleared, so it is served here.
+    while (slave->is_rx_held && !(hw->status & I2C_IC_STATUS_SLV_ACTIVITY_BITS))
+    {
+        smbus_slave_irq_start(bus_index);
+        hw->clr_start_det;
+        smbus_slave_irq_stop(bus_index);
+        hw->clr_stop_det;
+    }
+}
+
+void smbus_init_i2c_gpio(uint gpio)
+{
+    gpio_init(gpio);
+    gpio_set_function(gpio, GPIO_FUNC_I2C);
+    gpio_pull_up(gpio);
+}
+
+size_t smbus_slave_tx_fill(uint bus_index)
+{
+    i2c_inst_t* i2c = smbus_slave_i2c(bus_index);
+    i2c_hw_t* hw = smbus_slaves[bus_index].hw;
+    smbus_slave_t* slave = &smbus_slaves[bus_index];
+
+    size_t tx_space = i2c_get_write_available(i2c);
+    size_t tx_len = slave->io_data_len + (slave->is_pec_enabled ? 1 : 0);
+    size_t tx_count = 0;
+
+    while (tx_count < tx_space && slave->io_next_byte < tx_len)
+    {
+        uint8_t tx_byte;
+
+        if(slave->io_next_byte == slave->io_data_len)
+        {
+            tx_byte = slave->crc;
+        }
+        else
+        {
+            tx_byte = slave->io_buffer[slave->io_next_byte];
+
+            if(slave->is_pec_enabled && !slave->is_pec_precomputed)
+            {
+                slave->crc = smbus_pec_single(slave->crc, tx_byte);
+            }
+        }
+
+        i2c_write_byte_raw(i2c, tx_byte);
+        slave->io_next_byte += 1;
+        tx_count += 1;
+    }
+
+    // TX_EMPTY tops the FIFO up until the whole response is queued
+    if(slave->io_next_byte < tx_len)
+    {
+        hw_set_bits(&hw->intr_mask, I2C_IC_INTR_MASK_M_TX_EMPTY_BITS);
+    }
+    else
+    {
+        hw_clear_bits(&hw->intr_mask, I2C_IC_INTR_MASK_M_TX_EMPTY_BITS);
+    }
+
+    return tx_count;
+}
+
+void smbus_slave_dma_rx_start(uint bus_index)
+{
+    i2c_inst_t* i2c = smbus_slave_i2c(bus_index);
+    i2c_hw_t* hw = smbus_slaves[bus_index].hw;
+    smbus_slave_t* slave = &smbus_slaves[bus_index];
+
+    size_t rx_len = slave->io_capacity - slave->io_next_byte;
+    dma_channel_config config = dma_channel_get_default_config(slave->dma_rx_channel);
+
+    if(slave->dma_rx_len > 0 || rx_len == 0)
+    {
+        return;
+    }
+
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_dreq(&config, i2c_get_dreq(i2c, false));
+
+    dma_channel_configure(
+        slave->dma_rx_channel,
+        &config,
+        &slave->io_buffer[slave->io_next_byte],
+        &hw->data_cmd,
+        rx_len,
+        true
+    );
+
+    // RX_FULL now only fires if the buffer is exhausted and the FIFO fills up
+    slave->dma_rx_len = rx_len;
+    slave->dma_rx_tl = hw->rx_tl;
+    hw->rx_tl = SMBUS_FIFO_DEPTH - 1;
+}
+
+void smbus_slave_dma_rx_finish(uint bus_index)
+{
+    i2c_inst_t* i2c = smbus_slave_i2c(bus_index);
+    i2c_hw_t* hw = smbus_slaves[bus_index].hw;
+    smbus_slave_t* slave = &smbus_slaves[bus_index];
+
+    if(slave->dma_rx_len == 0)
+    {
+        return;
+    }
+
+    // The channel empties the FIFO within a few cycles of a byte arriving
+    while (dma_channel_is_busy(slave->dma_rx_channel) && i2c_get_read_available(i2c) > 0)
+    {
+        tight_loop_contents();
+    }
+
+    dma_channel_abort(slave->dma_rx_channel);
+
+    size_t rx_count = slave->dma_rx_len - dma_channel_hw_addr(slave->dma_rx_channel)->transfer_count;
+
+    if(slave->is_pec_enabled)
+    {
+        slave->crc = smbus_pec_block(slave->crc, &slave->io_buffer[slave->io_next_byte], rx_count);
+    }
+
+    slave->io_next_byte += rx_count;
+    smbus_slave_mark_dirty(bus_index, slave->io_next_byte);
+    slave->dma_rx_len = 0;
+    hw->rx_tl = slave->dma_rx_tl;
+}
+
+bool smbus_slave_dma_tx_start(uint bus_index)
+{
+    i2c_inst_t* i2c = smbus_slave_i2c(bus_index);
+    i2c_hw_t* hw = smbus_slaves[bus_index].hw;
+    smbus_slave_t* slave = &smbus_slaves[bus_index];
+
+    size_t tx_len = slave->io_data_len + (slave->is_pec_enabled ? 1 : 0);
+    dma_channel_config config = dma_channel_get_default_config(slave->dma_tx_channel);
+
+    // Responses too long for the halfword buffer are topped up by TX_EMPTY
+    if(!slave->is_dma_enabled ||
+       slave->io_next_byte != 0 ||
+       tx_len < SMBUS_DMA_MIN_LEN ||
+       tx_len > count_of(slave->dma_tx_buffer))
+    {
+        return false;
+    }
+
+    // Narrow writes to IC_DATA_CMD are replicated across byte lanes and
+    // would set the CMD bit, so every byte goes out as a halfword
+    for (size_t i = 0; i < slave->io_data_len; ++i)
+    {
+        slave->dma_tx_buffer[i] = slave->io_buffer[i];
+    }
+
+    if(slave->is_pec_enabled)
+    {
+        if(!slave->is_pec_precomputed)
+        {
+            slave->crc = smbus_pec_block(slave->crc, slave->io_buffer, slave->io_data_len);
+        }
+
+        slave->dma_tx_buffer[slave->io_data_len] = slave->crc;
+    }
+
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_dreq(&config, i2c_get_dreq(i2c, true));
+
+    dma_channel_configure(
+        slave->dma_tx_channel,
+        &config,
+        &hw->data_cmd,
+        slave->dma_tx_buffer,
+        tx_len,
+        true
+    );
+
+    slave->io_next_byte = tx_len;
+
+    return true;
+}
+
+void smbus_slave_dma_tx_finish(uint bus_index)
+{
+    smbus_slave_t* slave = &smbus_slaves[bus_index];
+
+    if(slave->is_dma_enabled && dma_channel_is_busy(slave->dma_tx_channel))
+    {
+        dma_channel_abort(slave->dma_tx_channel);
+    }
+}
+
+void smbus_slave_write_event(uint bus_index, smbus_slave_event_t event)
+{
+    smbus_slave_t* slave = &smbus_slaves[bus_index];
+    smbus_queue_t* queue = &slave->queue;
+
+    // The write after next reuses a registered buffer's half, so its
+    // on_write cannot wait for smbus_dispatch()
+    if(!slave->is_deferred || slave->is_io_buffer_reg)
+    {
+        uint32_t handler_cycles = smbus_slave_cycles();
+
+        switch (event)
+        {
+            case SMBUS_SLAVE_QUICK:
+                SMBUS_SLAVE_CALL_HANDLER(slave->quick_handler, slave->is_quick_on);
+                break;
+            case SMBUS_SLAVE_WRITE_REG:
+                SMBUS_SLAVE_CALL_HANDLER(slave->write_reg_handler, slave->cmd_byte);
+                break;
+            case SMBUS_SLAVE_WRITE_DATA:
+            {
+                smbus_slave_write_data_handler_t handler = smbus_slave_get_write_data_handler(bus_index, slave->cmd_byte);
+
+                SMBUS_SLAVE_CALL_HANDLER(handler, slave->cmd_byte, (const smbus_data_t*)slave->io_buffer);
+            }
+            break;
+            default:
+                break;
+        }
+
+        smbus_slave_handler_done(bus_index, handler_cycles);
+
+        return;
+    }
+
+    uint32_t head = queue->head;
+    uint32_t used = head - queue->tail;
+
+    if(used == SMBUS_QUEUE_LEN)
+    {
+        queue->overflows += 1;
+        return;
+    }
+
+    smbus_queue_entry_t* entry = &queue->entries[head % SMBUS_QUEUE_LEN];
+
+    entry->event = event;
+    entry->cmd_byte = slave->cmd_byte;
+    entry->is_quick_on = slave->is_quick_on;
+
+    if(event == SMBUS_SLAVE_WRITE_DATA)
+    {
+        memcpy(&entry->smbus_data, &slave->smbus_data, slave->io_next_byte);
+        memset(&entry->smbus_data.block[slave->io_next_byte], 0, sizeof(smbus_data_t) - slave->io_next_byte);
+    }
+
+    // Publish the entry before the consumer can see the new head
+    __mem_fence_release();
+    queue->head = head + 1;
+
+    if(used + 1 > queue->high_water)
+    {
+        queue->high_water = used + 1;
+    }
+}
+
+bool smbus_slave_cache_read(uint bus_index)
+{
+    smbus_slave_t* slave = &smbus_slaves[bus_index];
+    uint32_t seq;
+
+    do
+    {
+        uint slot_index = slave->cache_map[slave->cmd_byte];
+
+        if(slot_index == 0)
+        {
+            return false;
+        }
+
+        smbus_cache_slot_t* slot = &slave->cache_slots[slot_index - 1];
+
+        seq = slot->seq;
+        __mem_fence_acquire();
+
+        const smbus_cache_buffer_t* buffer = &slot->buffers[seq & 1];
+
+        memcpy(slave->smbus_data.block, buffer->data, buffer->data_len);
+        slave->io_buffer = slave->smbus_data.block;
+        slave->io_data_len = buffer->data_len;
+        smbus_slave_mark_dirty(bus_index, buffer->data_len);
+        slave->crc = buffer->pec;
+
+        // Only a writer on the other core can move seq under us
+        __mem_fence_acquire();
+
+        if(slot->seq == seq)
+        {
+            break;
+        }
+    }
+    while (true);
+
+    slave->is_pec_precomputed = slave->is_pec_enabled;
+
+    return true;
+}
+
+const smbus_reg_t* smbus_slave_get_reg(uint bus_index)
+{
+    smbus_slave_t* slave = &smbus_slaves[bus_index];
+
+    if(slave->regmap == NULL || slave->regmap[slave->cmd_byte].type == SMBUS_REG_NONE)
+    {
+        return NULL;
+    }
+
+    return &slave->regmap[slave->cmd_byte];
+}
+
+void smbus_slave_reg_read(uint bus_index, const smbus_reg_t* reg)
+{
+    smbus_slave_t* slave = &smbus_slaves[bus_index];
+    uint8_t* storage = reg->storage;
+    size_t data_len = 0;
+
+    if(reg->type == SMBUS_REG_BUFFER)
+    {
+        // Sent in place from the half readers see, pinned by io_buffer until
+        // the STOP. Its count goes out as sent, like a block register's.
+        spin_lock_unsafe_blocking(slave->regmap_lock);
+        storage = smbus_reg_buffer_half(reg, SMBUS_REG_BUFFER_LIVE(reg));
+        storage[0] = MIN(storage[0], reg->len);
+        slave->io_buffer = storage;
+        slave->is_io_buffer_reg = true;
+        spin_unlock_unsafe(slave->regmap_lock);
+
+        // Reads of write-only registers get 0xFF from the RD_REQ fallback
+        slave->io_data_len = (reg->access & SMBUS_REG_READ) ? storage[0] + 1 : 0;
+        return;
+    }
+
+    // Reads of write-only registers get 0xFF from the RD_REQ fallback
+    if(reg->access & SMBUS_REG_READ)
+    {
+        if(reg->type == SMBUS_REG_FIXED)
+        {
+            data_len = reg->len;
+        }
+        else
+        {
+            data_len = MIN(storage[0], reg->len) + 1;
+        }
+    }
+
+    data_len = MIN(data_len, sizeof(smbus_data_t) - 1);
+
+    // smbus_reg_write() may be running on the other core
+    spin_lock_unsafe_blocking(slave->regmap_lock);
+    memcpy(slave->smbus_data.block, storage, data_len);
+    spin_unlock_unsafe(slave->regmap_lock);
+
+    if(reg->type == SMBUS_REG_BLOCK && data_len > 0)
+    {
+        slave->smbus_data.block[0] = data_len - 1;
+    }
+
+    slave->io_buffer = slave->smbus_data.block;
+    slave->io_data_len = data_len;
+    smbus_slave_mark_dirty(bus_index, data_len);
+}
+
+bool smbus_slave_reg_write(uint bus_index, const smbus_reg_t* reg)
+{
+    smbus_slave_t* slave = &smbus_slaves[bus_index];
+    size_t data_len = slave->io_next_byte;
+
+    if(!(reg->access & SMBUS_REG_WRITE))
+    {
+        return false;
+    }
+
+    if(reg->type == SMBUS_REG_FIXED)
+    {
+        if(data_len != reg->len)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        uint8_t count = slave->io_buffer[0];
+
+        if(data_len == 0 || count > reg->len || data_len != (size_t)count + 1)
+        {
+            return false;
+        }
+    }
+
+    // Only a write that passed is copied or, received in place into a
+    // buffer half, shown to readers. A rejected one leaves them alone.
+    spin_lock_unsafe_blocking(slave->regmap_lock);
+
+    if(reg->type == SMBUS_REG_BUFFER)
+    {
+        SMBUS_REG_BUFFER_LIVE(reg) = (slave->io_buffer == smbus_reg_buffer_half(reg, 1));
+    }
+    else
+    {
+        memcpy(reg->storage, slave->io_buffer, data_len);
+    }
+
+    spin_unlock_unsafe(slave->regmap_lock);
+
+    return true;
+}
+
+void smbus_slave_mark_dirty(uint bus_index, size_t data_len)
+{
+    smbus_slave_t* slave = &smbus_slaves[bus_index];
+
+    // Only smbus_data is cleared at STOP, registered buffers are left alone
+    if(slave->io_buffer == slave->smbus_data.block && data_len > slave->io_dirty_len)
+    {
+        slave->io_dirty_len = MIN(data_len, sizeof(smbus_data_t));
+    }
+}
+
+bool smbus_slave_block_proc_call(uint bus_index)
+{
+    smbus_slave_t* slave = &smbus_slaves[bus_index];
+    smbus_data_t* response = &slave->response_data;
+
+    if(slave->block_proc_call_handler.plain == NULL || slave->io_next_byte != slave->smbus_data.block[0] + 1)
+    {
+        return false;
+    }
+
+    uint32_t handler_cycles = smbus_slave_cycles();
+    bool is_handled;
+
+    response->block[0] = 0;
+    is_handled = SMBUS_SLAVE_CALL_HANDLER(slave->block_proc_call_handler, slave->cmd_byte, &slave->smbus_data, response);
+    smbus_slave_handler_done(bus_index, handler_cycles);
+
+    if(!is_handled)
+    {
+        return false;
+    }
+
+    // The read half carries its own count, the PEC covers both halves
+    slave->io_buffer = response->block;
+    slave->io_data_len = MIN(response->block[0], SMBUS_MAX_BLOCK_LEN) + 1;
+    slave->io_next_byte = 0;
+
+    return true;
+}
+
+void smbus_slave_rx_buffer(uint bus_index)
+{
+    smbus_slave_t* slave = &smbus_slaves[bus_index];
+    const smbus_reg_t* reg = smbus_slave_get_reg(bus_index);
+
+    if(reg != NULL && reg->type == SMBUS_REG_BUFFER && (reg->access & SMBUS_REG_WRITE))
+    {
+        // Received in place into the half readers do not see, pinned by
+        // io_buffer until the STOP
+        spin_lock_unsafe_blocking(slave->regmap_lock);
+        slave->io_buffer = smbus_reg_buffer_half(reg, !SMBUS_REG_BUFFER_LIVE(reg));
+        slave->is_io_buffer_reg = true;
+        spin_unlock_unsafe(slave->regmap_lock);
+
+        slave->io_capacity = reg->len + 1;
+    }
+}
+
+void smbus_slave_set_address(uint bus_index, uint8_t address)
+{
+    i2c_hw_t* hw = smbus_slaves[bus_index].hw;
+
+    // IC_SAR only takes writes while the controller is disabled
+    hw->enable = 0;
+    hw->sar = address;
+    hw->enable = 1;
+
+    smbus_slave_cache_address(bus_index, address);
+}
+
+void smbus_slave_cache_address(uint bus_index, uint8_t address)
+{
+    smbus_slave_t* slave = &smbus_slaves[bus_index];
+
+    slave->write_address = (uint8_t)(address << 1);
+    slave->read_address = slave->write_address | 0x1;
+    slave->write_address_crc = smbus_pec_single(0, slave->write_address);
+    slave->read_address_crc = smbus_pec_single(0, slave->read_address);
+}
+
+smbus_notify_result_t smbus_master_write(i2c_inst_t* i2c, uint8_t address, const uint8_t data[], size_t data_len)
+{
+    i2c_hw_t* hw = i2c_get_hw(i2c);
+    uint32_t con = hw->con;
+    uint32_t abort_source = 0;
+    bool is_empty = false;
+    bool is_aborted = false;
+    bool is_timed_out = false;
+    uint64_t deadline_us = time_us_64() + SMBUS_NOTIFY_TIMEOUT_US;
+
+    hw->enable = 0;
+    hw->con = (con & ~I2C_IC_CON_RX_FIFO_FULL_HLD_CTRL_BITS)
+            | I2C_IC_CON_MASTER_MODE_BITS
+            | I2C_IC_CON_IC_SLAVE_DISABLE_BITS;
+    hw->tar = address;
+    hw->enable = 1;
+
+    for (size_t i = 0; i < data_len && !is_aborted && !is_timed_out; ++i)
+    {
+        hw->data_cmd = data[i] | ((i + 1 == data_len) ? I2C_IC_DATA_CMD_STOP_BITS : 0);
+
+        // The abort source is only valid until IC_CLR_TX_ABRT is read
+        do
+        {
+            abort_source = hw->tx_abrt_source;
+            is_aborted = hw->clr_tx_abrt;
+            is_empty = hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_TX_EMPTY_BITS;
+            is_timed_out = time_us_64() > deadline_us;
+        }
+        while (!is_aborted && !is_timed_out && !is_empty);
+
+        // An abort can be raised along with TX_EMPTY
+        if(!is_aborted)
+        {
+            abort_source = hw->tx_abrt_source;
+            is_aborted = hw->clr_tx_abrt;
+        }
+    }
+
+    // An aborted transfer also ends with a STOP, from us or the winner
+    while (!is_timed_out && !(hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_STOP_DET_BITS))
+    {
+        is_timed_out = time_us_64() > deadline_us;
+    }
+
+    // Nothing of the above is meant for the slave ISR
+    hw->clr_intr;
+
+    hw->enable = 0;
+    hw->con = con;
+    hw->enable = 1;
+
+    if(is_timed_out)
+    {
+        return SMBUS_NOTIFY_TIMEOUT;
+    }
+
+    if(is_aborted)
+    {
+        return (abort_source & I2C_IC_TX_ABRT_SOURCE_ARB_LOST_BITS) ? SMBUS_NOTIFY_ARB_LOST : SMBUS_NOTIFY_NACK;
+    }
+
+    return SMBUS_NOTIFY_OK;
+}
+
+smbus_slave_write_data_handler_t smbus_slave_get_write_data_handler(uint bus_index, uint8_t command)
+{
+    smbus_slave_t* slave = &smbus_slaves[bus_index];
+
+    // Regmap entries take their plain on_write instead
+    if(slave->regmap != NULL && slave->regmap[command].type != SMBUS_REG_NONE)
+    {
+        smbus_slave_write_data_handler_t handler = { .plain = slave->regmap[command].on_write };
+
+        return handler;
+    }
+
+    return slave->write_data_handler;
+}
+
+void smbus_slave_init(
+    i2c_inst_t* i2c, 
+    uint8_t address, 
+    uint baudrate,
+    uint sda_pin,
+    uint scl_pin
+)
+{
+    assert(i2c == i2c0 || i2c == i2c1);
+    assert(SMBUS_MIN_BAUD_RATE_HZ <= baudrate && baudrate <= SMBUS_MAX_BAUD_RATE_HZ);
+    
+    i2c_hw_t* hw = i2c_get_hw(i2c);
+
+    uint i2c_index = i2c_hw_index(i2c);
+    uint intr_num = I2C0_IRQ + i2c_index;
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+
+    memset(slave, 0, sizeof(smbus_slave_t));
+
+    slave->hw = hw;
+    slave->io_buffer = slave->smbus_data.block;
+    slave->io_capacity = sizeof(smbus_data_t);
+    smbus_slave_cache_address(i2c_index, address);
+
+    smbus_init_i2c_gpio(sda_pin);
+    smbus_init_i2c_gpio(scl_pin);
+
+    i2c_init(i2c, baudrate);
+    i2c_set_slave_mode(i2c, true, address);
+    
+    hw->intr_mask = I2C_IC_INTR_MASK_M_START_DET_BITS
+                  | I2C_IC_INTR_MASK_M_RESTART_DET_BITS
+                  | I2C_IC_INTR_MASK_M_TX_ABRT_BITS
+                  | I2C_IC_INTR_MASK_M_STOP_DET_BITS
+                  | I2C_IC_INTR_MASK_M_RX_FULL_BITS
+                  | I2C_IC_INTR_MASK_M_RD_REQ_BITS;
+
+    slave->regmap_lock = spin_lock_instance(spin_lock_claim_unused(true));
+    smbus_slave_trace_init();
+    slave->core_num = get_core_num();
+
+    // The IRQ is taken by the calling core, the handlers run there too
+    irq_set_exclusive_handler(intr_num, smbus_slave_irq_handlers[i2c_index]);
+    irq_set_enabled(intr_num, true);
+
+    slave->address = address;
+    slave->sda_pin = sda_pin;
+    slave->scl_pin = scl_pin;
+    slave->cycles_per_us = clock_get_hz(clk_sys) / 1000000;
+
+    // Free running SysTick for the latency histograms, unless it is taken
+    if(!(systick_hw->csr & M0PLUS_SYST_CSR_ENABLE_BITS))
+    {
+        systick_hw->rvr = M0PLUS_SYST_RVR_BITS;
+        systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+    }
+}
+
+void smbus_slave_deinit(
+    i2c_inst_t* i2c
+)
+{
+    assert(i2c == i2c0 || i2c == i2c1);
+
+    i2c_hw_t *hw = i2c_get_hw(i2c);
+
+    uint i2c_index = i2c_hw_index(i2c);
+    uint intr_num = I2C0_IRQ + i2c_index;
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+
+    irq_set_enabled(intr_num, false);
+    irq_remove_handler(intr_num, smbus_slave_irq_handlers[i2c_index]);
+    hw->intr_mask = I2C_IC_INTR_MASK_RESET;
+
+    i2c_set_slave_mode(i2c, false, 0);
+
+    // The ISR is gone, release SMBALERT# without going through
+    // smbus_set_alert(), which must run on the SMBus core
+    if(slave->is_alert_enabled)
+    {
+        gpio_deinit(slave->alert_pin);
+    }
+
+    smbus_set_dma(i2c, false);
+    
+    gpio_deinit(slave->sda_pin);
+    gpio_deinit(slave->scl_pin);
+
+    spin_lock_unclaim(spin_lock_get_num(slave->regmap_lock));
+    
+    memset(slave, 0, sizeof(smbus_slave_t));
+}
+
+
+// The ISR sees either no handler or the new one with its ctx and tag,
+// never the new handler with the old ones
+#define SMBUS_SLAVE_SET_HANDLER(slave, name, member, handler, handler_ctx, is_handler_ctx)  \
+    do                                                                                      \
+    {                                                                                       \
+        (slave)->name##_handler.plain = NULL;                                               \
+        __mem_fence_release();                                                              \
+        (slave)->name##_handler.ctx = (handler_ctx);                                        \
+        (slave)->name##_handler.is_ctx = (is_handler_ctx);                                  \
+        __mem_fence_release();                                                              \
+        (slave)->name##_handler.member = (handler);                                         \
+    }                                                                                       \
+    while (0)
+
+void smbus_set_quick_handler(i2c_inst_t* i2c, quick_handler_t handler)
+{
+    uint i2c_index = i2c_hw_index(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+
+    SMBUS_SLAVE_SET_HANDLER(slave, quick, plain, handler, NULL, false);
+}
+
+void smbus_set_quick_ctx_handler(i2c_inst_t* i2c, quick_ctx_handler_t handler, void* ctx)
+{
+    uint i2c_index = i2c_hw_index(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+
+    SMBUS_SLAVE_SET_HANDLER(slave, quick, with_ctx, handler, ctx, true);
+}
+
+void smbus_set_write_reg_handler(i2c_inst_t* i2c, write_reg_handler_t handler)
+{
+    uint i2c_index = i2c_hw_index(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+
+    SMBUS_SLAVE_SET_HANDLER(slave, write_reg, plain, handler, NULL, false);
+}
+
+void smbus_set_write_reg_ctx_handler(i2c_inst_t* i2c, write_reg_ctx_handler_t handler, void* ctx)
+{
+    uint i2c_index = i2c_hw_index(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+
+    SMBUS_SLAVE_SET_HANDLER(slave, write_reg, with_ctx, handler, ctx, true);
+}
+
+void smbus_set_write_data_handler(i2c_inst_t* i2c, write_data_handler_t handler)
+{
+    uint i2c_index = i2c_hw_index(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+
+    SMBUS_SLAVE_SET_HANDLER(slave, write_data, plain, handler, NULL, false);
+}
+
+void smbus_set_write_data_ctx_handler(i2c_inst_t* i2c, write_data_ctx_handler_t handler, void* ctx)
+{
+    uint i2c_index = i2c_hw_index(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+
+    SMBUS_SLAVE_SET_HANDLER(slave, write_data, with_ctx, handler, ctx, true);
+}
+
+void smbus_set_read_reg_handler(i2c_inst_t* i2c, read_reg_handler_t handler)
+{
+    uint i2c_index = i2c_hw_index(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+
+    SMBUS_SLAVE_SET_HANDLER(slave, read_reg, plain, handler, NULL, false);
+}
+
+void smbus_set_read_reg_ctx_handler(i2c_inst_t* i2c, read_reg_ctx_handler_t handler, void* ctx)
+{
+    uint i2c_index = i2c_hw_index(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+
+    SMBUS_SLAVE_SET_HANDLER(slave, read_reg, with_ctx, handler, ctx, true);
+}
+
+void smbus_set_read_data_handler(i2c_inst_t* i2c, read_data_handler_t handler)
+{
+    uint i2c_index = i2c_hw_index(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+
+    SMBUS_SLAVE_SET_HANDLER(slave, read_data, plain, handler, NULL, false);
+}
+
+void smbus_set_read_data_ctx_handler(i2c_inst_t* i2c, read_data_ctx_handler_t handler, void* ctx)
+{
+    uint i2c_index = i2c_hw_index(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+
+    SMBUS_SLAVE_SET_HANDLER(slave, read_data, with_ctx, handler, ctx, true);
+}
+
+void smbus_set_proc_call_handler(i2c_inst_t* i2c, proc_call_handler_t handler)
+{
+    uint i2c_index = i2c_hw_index(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+
+    SMBUS_SLAVE_SET_HANDLER(slave, proc_call, plain, handler, NULL, false);
+}
+
+void smbus_set_proc_call_ctx_handler(i2c_inst_t* i2c, proc_call_ctx_handler_t handler, void* ctx)
+{
+    uint i2c_index = i2c_hw_index(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+
+    SMBUS_SLAVE_SET_HANDLER(slave, proc_call, with_ctx, handler, ctx, true);
+}
+
+void smbus_set_block_proc_call_handler(i2c_inst_t* i2c, block_proc_call_handler_t handler)
+{
+    uint i2c_index = i2c_hw_index(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+
+    SMBUS_SLAVE_SET_HANDLER(slave, block_proc_call, plain, handler, NULL, false);
+}
+
+void smbus_set_block_proc_call_ctx_handler(i2c_inst_t* i2c, block_proc_call_ctx_handler_t handler, void* ctx)
+{
+    uint i2c_index = i2c_hw_index(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+
+    SMBUS_SLAVE_SET_HANDLER(slave, block_proc_call, with_ctx, handler, ctx, true);
+}
+
+void smbus_reset_handler(i2c_inst_t* i2c, smbus_slave_event_t slave_event)
+{
+    uint i2c_index = i2c_hw_index(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+    
+    switch (slave_event)
+    {
+        case SMBUS_SLAVE_QUICK:
+            slave->quick_handler.plain = NULL;
+            break;
+        case SMBUS_SLAVE_WRITE_REG:
+            slave->write_reg_handler.plain = NULL;
+            break;
+        case SMBUS_SLAVE_WRITE_DATA:
+            slave->write_data_handler.plain = NULL;
+            break;
+        case SMBUS_SLAVE_READ_REG:
+            slave->read_reg_handler.plain = NULL;
+            break;
+        case SMBUS_SLAVE_READ_DATA:
+            slave->read_data_handler.plain = NULL;
+            break;
+        case SMBUS_SLAVE_PROC_CALL:
+            slave->proc_call_handler.plain = NULL;
+            break;
+        case SMBUS_SLAVE_BLOCK_PROC_CALL:
+            slave->block_proc_call_handler.plain = NULL;
+            break;
+    }
+}
+
+void smbus_set_pec(i2c_inst_t* i2c, bool is_enabled)
+{
+    uint i2c_index = i2c_hw_index(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+
+    slave->is_pec_enabled = is_enabled;
+}
+
+bool smbus_get_pec(i2c_inst_t* i2c)
+{
+    uint i2c_index = i2c_hw_index(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+
+    return slave->is_pec_enabled;
+}
+
+
+void smbus_set_fifo_thresholds(i2c_inst_t* i2c, uint rx_threshold, uint tx_threshold)
+{
+    assert(1 <= rx_threshold && rx_threshold <= SMBUS_FIFO_DEPTH);
+    assert(tx_threshold < SMBUS_FIFO_DEPTH);
+
+    i2c_hw_t* hw = i2c_get_hw(i2c);
+
+    hw->rx_tl = rx_threshold - 1;
+    hw->tx_tl = tx_threshold;
+}
+
+bool smbus_set_dma(i2c_inst_t* i2c, bool is_enabled)
+{
+    uint i2c_index = i2c_hw_index(i2c);
+    i2c_hw_t* hw = i2c_get_hw(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+
+    if(is_enabled == slave->is_dma_enabled)
+    {
+        return true;
+    }
+
+    if(is_enabled)
+    {
+        int rx_channel = dma_claim_unused_channel(false);
+        int tx_channel = dma_claim_unused_channel(false);
+
+        if(rx_channel < 0 || tx_channel < 0)
+        {
+            if(rx_channel >= 0)
+            {
+                dma_channel_unclaim(rx_channel);
+            }
+
+            return false;
+        }
+
+        slave->dma_rx_channel = rx_channel;
+        slave->dma_tx_channel = tx_channel;
+
+        // Keep the TX FIFO topped up, fetch every received byte
+        hw->dma_tdlr = SMBUS_FIFO_DEPTH - 1;
+        hw->dma_rdlr = 0;
+        hw->dma_cr = I2C_IC_DMA_CR_TDMAE_BITS | I2C_IC_DMA_CR_RDMAE_BITS;
+    }
+    else
+    {
+        dma_channel_abort(slave->dma_rx_channel);
+        dma_channel_abort(slave->dma_tx_channel);
+        dma_channel_unclaim(slave->dma_rx_channel);
+        dma_channel_unclaim(slave->dma_tx_channel);
+    }
+
+    slave->is_dma_enabled = is_enabled;
+
+    return true;
+}
+
+bool smbus_get_dma(i2c_inst_t* i2c)
+{
+    uint i2c_index = i2c_hw_index(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+
+    return slave->is_dma_enabled;
+}
+
+void smbus_set_deferred(i2c_inst_t* i2c, bool is_enabled)
+{
+    uint i2c_index = i2c_hw_index(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+
+    slave->is_deferred = is_enabled;
+}
+
+bool smbus_get_deferred(i2c_inst_t* i2c)
+{
+    uint i2c_index = i2c_hw_index(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+
+    return slave->is_deferred;
+}
+
+size_t smbus_dispatch(i2c_inst_t* i2c)
+{
+    uint i2c_index = i2c_hw_index(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+    smbus_queue_t* queue = &slave->queue;
+    size_t dispatched = 0;
+
+    uint32_t tail = queue->tail;
+
+    while (tail != queue->head)
+    {
+        // Entry contents are read only after head was seen to move past them
+        __mem_fence_acquire();
+
+        smbus_queue_entry_t* entry = &queue->entries[tail % SMBUS_QUEUE_LEN];
+
+        switch (entry->event)
+        {
+            case SMBUS_SLAVE_QUICK:
+                if(slave->quick_handler.plain != NULL)
+                {
+                    SMBUS_SLAVE_CALL_HANDLER(slave->quick_handler, entry->is_quick_on);
+                }
+                break;
+            case SMBUS_SLAVE_WRITE_REG:
+                if(slave->write_reg_handler.plain != NULL)
+                {
+                    SMBUS_SLAVE_CALL_HANDLER(slave->write_reg_handler, entry->cmd_byte);
+                }
+                break;
+            case SMBUS_SLAVE_WRITE_DATA:
+            {
+                smbus_slave_write_data_handler_t handler = smbus_slave_get_write_data_handler(i2c_index, entry->cmd_byte);
+
+                if(handler.plain != NULL)
+                {
+                    SMBUS_SLAVE_CALL_HANDLER(handler, entry->cmd_byte, &entry->smbus_data);
+                }
+            }
+            break;
+            default:
+                break;
+        }
+
+        // The slot is handed back only after the handler is done with it
+        __mem_fence_release();
+        queue->tail = ++tail;
+        dispatched += 1;
     }
 
-    if(intr_stat & I2C_IC_INTR_STAT_R_START_DET_BITS)
-    {
-        smbus_slave_irq_start(bus_index);
-        hw->clr_start_det; 
+    return dispatched;
+}
 
-        return;
+void smbus_get_queue_stats(i2c_inst_t* i2c, smbus_queue_stats_t* stats)
+{
+    uint i2c_index = i2c_hw_index(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+
+    stats->overflows = slave->queue.overflows;
+    stats->high_water = slave->queue.high_water;
+}
+
+static void smbus_cache_write(smbus_cache_buffer_t* buffer, const void* data, size_t data_len, uint8_t pec)
+{
+    memcpy(buffer->data, data, data_len);
+    buffer->data_len = data_len;
+    buffer->pec = pec;
+}
+
+bool smbus_publish(i2c_inst_t* i2c, uint8_t command, const void* data, size_t data_len)
+{
+    uint i2c_index = i2c_hw_index(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+    uint slot_index = slave->cache_map[command];
+
+    if(data_len > sizeof(smbus_data_t) - 1)
+    {
+        return false;
     }
 
-    if(intr_stat & I2C_IC_INTR_STAT_R_TX_ABRT_BITS)
+    if(slot_index == 0)
     {
-        smbus_slave_irq_tx_abrt(bus_index);        
-        hw->clr_tx_abrt;
+        bool is_used[SMBUS_CACHE_SLOTS] = { false };
 
-        return;
+        for (uint i = 0; i < 256; ++i)
+        {
+            if(slave->cache_map[i] != 0)
+            {
+                is_used[slave->cache_map[i] - 1] = true;
+            }
+        }
+
+        for (uint i = 0; i < SMBUS_CACHE_SLOTS && slot_index == 0; ++i)
+        {
+            if(!is_used[i])
+            {
+                slot_index = i + 1;
+            }
+        }
+
+        if(slot_index == 0)
+        {
+            return false;
+        }
     }
 
-    if(intr_stat & I2C_IC_INTR_STAT_R_STOP_DET_BITS)
-    {
-        smbus_slave_irq_stop(bus_index);
-        hw->clr_stop_det;  
+    // The response PEC covers the whole read transaction, addresses included
+    uint8_t pec = 0;
+
+    pec = smbus_pec_single(pec, (uint8_t)(slave->address << 1));
+    pec = smbus_pec_single(pec, command);
+    pec = smbus_pec_single(pec, (uint8_t)(slave->address << 1) | 0x1);
+    pec = smbus_pec_block(pec, data, data_len);
+
+    smbus_cache_slot_t* slot = &slave->cache_slots[slot_index - 1];
+    uint32_t seq = slot->seq;
+
+    // Steer readers to buffers[1] while buffers[0] is rewritten, then back
+    slot->seq = seq + 1;
+    __mem_fence_release();
+    smbus_cache_write(&slot->buffers[0], data, data_len, pec);
+    __mem_fence_release();
+
+    slot->seq = seq + 2;
+    __mem_fence_release();
+    smbus_cache_write(&slot->buffers[1], data, data_len, pec);
+    __mem_fence_release();
+
+    slave->cache_map[command] = slot_index;
+
+    return true;
+}
+
+void smbus_unpublish(i2c_inst_t* i2c, uint8_t command)
+{
+    uint i2c_index = i2c_hw_index(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+
+    slave->cache_map[command] = 0;
+}
+
+void smbus_set_regmap(i2c_inst_t* i2c, const smbus_reg_t* regmap)
+{
+    uint i2c_index = i2c_hw_index(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+
+    slave->regmap = regmap;
+}
+
+size_t smbus_reg_read(i2c_inst_t* i2c, uint8_t command, void* data, size_t data_max)
+{
+    uint i2c_index = i2c_hw_index(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+    const smbus_reg_t* reg = slave->regmap != NULL ? &slave->regmap[command] : NULL;
+    size_t data_len = 0;
 
-        return;  
+    if(reg == NULL || reg->type == SMBUS_REG_NONE || !(reg->access & SMBUS_REG_READ))
+    {
+        return 0;
     }
 
-    if(intr_stat & I2C_IC_INTR_STAT_R_RX_FULL_BITS)
-    {    
-        smbus_slave_irq_rx_full(bus_index);
+    // Keeps out the ISR on either core
+    uint32_t interrupts = spin_lock_blocking(slave->regmap_lock);
 
-        return;
-    }    
+    const uint8_t* storage = reg->storage;
 
-    if(intr_stat & I2C_IC_INTR_STAT_R_RD_REQ_BITS)
+    if(reg->type == SMBUS_REG_BUFFER)
     {
-        smbus_slave_irq_rd_req(bus_index);
-        hw->clr_rd_req;
+        storage = smbus_reg_buffer_half(reg, SMBUS_REG_BUFFER_LIVE(reg));
+    }
 
-        return;
+    if(reg->type == SMBUS_REG_FIXED)
+    {
+        data_len = reg->len;
+    }
+    else
+    {
+        data_len = MIN(storage[0], reg->len) + 1;
     }
-}
 
-void smbus_init_i2c_gpio(uint gpio)
-{
-    gpio_init(gpio);
-    gpio_set_function(gpio, GPIO_FUNC_I2C);
-    gpio_pull_up(gpio);
+    if(data_len > data_max)
+    {
+        data_len = 0;
+    }
+    else
+    {
+        memcpy(data, storage, data_len);
+    }
+
+    spin_unlock(slave->regmap_lock, interrupts);
+
+    // The count as it would go out on the bus
+    if(reg->type != SMBUS_REG_FIXED && data_len > 0)
+    {
+        ((uint8_t*)data)[0] = data_len - 1;
+    }
+
+    return data_len;
 }
 
-uint8_t smbus_get_unshifted_address(uint bus_index, bool readwrite_bit)
+bool smbus_reg_write(i2c_inst_t* i2c, uint8_t command, const void* data, size_t data_len)
 {
-    i2c_inst_t* i2c = i2c_get_instance(bus_index);
-    i2c_hw_t* hw = i2c_get_hw(i2c);
+    uint i2c_index = i2c_hw_index(i2c);
+    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+    const smbus_reg_t* reg = slave->regmap != NULL ? &slave->regmap[command] : NULL;
+    const uint8_t* bytes = data;
+
+    if(reg == NULL || reg->type == SMBUS_REG_NONE || !(reg->access & SMBUS_REG_WRITE))
+    {
+        return false;
+    }
+
+    if(reg->type == SMBUS_REG_FIXED)
+    {
+        if(data_len != reg->len)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        if(data_len == 0 || bytes[0] > reg->len || data_len != (size_t)bytes[0] + 1)
+        {
+            return false;
+        }
+    }
+
+    uint32_t interrupts = spin_lock_blocking(slave->regmap_lock);
+    uint8_t* storage = reg->storage;
 
-    uint8_t unshifted_address = ((uint8_t)(hw->sar) << 1);;
+    if(reg->type == SMBUS_REG_BUFFER)
+    {
+        storage = smbus_reg_buffer_half(reg, !SMBUS_REG_BUFFER_LIVE(reg));
+
+        // The ISR still receives into that half or sends from it
+        while (slave->io_buffer == storage)
+        {
+            spin_unlock(slave->regmap_lock, interrupts);
+            tight_loop_contents();
+            interrupts = spin_lock_blocking(slave->regmap_lock);
+            storage = smbus_reg_buffer_half(reg, !SMBUS_REG_BUFFER_LIVE(reg));
+        }
+    }
+
+    memcpy(storage, data, data_len);
+
+    if(reg->type == SMBUS_REG_BUFFER)
+    {
+        SMBUS_REG_BUFFER_LIVE(reg) = (storage == smbus_reg_buffer_half(reg, 1));
+    }
+
+    spin_unlock(slave->regmap_lock, interrupts);
 
-    if(readwrite_bit)
+    if(reg->on_write != NULL)
     {
-        unshifted_address |= 0x1;
+        if(reg->type == SMBUS_REG_BUFFER)
+        {
+            reg->on_write(command, (const smbus_data_t*)storage);
+        }
+        else
+        {
+            smbus_data_t smbus_data;
+
+            memcpy(&smbus_data, data, MIN(data_len, sizeof(smbus_data)));
+            reg->on_write(command, &smbus_data);
+        }
     }
 
-    return unshifted_address;
+    return true;
 }
 
 
-void smbus_slave_init(
-    i2c_inst_t* i2c, 
-    uint8_t address, 
-    uint baudrate,
-    uint sda_pin,
-    uint scl_pin
-)
+smbus_notify_result_t smbus_notify_host(i2c_inst_t* i2c, uint16_t status)
 {
-    assert(i2c == i2c0 || i2c == i2c1);
-    assert(SMBUS_MIN_BAUD_RATE_HZ <= baudrate && baudrate <= SMBUS_MAX_BAUD_RATE_HZ);
-    
     i2c_hw_t* hw = i2c_get_hw(i2c);
 
     uint i2c_index = i2c_hw_index(i2c);
     uint intr_num = I2C0_IRQ + i2c_index;
     smbus_slave_t* slave = &smbus_slaves[i2c_index];
 
-    memset(slave, 0, sizeof(smbus_slave_t));
+    // Host Notify: our address in place of a command, then the status word
+    uint8_t message[] = { (uint8_t)(slave->address << 1), (uint8_t)status, (uint8_t)(status >> 8) };
+    smbus_notify_result_t result = SMBUS_NOTIFY_ARB_LOST;
 
-    smbus_init_i2c_gpio(sda_pin);
-    smbus_init_i2c_gpio(scl_pin);
+    // Masking the IRQ only keeps the ISR out on its own core
+    assert(get_core_num() == slave->core_num);
 
-    i2c_init(i2c, baudrate);
-    i2c_set_slave_mode(i2c, true, address);
-    
-    hw->intr_mask = I2C_IC_INTR_MASK_M_START_DET_BITS
-                  | I2C_IC_INTR_MASK_M_RESTART_DET_BITS
-                  | I2C_IC_INTR_MASK_M_TX_ABRT_BITS
-                  | I2C_IC_INTR_MASK_M_STOP_DET_BITS
-                  | I2C_IC_INTR_MASK_M_RX_FULL_BITS
-                  | I2C_IC_INTR_MASK_M_RD_REQ_BITS;
+    for (uint attempt = 0; attempt < SMBUS_NOTIFY_RETRIES && result == SMBUS_NOTIFY_ARB_LOST; ++attempt)
+    {
+        // While in master mode the slave address is not acknowledged anyway
+        irq_set_enabled(intr_num, false);
 
-    irq_set_exclusive_handler(intr_num, smbus_slave_irq_handler);
-    irq_set_enabled(intr_num, true);
+        if(hw->status & I2C_IC_STATUS_ACTIVITY_BITS)
+        {
+            result = SMBUS_NOTIFY_BUSY;
+        }
+        else
+        {
+            // The controller waits for a free bus before its START
+            result = smbus_master_write(i2c, SMBUS_HOST_NOTIFY_ADDRESS, message, sizeof(message));
+        }
 
-    slave->sda_pin = sda_pin;
-    slave->scl_pin = scl_pin;
+        irq_set_enabled(intr_num, true);
+    }
+
+    return result;
 }
 
-void smbus_slave_deinit(
-    i2c_inst_t* i2c
-)
+void smbus_set_alert(i2c_inst_t* i2c, bool is_enabled, uint alert_pin)
 {
-    assert(i2c == i2c0 || i2c == i2c1);
-
-    i2c_hw_t *hw = i2c_get_hw(i2c);
-
     uint i2c_index = i2c_hw_index(i2c);
     uint intr_num = I2C0_IRQ + i2c_index;
     smbus_slave_t* slave = &smbus_slaves[i2c_index];
 
-    irq_set_enabled(intr_num, false);
-    irq_remove_handler(intr_num, smbus_slave_irq_handler);
-    hw->intr_mask = I2C_IC_INTR_MASK_RESET;
+    assert(get_core_num() == slave->core_num);
 
-    i2c_set_slave_mode(i2c, false, 0);
-    
-    gpio_deinit(slave->sda_pin);
-    gpio_deinit(slave->scl_pin);
-    
-    memset(slave, 0, sizeof(smbus_slave_t));
-}
+    if(slave->is_alert_enabled)
+    {
+        irq_set_enabled(intr_num, false);
+
+        if(slave->is_alert_raised)
+        {
+            smbus_slave_set_address(i2c_index, slave->address);
+        }
 
+        slave->is_alert_enabled = false;
+        slave->is_alert_raised = false;
+        slave->is_alert_answered = false;
 
-void smbus_set_quick_handler(i2c_inst_t* i2c, quick_handler_t quick_handler)
-{
-    uint i2c_index = i2c_hw_index(i2c);
-    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+        irq_set_enabled(intr_num, true);
 
-    slave->quick_handler = quick_handler;
+        gpio_deinit(slave->alert_pin);
+    }
+
+    if(is_enabled)
+    {
+        // Open drain: driven low while raised, released to the pull-up otherwise
+        gpio_init(alert_pin);
+        gpio_put(alert_pin, false);
+        gpio_set_dir(alert_pin, GPIO_IN);
+        gpio_pull_up(alert_pin);
+
+        slave->alert_pin = alert_pin;
+        slave->is_alert_enabled = true;
+    }
 }
 
-void smbus_set_write_reg_handler(i2c_inst_t* i2c, write_reg_handler_t handler)
+bool smbus_get_alert(i2c_inst_t* i2c)
 {
     uint i2c_index = i2c_hw_index(i2c);
     smbus_slave_t* slave = &smbus_slaves[i2c_index];
 
-    slave->write_reg_handler = handler;
+    return slave->is_alert_enabled;
 }
 
-void smbus_set_write_data_handler(i2c_inst_t* i2c, write_data_handler_t handler)
+smbus_notify_result_t smbus_alert_host(i2c_inst_t* i2c)
 {
+    i2c_hw_t* hw = i2c_get_hw(i2c);
+
     uint i2c_index = i2c_hw_index(i2c);
+    uint intr_num = I2C0_IRQ + i2c_index;
     smbus_slave_t* slave = &smbus_slaves[i2c_index];
+    smbus_notify_result_t result = SMBUS_NOTIFY_OK;
+
+    assert(slave->is_alert_enabled);
+    assert(get_core_num() == slave->core_num);
+
+    irq_set_enabled(intr_num, false);
+
+    if(!slave->is_alert_raised)
+    {
+        if(hw->status & I2C_IC_STATUS_ACTIVITY_BITS)
+        {
+            result = SMBUS_NOTIFY_BUSY;
+        }
+        else
+        {
+            // Answer at the Alert Response Address before the host can read it
+            smbus_slave_set_address(i2c_index, SMBUS_ALERT_RESPONSE_ADDRESS);
+            gpio_set_dir(slave->alert_pin, GPIO_OUT);
+
+            slave->is_alert_raised = true;
+        }
+    }
+
+    irq_set_enabled(intr_num, true);
 
-    slave->write_data_handler = handler;
+    return result;
 }
 
-void smbus_set_read_reg_handler(i2c_inst_t* i2c, read_reg_handler_t handler)
+bool smbus_is_alert_raised(i2c_inst_t* i2c)
 {
     uint i2c_index = i2c_hw_index(i2c);
     smbus_slave_t* slave = &smbus_slaves[i2c_index];
 
-    slave->read_reg_handler = handler;
+    return slave->is_alert_raised;
 }
 
-void smbus_set_read_data_handler(i2c_inst_t* i2c, read_data_handler_t handler)
+
+void smbus_get_stats(i2c_inst_t* i2c, smbus_stats_t* stats)
 {
     uint i2c_index = i2c_hw_index(i2c);
     smbus_slave_t* slave = &smbus_slaves[i2c_index];
 
-    slave->read_data_handler = handler;
+    *stats = slave->stats;
 }
 
-void smbus_set_proc_call_handler(i2c_inst_t* i2c, proc_call_handler_t handler)
+void smbus_reset_stats(i2c_inst_t* i2c)
 {
     uint i2c_index = i2c_hw_index(i2c);
     smbus_slave_t* slave = &smbus_slaves[i2c_index];
 
-    slave->proc_call_handler = handler;
+    memset(&slave->stats, 0, sizeof(smbus_stats_t));
 }
 
-void smbus_reset_handler(i2c_inst_t* i2c, smbus_slave_event_t slave_event)
+size_t smbus_trace_read(smbus_trace_cursor_t* cursor, smbus_trace_record_t records[], size_t max_records)
 {
-    uint i2c_index = i2c_hw_index(i2c);
-    smbus_slave_t* slave = &smbus_slaves[i2c_index];
-    
-    switch (slave_event)
+    size_t count = 0;
+
+#if SMBUS_TRACE_LEN > 0
+    while (count < max_records)
     {
-        case SMBUS_SLAVE_QUICK:
-            slave->quick_handler = NULL;
-            break;
-        case SMBUS_SLAVE_WRITE_REG:
-            slave->write_reg_handler = NULL;
-            break;
-        case SMBUS_SLAVE_WRITE_DATA:
-            slave->write_data_handler = NULL;
-            break;
-        case SMBUS_SLAVE_READ_REG:
-            slave->read_reg_handler = NULL;
-            break;
-        case SMBUS_SLAVE_READ_DATA:
-            slave->read_data_handler = NULL;
-            break;
-        case SMBUS_SLAVE_PROC_CALL:
-            slave->proc_call_handler = NULL;
+        uint32_t head = smbus_trace.head;
+
+        __mem_fence_acquire();
+
+        if(cursor->next == head)
+        {
             break;
-    }
-}
+        }
 
-void smbus_set_pec(i2c_inst_t* i2c, bool is_enabled)
-{
-    uint i2c_index = i2c_hw_index(i2c);
-    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+        // The ISR is about to overwrite the oldest slot, skip it as well
+        if(head - cursor->next >= SMBUS_TRACE_LEN)
+        {
+            cursor->lost += head - cursor->next - (SMBUS_TRACE_LEN - 1);
+            cursor->next = head - (SMBUS_TRACE_LEN - 1);
+        }
 
-    slave->is_pec_enabled = is_enabled;
-}
+        smbus_trace_entry_t entry = smbus_trace.entries[cursor->next % SMBUS_TRACE_LEN];
 
-bool smbus_get_pec(i2c_inst_t* i2c)
-{
-    uint i2c_index = i2c_hw_index(i2c);
-    smbus_slave_t* slave = &smbus_slaves[i2c_index];
+        // The copy only counts if the slot was not reused meanwhile
+        __mem_fence_acquire();
 
-    return slave->is_pec_enabled;
+        if(smbus_trace.head - cursor->next >= SMBUS_TRACE_LEN)
+        {
+            cursor->lost += 1;
+        }
+        else
+        {
+            uint32_t cycles_per_us = smbus_slaves[entry.record.bus_index].cycles_per_us;
+
+            records[count] = entry.record;
+            records[count].handler_us = (uint16_t)MIN(entry.handler_cycles / cycles_per_us, UINT16_MAX);
+            count += 1;
+        }
+
+        cursor->next += 1;
+    }
+#endif
+
+    return count;
 }